@@ -12,6 +12,7 @@
         glfw3
         pkg-config
         ffmpeg_6-full
+        liburing
       ];
     };
   };
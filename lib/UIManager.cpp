@@ -1,12 +1,25 @@
 #include "UIManager.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+static ImU32 bookmarkColor(BookmarkKind kind) {
+  if (kind == BookmarkKind::Motion) {
+    return IM_COL32(255, 160, 0, 255);
+  } else if (kind == BookmarkKind::Loudness) {
+    return IM_COL32(0, 200, 255, 255);
+  }
+  return IM_COL32(255, 0, 0, 255);
+}
 
 UIManager::UIManager() {
 
 }
 
 UIManager::~UIManager() {
-
+  this->saveMarkers();
 }
 
 bool UIManager::init(MediaPlayer* mediaPlayer, int* windowWidth, int* windowHeight, GLFWwindow* window, char* openglVersion, float* videoAspectRatio) {
@@ -61,6 +74,8 @@ void UIManager::render() {
   ImGui_ImplGlfw_NewFrame();
   ImGui::NewFrame();
 
+  this->syncRecording();
+
   // Render components
   renderToolBar();
   renderSideBar();
@@ -76,15 +91,83 @@ void UIManager::renderToolBar() {
   ImGui::BeginMainMenuBar();
   if (ImGui::BeginMenu("File")) {
     if (ImGui::MenuItem("New")) {}
-    if (ImGui::MenuItem("Open")) {}
-    if (ImGui::MenuItem("Save")) {}
+    // Edits are already journaled, Open reads the project back and Save compacts it
+    bool hasProject = this->project.isOpen();
+    if (ImGui::MenuItem("Open", NULL, false, hasProject)) {
+      this->openProject();
+    }
+    if (ImGui::MenuItem("Save", NULL, false, hasProject)) {
+      this->saveMarkers();
+      this->project.compact();
+    }
+    ImGui::Separator();
+    std::shared_ptr<const TimelineIndex> index = this->mediaPlayer->getTimelineIndex();
+    bool canExport = index && !index->empty() && !this->exportStatus.running;
+    if (ImGui::MenuItem("Export Without Dead Time", NULL, false, canExport)) {
+      this->exportRange({ index->getStartPts(), index->getEndPts() + index->getAverageFrameDuration() }, "trimmed", true);
+    }
+    ImGui::MenuItem("Cut Dead Time From Clips", NULL, &this->cutDeadTimeFromClips);
+    ImGui::Separator();
+    if (ImGui::MenuItem(this->recorder.isRecording() ? "Stop Recording" : "Record Screen", "Ctrl+R")) {
+      this->toggleRecording();
+    }
     ImGui::EndMenu();
   }
   if (ImGui::BeginMenu("Edit")) {
-    if (ImGui::MenuItem("Undo")) {}
-    if (ImGui::MenuItem("Redo")) {}
+    if (ImGui::MenuItem("Undo", "Ctrl+Z", false, this->history.canUndo())) {
+      this->undo();
+    }
+    if (ImGui::MenuItem("Redo", "Ctrl+Y", false, this->history.canRedo())) {
+      this->redo();
+    }
     ImGui::EndMenu();
   }
+  if (ImGui::BeginMenu("Playback")) {
+    bool liveFollow = this->mediaPlayer->isLiveFollow();
+    if (ImGui::MenuItem("Follow Live Recording", NULL, &liveFollow)) {
+      this->mediaPlayer->setLiveFollow(liveFollow);
+    }
+    if (ImGui::MenuItem("Jump to Live", NULL, false, liveFollow)) {
+      this->mediaPlayer->jumpToLive();
+    }
+    bool reviewing = this->mediaPlayer->getMemoryStream() != nullptr;
+    if (ImGui::MenuItem("Review Replay Buffer", NULL, false, this->recorder.isRecording() && !reviewing)) {
+      this->reviewReplayBuffer();
+    }
+    ImGui::Separator();
+    if (ImGui::MenuItem("Shuttle Reverse", "J")) {
+      this->mediaPlayer->shuttleBackward();
+    }
+    if (ImGui::MenuItem("Stop", "K")) {
+      this->mediaPlayer->shuttleStop();
+    }
+    if (ImGui::MenuItem("Shuttle Forward", "L")) {
+      this->mediaPlayer->shuttleForward();
+    }
+    bool reverse = this->mediaPlayer->isReverse();
+    if (ImGui::MenuItem("Reverse", NULL, &reverse)) {
+      this->mediaPlayer->setReverse(reverse);
+    }
+    ImGui::Separator();
+    if (ImGui::MenuItem("Previous Frame", "Left")) {
+      this->mediaPlayer->stepBackward();
+    }
+    if (ImGui::MenuItem("Next Frame", "Right")) {
+      this->mediaPlayer->stepForward();
+    }
+    ImGui::EndMenu();
+  }
+
+  // Recorder and writer health while recording, debug only
+  if (this->debug && this->recorder.isRecording()) {
+    RecorderStats stats = this->recorder.getStats();
+    AsyncWriterStats writer = this->recorder.getWriterStats();
+    ImGui::Separator();
+    ImGui::Text("REC %llu frames, %llu dropped, tuner %d | %s %.1f MB/s, queue %zu (max %zu), %llu spilled, %.1f ms/write",
+      (unsigned long long)stats.framesEncoded, (unsigned long long)stats.framesDropped, stats.tunerLevel,
+      writer.backend.c_str(), writer.throughput, writer.queueDepth, writer.maxQueueDepth,
+      (unsigned long long)writer.spilledBlocks, writer.averageWriteLatency * 1000.0);
+  }
 
   // Update height
   this->toolBarHeight = ImGui::GetWindowSize()[1];
@@ -103,20 +186,89 @@ void UIManager::renderSideBar() {
     std::cout << "[INFO]: Create Clip" << std::endl;
     double currentPts = this->mediaPlayer->getVideoFrame().pts;
     double clipEndPts = std::min(currentPts+this->mediaPlayer->getTotalDuration()*0.01, this->mediaPlayer->getTotalDuration());
-    this->clips.push_back(Clip(currentPts, clipEndPts, "Clip"));
+    this->clips.push_back({ currentPts, clipEndPts, this->clipNames.intern("Clip"), this->nextClipId++ });
+    // A clip made on the recording in progress gets a keyframe at its start, so it cuts cleanly
+    if (this->recorder.isRecording() && this->mediaPlayer->getFileName() == this->recordingFile)
+      this->recorder.forceKeyframe(currentPts);
+    this->clipsChanged = true;
+    this->saveClip(this->clips.back());
+    this->recordEdit(nullptr, &this->clips.back());
   }
+  ImGui::SameLine();
+  ImGui::TextDisabled("%zu", this->clips.size());
+
+  renderExportStatus();
+
+  // Only the rows in view are laid out, so the list costs the same with 50 clips or 50k
+  ImGui::BeginChild("##ClipList", ImVec2(0.0f, 0.0f));
+  bool exporting = this->exportStatus.running;
+  float buttonsWidth = ImGui::CalcTextSize("ExportDelete").x + ImGui::GetStyle().FramePadding.x * 4.0f + ImGui::GetStyle().ItemSpacing.x * 2.0f;
+  int deleted = -1;
+  ImGuiListClipper clipper;
+  clipper.Begin((int)this->clips.size());
+  while (clipper.Step()) {
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+      Clip& c = this->clips[i];
+      ImGui::PushID(i);
+
+      // Click seeks to the clip, double click renames it
+      float nameWidth = std::max(ImGui::GetContentRegionAvail().x - buttonsWidth, 20.0f);
+      if (this->renamingClip == i) {
+        ImGui::SetNextItemWidth(nameWidth);
+        if (!ImGui::IsAnyItemActive())
+          ImGui::SetKeyboardFocusHere();
+        bool entered = ImGui::InputText("##Name", this->renameBuffer, sizeof(this->renameBuffer), ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_AutoSelectAll);
+        if (entered || ImGui::IsItemDeactivated()) {
+          Clip before = c;
+          c.name = this->clipNames.intern(this->renameBuffer);
+          this->renamingClip = -1;
+          if (c.name != before.name) {
+            this->saveClip(c);
+            this->recordEdit(&before, &c);
+          }
+        }
+      } else if (ImGui::Selectable(this->clipNames.get(c.name), false, ImGuiSelectableFlags_AllowDoubleClick, ImVec2(nameWidth, 0.0f))) {
+        if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
+          this->renamingClip = i;
+          std::strncpy(this->renameBuffer, this->clipNames.get(c.name), sizeof(this->renameBuffer) - 1);
+          this->renameBuffer[sizeof(this->renameBuffer) - 1] = '\0';
+        } else {
+          this->mediaPlayer->seek(c.time_start);
+        }
+      }
+      if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("%.2fs - %.2fs", c.time_start, c.time_end);
+
+      ImGui::SameLine();
+      ImGui::BeginDisabled(exporting);
+      if (ImGui::SmallButton("Export")) {
+        this->exportRange({ c.time_start, c.time_end }, "clip" + std::to_string(i + 1), this->cutDeadTimeFromClips);
+      }
+      ImGui::EndDisabled();
+
+      ImGui::SameLine();
+      if (ImGui::SmallButton("Delete")) {
+        deleted = i;
+      }
+      ImGui::PopID();
+    }
+  }
+  ImGui::EndChild();
 
-  for (int i = 0; i < this->clips.size(); i++) {
-    Clip c = this->clips[i];
-
-    ImGui::InputText(("##ClipName" + std::to_string(i)).c_str(), c.name, c.buffer_size);
-    //ImGui::InputDouble(("##PTS" + std::to_string(i)).c_str(), &c.time_start, c.buffer_size);
+  if (this->debug && ImGui::IsItemHovered()) {
+    ProjectStats stats = this->project.getStats();
+    ImGui::SetTooltip("Project: %lld KB (%lld KB live), %llu appends, %llu compactions, loaded in %.1f ms",
+      (long long)stats.fileBytes / 1024, (long long)stats.liveBytes / 1024, (unsigned long long)stats.appends,
+      (unsigned long long)stats.compactions, stats.loadMs);
+  }
 
-    ImGui::SameLine(); 
-    if (ImGui::Button(("Delete##" + std::to_string(i)).c_str())) {
-      clips.erase(this->clips.begin() + i);
-      break;
-    }
+  if (deleted >= 0) {
+    this->project.removeClip(this->clips[deleted].id);
+    this->recordEdit(&this->clips[deleted], nullptr);
+    this->clips.erase(this->clips.begin() + deleted);
+    this->clipsChanged = true;
+    if (this->renamingClip >= deleted)
+      this->renamingClip = -1;
   }
   ImGui::End();
 }
@@ -168,23 +320,30 @@ void UIManager::renderSeekBar() {
   bool mouseDown = ImGui::IsMouseDown(0);
 
   // Pre-calculate target time in case of seek
+  // The bar spans the index, which starts past 0 once a replay buffer has dropped its head
+  std::shared_ptr<const TimelineIndex> index = this->mediaPlayer->getTimelineIndex();
+  double origin = index && !index->empty() ? index->getStartPts() : 0.0;
   double totalDuration = this->mediaPlayer->getTotalDuration();
   double relative_x = std::min(std::max((mousePos.x - barPos.x) / barWidth, 0.0), barWidth);
-  double targetTime = this->findNearestPts(relative_x * totalDuration);
+  double targetTime = this->findNearestPts(origin + relative_x * totalDuration);
 
   // Draw the progress bar
   static float g_progress = 0.0f;
-  g_progress = (mouseDown && ImGui::IsItemClicked()) ? (targetTime / totalDuration) : this->mediaPlayer->getProgress() / 100.0;
+  g_progress = (mouseDown && ImGui::IsItemClicked()) ? ((targetTime - origin) / totalDuration) : this->mediaPlayer->getProgress() / 100.0;
   ImGui::ProgressBar(g_progress, barSize, "");
+  this->syncBookmarks();
+  renderDeadTime(barPos, (float)barWidth, ImGui::GetItemRectSize().y, totalDuration);
   
   // Check if mouse is over the progress bar
   bool hovered = mousePos.y >= barPos.y && mousePos.y <= barPos.y + barSize.y && mousePos.x >= barPos.x && mousePos.x <= barPos.x + barWidth;
 
+  this->syncThumbnailSource();
+
   if (hovered) {
     if (ImGui::IsMouseClicked(0)) {
       g_seeking = true;
     }
-    renderSeekPreview(barPos.y);
+    renderSeekPreview(barPos.y, targetTime);
   }
   
   if (g_seeking && mouseDown) {
@@ -198,13 +357,30 @@ void UIManager::renderSeekBar() {
 
   ImGui::PopStyleColor(2);
 
-  // TODO: Convert timestamp to percent
-  std::vector<float> bookmarks = { 0.25f, 0.5f, 0.75f };
+  // Waveform of the whole recording right under the bar, skipped when the bar is too short for it.
+  // Drawn first so the clip handles stay on top, its space is reserved after them since
+  // those size themselves from the last item.
+  bool showWaveform = this->bottomBarHeight >= 120;
+  ImVec2 wavePos = ImVec2(barPos.x, ImGui::GetCursorScreenPos().y);
+  if (showWaveform) {
+    ImGui::GetWindowDrawList()->AddRectFilled(wavePos, ImVec2(wavePos.x + (float)barWidth, wavePos.y + this->waveformHeight), IM_COL32(40, 40, 40, 255));
+    renderWaveform(wavePos, (float)barWidth, this->waveformHeight, origin, origin + totalDuration, IM_COL32(110, 150, 200, 255), IM_COL32(170, 210, 255, 255));
+  }
 
   renderClipCreator(barPos);
-  renderBookmarks(barPos, bookmarks);
+  renderBookmarks(barPos, this->bookmarks, totalDuration);
   renderClipBoxes(barPos, this->clips, totalDuration);
 
+  if (showWaveform) {
+    ImGui::Dummy(ImVec2((float)barWidth, this->waveformHeight));
+    if (this->debug && ImGui::IsItemHovered()) {
+      AudioPeakStats stats = this->audioPeaks.getStats();
+      ImGui::SetTooltip("%.1fs decoded, %zu buckets (%zu from sidecar), %zu KB, query %.1f us", stats.decodedSeconds,
+        stats.buckets, stats.sidecarBuckets, stats.memoryBytes / 1024, stats.lastQueryUs);
+    }
+  }
+
+
   // TODO: Move to helper function
   double currentFrameTime = mediaPlayer->getVideoFrame().pts;
   double currentTimeInMicroseconds = currentFrameTime * 1000000;
@@ -235,10 +411,459 @@ void UIManager::renderBottomBar() {
   // Render media buttons
   renderMediaButtons();
 
+  // Zoomable filmstrip in whatever height is left
+  renderTimeline();
+
   ImGui::End();
 }
 
-void UIManager::renderSeekPreview(int seekBarYPos) {
+void UIManager::syncThumbnailSource() {
+  // Reopen the thumbnail decoder whenever the player loads something else
+  if (this->mediaPlayer->getSourceId() != this->thumbnailSourceId) {
+    this->thumbnailSourceId = this->mediaPlayer->getSourceId();
+    this->openProject();
+    std::shared_ptr<MemoryStream> stream = this->mediaPlayer->getMemoryStream();
+    bool opened = stream ? this->thumbnailEngine.open(stream) : this->thumbnailEngine.open(this->mediaPlayer->getFileName());
+    if (opened)
+      this->thumbnailAtlas.init(this->thumbnailEngine.getThumbnailWidth(), this->thumbnailEngine.getThumbnailHeight());
+
+    opened = stream ? this->filmstrip.open(stream) : this->filmstrip.open(this->mediaPlayer->getFileName());
+    if (opened)
+      this->filmstripAtlas.init(this->filmstrip.getTileWidth(), this->filmstrip.getTileHeight());
+    this->timelineStart = 0.0;
+    this->timelineSpan = 0.0;
+
+    if (stream) {
+      this->audioPeaks.open(stream);
+      this->sceneAnalyzer.open(stream);
+      this->hasAudio = this->loudnessAnalyzer.open(stream);
+    } else {
+      this->audioPeaks.open(this->mediaPlayer->getFileName());
+      this->sceneAnalyzer.open(this->mediaPlayer->getFileName());
+      this->hasAudio = this->loudnessAnalyzer.open(this->mediaPlayer->getFileName());
+    }
+  }
+
+  std::shared_ptr<const TimelineIndex> index = this->mediaPlayer->getTimelineIndex();
+  this->thumbnailEngine.setIndex(index);
+  this->filmstrip.setIndex(index);
+  this->audioPeaks.setIndex(index);
+  this->sceneAnalyzer.setIndex(index);
+  this->loudnessAnalyzer.setIndex(index);
+}
+
+void UIManager::syncBookmarks() {
+  // Both versions only ever go up, so their sum changes when either does
+  uint64_t version = this->sceneAnalyzer.getVersion() + this->loudnessAnalyzer.getVersion();
+  if (version != this->analysisVersion) {
+    this->analysisVersion = version;
+    this->bookmarks = this->sceneAnalyzer.getBookmarks();
+    std::vector<Bookmark> loudness = this->loudnessAnalyzer.getBookmarks();
+    this->bookmarks.insert(this->bookmarks.end(), loudness.begin(), loudness.end());
+
+    // Stored markers fill in wherever this session's analysis hasn't got to yet
+    double covered = this->sceneAnalyzer.getStats().analyzedSeconds;
+    if (this->hasAudio)
+      covered = std::min(covered, this->loudnessAnalyzer.getStats().analyzedSeconds);
+    auto firstStored = std::upper_bound(this->storedBookmarks.begin(), this->storedBookmarks.end(), covered,
+      [](double time, const Bookmark& bookmark) { return time < bookmark.time; });
+    this->bookmarks.insert(this->bookmarks.end(), firstStored, this->storedBookmarks.end());
+
+    std::sort(this->bookmarks.begin(), this->bookmarks.end(), [](const Bookmark& a, const Bookmark& b) { return a.time < b.time; });
+    std::vector<TimeSpan> points(this->bookmarks.size());
+    for (size_t i = 0; i < this->bookmarks.size(); i++)
+      points[i] = { this->bookmarks[i].time, this->bookmarks[i].time };
+    this->bookmarkIndex.build(points);
+
+    // Dead time has to be both still and silent, a recording without audio goes by the picture alone
+    std::vector<TimeSpan> silent = this->hasAudio ? this->loudnessAnalyzer.getSilentSpans() : std::vector<TimeSpan>{ { 0.0, INFINITY } };
+    this->deadSpans = intersectSpans(this->sceneAnalyzer.getStillSpans(), silent, this->minDeadTime);
+    for (const TimeSpan& span : this->storedDeadSpans) {
+      if (span.start >= covered)
+        this->deadSpans.push_back(span);
+    }
+  }
+
+  if (ImGui::GetTime() - this->markersSavedAt >= this->markerSaveInterval) {
+    this->markersSavedAt = ImGui::GetTime();
+    this->saveMarkers();
+  }
+}
+
+void UIManager::openProject() {
+  // Clips belong to the recording they were made on, so they're swapped along with it
+  this->saveMarkers();
+  this->project.close();
+  this->clips.clear();
+  this->clipsChanged = true;
+  this->renamingClip = -1;
+  this->nextClipId = 1;
+  this->history.clear();
+  this->storedBookmarks.clear();
+  this->storedDeadSpans.clear();
+
+  // The replay buffer has nothing on disk to sit next to
+  std::string fileName = this->mediaPlayer->getFileName();
+  if (!this->mediaPlayer->getMemoryStream() && !fileName.empty())
+    this->project.open(fileName + ".rwproj", this->clips, this->clipNames, this->storedBookmarks, this->storedDeadSpans);
+  for (const Clip& clip : this->clips)
+    this->nextClipId = std::max(this->nextClipId, clip.id + 1);
+
+  // Show what was stored right away, and don't write it straight back
+  this->analysisVersion = UINT64_MAX;
+  this->markersSavedVersion = UINT64_MAX;
+  this->markersSavedAt = ImGui::GetTime();
+}
+
+void UIManager::saveClip(const Clip& clip) {
+  this->project.putClip(clip, this->clipNames.get(clip.name));
+}
+
+void UIManager::recordEdit(const Clip* before, const Clip* after, bool merge) {
+  ClipEdit edit;
+  edit.hadBefore = before != nullptr;
+  edit.hasAfter = after != nullptr;
+  if (before)
+    edit.before = *before;
+  if (after)
+    edit.after = *after;
+  this->history.record(edit, merge);
+}
+
+void UIManager::setClip(uint32_t id, const Clip* clip) {
+  // Ids follow creation order, so an undone delete lands back where it was
+  auto it = std::lower_bound(this->clips.begin(), this->clips.end(), id, [](const Clip& c, uint32_t id) { return c.id < id; });
+  bool exists = it != this->clips.end() && it->id == id;
+  if (clip && exists) {
+    *it = *clip;
+  } else if (clip) {
+    this->clips.insert(it, *clip);
+  } else if (exists) {
+    this->clips.erase(it);
+  }
+
+  if (clip) {
+    this->saveClip(*clip);
+  } else if (exists) {
+    this->project.removeClip(id);
+  }
+  this->clipsChanged = true;
+  this->renamingClip = -1;
+}
+
+void UIManager::undo() {
+  ClipEdit edit;
+  if (this->history.undo(edit)) {
+    this->setClip(edit.hasAfter ? edit.after.id : edit.before.id, edit.hadBefore ? &edit.before : nullptr);
+  }
+}
+
+void UIManager::redo() {
+  ClipEdit edit;
+  if (this->history.redo(edit)) {
+    this->setClip(edit.hasAfter ? edit.after.id : edit.before.id, edit.hasAfter ? &edit.after : nullptr);
+  }
+}
+
+void UIManager::saveMarkers() {
+  if (this->analysisVersion == this->markersSavedVersion || this->analysisVersion == UINT64_MAX) {
+    return;
+  }
+  this->project.putMarkers(this->bookmarks, this->deadSpans);
+  this->markersSavedVersion = this->analysisVersion;
+}
+
+void UIManager::renderDeadTime(ImVec2 barPos, float barWidth, float barHeight, double duration) {
+  if (duration <= 0.0) {
+    return;
+  }
+
+  ImDrawList* drawList = ImGui::GetWindowDrawList();
+  for (const TimeSpan& span : this->deadSpans) {
+    float x0 = barPos.x + (float)(span.start / duration) * barWidth;
+    float x1 = barPos.x + (float)(std::min(span.end, duration) / duration) * barWidth;
+    drawList->AddRectFilled(ImVec2(x0, barPos.y), ImVec2(std::max(x1, x0 + 1.0f), barPos.y + barHeight), IM_COL32(0, 0, 0, 110));
+  }
+}
+
+void UIManager::startRecording() {
+  // Joins the threads of a recording that ended on its own
+  this->recorder.stop();
+
+  char name[64];
+  time_t now = time(nullptr);
+  strftime(name, sizeof(name), "recording-%Y%m%d-%H%M%S.mp4", localtime(&now));
+
+  // The desktop can't wait for the encoder, so it trades quality and frame rate for latency
+  RecorderConfig config;
+  config.autoTune = true;
+  config.replayBufferSeconds = this->replayBufferSeconds;
+  config.asyncWriter = true;
+  if (!this->recorder.start(&this->screenCapture, name, config)) {
+    std::cout << "Recording: could not start" << std::endl;
+    return;
+  }
+  this->recordingFile = name;
+  this->recordingStartedAt = ImGui::GetTime();
+  this->recordingLoaded = false;
+}
+
+void UIManager::stopRecording() {
+  this->recorder.stop();
+  if (this->recordingFile.empty()) {
+    return;
+  }
+
+  // Pick up the last fragment, or open a recording too short to have been opened live
+  if (this->recordingLoaded && this->mediaPlayer->getFileName() == this->recordingFile) {
+    this->mediaPlayer->refreshIndex();
+    this->mediaPlayer->setLiveFollow(false);
+  } else {
+    this->mediaPlayer->loadFile(this->recordingFile);
+  }
+  this->recordingLoaded = true;
+}
+
+void UIManager::toggleRecording() {
+  if (this->recorder.isRecording()) {
+    this->stopRecording();
+  } else {
+    this->startRecording();
+  }
+}
+
+void UIManager::syncRecording() {
+  if (this->recordingLoaded || this->recordingFile.empty() || !this->recorder.isRecording()) {
+    return;
+  }
+  if (ImGui::GetTime() - this->recordingStartedAt < this->recordingLoadDelay) {
+    return;
+  }
+
+  // Fragments are self-contained, the player can follow the file while it grows
+  if (this->mediaPlayer->loadFile(this->recordingFile)) {
+    this->mediaPlayer->setLiveFollow(true);
+    this->mediaPlayer->jumpToLive();
+    this->recordingLoaded = true;
+  } else {
+    this->recordingStartedAt = ImGui::GetTime();
+  }
+}
+
+void UIManager::reviewReplayBuffer() {
+  std::shared_ptr<MemoryStream> stream = this->recorder.getReplayBuffer();
+  if (!stream) {
+    return;
+  }
+
+  // Plays from the oldest fragment still in memory and keeps following the ring. Counts as the
+  // recording being loaded, so the file doesn't replace it until the recording stops.
+  if (this->mediaPlayer->loadStream(stream)) {
+    this->mediaPlayer->setLiveFollow(true);
+    this->mediaPlayer->play();
+    this->recordingLoaded = true;
+  } else {
+    std::cout << "Recording: the replay buffer has no complete fragment yet" << std::endl;
+  }
+}
+
+void UIManager::exportRange(TimeSpan range, const std::string& suffix, bool cutDeadTime) {
+  std::shared_ptr<const TimelineIndex> index = this->mediaPlayer->getTimelineIndex();
+  if (!index || index->empty()) {
+    return;
+  }
+
+  // Next to the recording, or the working directory for the replay buffer
+  std::string base = this->mediaPlayer->getFileName();
+  std::shared_ptr<MemoryStream> stream = this->mediaPlayer->getMemoryStream();
+  if (stream || base.empty())
+    base = "replay.mp4";
+  size_t dot = base.find_last_of('.');
+  size_t slash = base.find_last_of("/\\");
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    base = base.substr(0, dot);
+  std::string outputFile = base + "-" + suffix + ".mp4";
+
+  std::vector<TimeSpan> segments = cutDeadTime ? ClipExporter::planSegments(*index, range, this->deadSpans) : ClipExporter::planPlain(*index, range);
+  if (stream) {
+    this->clipExporter.start(stream, outputFile, segments);
+  } else {
+    this->clipExporter.start(this->mediaPlayer->getFileName(), outputFile, segments);
+  }
+  this->exportStatus = this->clipExporter.getStatus();
+}
+
+void UIManager::renderExportStatus() {
+  // The full status has strings in it, it's only copied again once the export ends
+  bool running = this->clipExporter.isRunning();
+  if (running != this->exportStatus.running) {
+    this->exportStatus = this->clipExporter.getStatus();
+  } else if (running) {
+    this->exportStatus.progress = this->clipExporter.getProgress();
+  }
+
+  const ExportStatus& status = this->exportStatus;
+  if (status.outputFile.empty()) {
+    return;
+  }
+
+  ImGui::SeparatorText("Export");
+  ImGui::TextWrapped("%s", status.outputFile.c_str());
+  if (status.running) {
+    ImGui::ProgressBar((float)status.progress, ImVec2(-FLT_MIN, 0.0f));
+    if (ImGui::Button("Cancel Export"))
+      this->clipExporter.cancel();
+  } else if (status.succeeded) {
+    ImGui::Text("Done, %.1fs kept", status.keptSeconds);
+  } else {
+    ImGui::TextDisabled("Failed: %s", status.error.c_str());
+  }
+}
+
+void UIManager::renderWaveform(ImVec2 pos, float width, float height, double start, double end, ImU32 peakColor, ImU32 rmsColor) {
+  size_t columns = (size_t)std::max(width, 0.0f);
+  if (this->waveformColumns.size() < columns)
+    this->waveformColumns.resize(columns);
+  size_t filled = this->audioPeaks.query(start, end, columns, this->waveformColumns.data());
+
+  // One pixel column each, min/max as the outline and RMS as the brighter core
+  ImDrawList* drawList = ImGui::GetWindowDrawList();
+  float mid = pos.y + height * 0.5f;
+  float scale = height * 0.5f;
+  for (size_t column = 0; column < filled; column++) {
+    const AudioPeak& peak = this->waveformColumns[column];
+    float x = pos.x + column;
+    float top = mid - std::min(peak.max, 1.0f) * scale;
+    float bottom = mid - std::max(peak.min, -1.0f) * scale;
+    drawList->AddRectFilled(ImVec2(x, top), ImVec2(x + 1.0f, std::max(bottom, top + 1.0f)), peakColor);
+
+    float rms = std::min(std::sqrt(peak.meanSquare), 1.0f) * scale;
+    if (rms >= 0.5f)
+      drawList->AddRectFilled(ImVec2(x, mid - rms), ImVec2(x + 1.0f, mid + rms), rmsColor);
+  }
+}
+
+void UIManager::renderTimeline() {
+  std::shared_ptr<const TimelineIndex> index = this->mediaPlayer->getTimelineIndex();
+  float trackHeight = std::min(ImGui::GetContentRegionAvail().y, 64.0f);
+  float trackWidth = ImGui::GetContentRegionAvail().x;
+  if (!index || index->empty() || trackHeight < 24.0f || trackWidth <= 0.0f || this->filmstrip.getTileHeight() <= 0) {
+    return;
+  }
+
+  ImVec2 trackPos = ImGui::GetCursorScreenPos();
+  ImGui::InvisibleButton("##timeline", ImVec2(trackWidth, trackHeight));
+  bool hovered = ImGui::IsItemHovered();
+  ImGuiIO& io = ImGui::GetIO();
+
+  // Visible window, span 0 means the whole recording
+  double start = index->getStartPts();
+  double duration = std::max(index->getDuration(), 1e-3);
+  double minSpan = std::max(index->getAverageFrameDuration() * 8.0, 0.05);
+  if (this->timelineSpan <= 0.0 || this->timelineSpan > duration) {
+    this->timelineSpan = duration;
+    this->timelineStart = start;
+  }
+
+  // Wheel zooms around the cursor, dragging pans, a click seeks
+  double mouseTime = this->timelineStart + (io.MousePos.x - trackPos.x) / trackWidth * this->timelineSpan;
+  if (hovered && io.MouseWheel != 0.0f) {
+    double span = std::clamp(this->timelineSpan * std::pow(0.8, io.MouseWheel), minSpan, duration);
+    this->timelineStart = mouseTime - (mouseTime - this->timelineStart) * span / this->timelineSpan;
+    this->timelineSpan = span;
+  }
+  if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
+    this->timelineStart -= io.MouseDelta.x / trackWidth * this->timelineSpan;
+  }
+  if (ImGui::IsItemDeactivated() && io.MouseDragMaxDistanceSqr[ImGuiMouseButton_Left] < io.MouseDragThreshold * io.MouseDragThreshold) {
+    this->mediaPlayer->seek(this->findNearestPts(mouseTime));
+    this->mediaPlayer->pause();
+  }
+  this->timelineStart = std::clamp(this->timelineStart, start, start + duration - this->timelineSpan);
+
+  // Coarsest level that still has a distinct tile for every tile drawn, per-frame below that
+  float tileWidth = trackHeight * this->filmstrip.getTileWidth() / this->filmstrip.getTileHeight();
+  double secondsPerTile = tileWidth / trackWidth * this->timelineSpan;
+  int level = this->filmstrip.getLevelCount() - 1;
+  for (int l = 0; l < this->filmstrip.getLevelCount() - 1; l++) {
+    if (this->filmstrip.getLevelInterval(l) <= secondsPerTile) {
+      level = l;
+      break;
+    }
+  }
+
+  ImDrawList* drawList = ImGui::GetWindowDrawList();
+  drawList->PushClipRect(trackPos, ImVec2(trackPos.x + trackWidth, trackPos.y + trackHeight), true);
+  drawList->AddRectFilled(trackPos, ImVec2(trackPos.x + trackWidth, trackPos.y + trackHeight), IM_COL32(30, 30, 30, 255));
+
+  // Tiles are anchored to time so they don't swim while panning
+  double firstTile = std::floor((this->timelineStart - start) / secondsPerTile);
+  for (double t = firstTile; start + t * secondsPerTile < this->timelineStart + this->timelineSpan; t++) {
+    double time = start + t * secondsPerTile;
+    float x = trackPos.x + (float)((time - this->timelineStart) / this->timelineSpan * trackWidth);
+
+    // Finer tiles stream in over the coarser ones already resident
+    std::shared_ptr<const Thumbnail> tile;
+    uint64_t key = 0;
+    for (int l = level; l >= 0 && !tile; l--) {
+      int64_t slot = this->filmstrip.slotForTime(l, time);
+      tile = this->filmstrip.getTile(l, slot, l == level);
+      key = this->filmstrip.getTileKey(l, slot);
+    }
+
+    ImVec2 uv0, uv1;
+    if (tile && this->filmstripAtlas.get(key, *tile, &uv0, &uv1)) {
+      drawList->AddImage(this->filmstripAtlas.getTextureId(), ImVec2(x, trackPos.y), ImVec2(x + tileWidth, trackPos.y + trackHeight), uv0, uv1);
+    }
+  }
+
+  // Waveform of the visible window along the bottom of the strip
+  float waveHeight = trackHeight * 0.4f;
+  renderWaveform(ImVec2(trackPos.x, trackPos.y + trackHeight - waveHeight), trackWidth, waveHeight, this->timelineStart,
+    this->timelineStart + this->timelineSpan, IM_COL32(110, 150, 200, 140), IM_COL32(170, 210, 255, 170));
+
+  renderTimelineMarkers(trackPos, trackWidth, trackHeight);
+
+  // Playhead
+  double playhead = this->mediaPlayer->getVideoFrame().pts;
+  if (playhead >= this->timelineStart && playhead <= this->timelineStart + this->timelineSpan) {
+    float x = trackPos.x + (float)((playhead - this->timelineStart) / this->timelineSpan * trackWidth);
+    drawList->AddLine(ImVec2(x, trackPos.y), ImVec2(x, trackPos.y + trackHeight), IM_COL32(255, 0, 0, 255), 2.0f);
+  }
+  drawList->PopClipRect();
+
+  if (this->debug && hovered) {
+    FilmstripStats stats = this->filmstrip.getStats();
+    ImGui::SetTooltip("Level %d, %zu tiles resident (%zu KB), %llu built, %llu from sidecar", level, stats.residentTiles,
+      stats.residentBytes / 1024, (unsigned long long)stats.tilesBuilt, (unsigned long long)stats.tilesLoaded);
+  }
+}
+
+void UIManager::renderTimelineMarkers(ImVec2 trackPos, float trackWidth, float trackHeight) {
+  // Only clips and bookmarks inside the zoomed window are looked at
+  ImDrawList* drawList = ImGui::GetWindowDrawList();
+  double end = this->timelineStart + this->timelineSpan;
+  auto toX = [&](double time) { return trackPos.x + (float)((time - this->timelineStart) / this->timelineSpan * trackWidth); };
+
+  this->syncClipIndex();
+  this->clipIndex.query(this->timelineStart, end, this->visibleItems);
+  for (uint32_t id : this->visibleItems) {
+    const Clip& clip = this->clips[id];
+    ImVec2 topLeft = ImVec2(std::max(toX(clip.time_start), trackPos.x - 1.0f), trackPos.y);
+    ImVec2 bottomRight = ImVec2(std::min(toX(clip.time_end), trackPos.x + trackWidth + 1.0f), trackPos.y + trackHeight);
+    drawList->AddRectFilled(topLeft, bottomRight, IM_COL32(0, 255, 0, 40));
+    drawList->AddRect(topLeft, bottomRight, IM_COL32(0, 255, 0, 200));
+  }
+
+  this->bookmarkIndex.query(this->timelineStart, end, this->visibleItems);
+  for (uint32_t id : this->visibleItems) {
+    const Bookmark& bookmark = this->bookmarks[id];
+    float x = toX(bookmark.time);
+    drawList->AddLine(ImVec2(x, trackPos.y), ImVec2(x, trackPos.y + trackHeight * 0.25f), bookmarkColor(bookmark.kind), 2.0f);
+  }
+}
+
+void UIManager::renderSeekPreview(int seekBarYPos, double time) {
   float verticalPadding = 10.0f;
   float previewWindowHeight = 200.0f;
 
@@ -247,6 +872,24 @@ void UIManager::renderSeekPreview(int seekBarYPos) {
   ImGui::SetNextWindowPos(ImVec2(mouse_pos.x-previewWindowSize.x/2, seekBarYPos-previewWindowSize.y-verticalPadding));
   ImGui::SetNextWindowSize(previewWindowSize);
   ImGui::Begin("SeekPreview", &p_open, this->seekPreviewWindowFlags);
+
+  // Nearest cached keyframe is shown right away, the exact one replaces it once decoded
+  std::shared_ptr<const Thumbnail> thumbnail = this->thumbnailEngine.request(time);
+  ImVec2 uv0, uv1;
+  if (thumbnail && this->thumbnailAtlas.get(thumbnail->keyframe, *thumbnail, &uv0, &uv1)) {
+    // Letterbox with the thumbnail's own aspect ratio, the window follows the player's
+    ImVec2 available = ImGui::GetContentRegionAvail();
+    float scale = std::min(available.x / thumbnail->width, available.y / thumbnail->height);
+    ImVec2 imageSize = ImVec2(thumbnail->width * scale, thumbnail->height * scale);
+    ImVec2 cursor = ImGui::GetCursorPos();
+    ImGui::SetCursorPos(ImVec2(cursor.x + (available.x - imageSize.x) / 2, cursor.y + (available.y - imageSize.y) / 2));
+    ImGui::Image(this->thumbnailAtlas.getTextureId(), imageSize, uv0, uv1);
+  }
+
+  if (this->debug) {
+    ThumbnailStats stats = this->thumbnailEngine.getStats();
+    ImGui::Text("%llu/%llu hits, %.1f ms", (unsigned long long)stats.hits, (unsigned long long)stats.requests, stats.averageDecodeMs);
+  }
   ImGui::End();
 }
 
@@ -259,114 +902,145 @@ void UIManager::renderClipBoxes(ImVec2 bar_position, std::vector<Clip>& clips, d
     ImVec2 mouse_pos = ImGui::GetIO().MousePos;
     bool mouse_down = ImGui::IsMouseDown(0);
     
-    // If mouse is released, reset dragging state
+    // If mouse is released, reset dragging state. The finished drag goes to the project as one edit.
     if (!mouse_down) {
+        if (dragging_handle != -1 && active_clip_index >= 0 && active_clip_index < (int)clips.size()) {
+            this->saveClip(clips[active_clip_index]);
+            this->history.closeGroup();
+        }
         dragging_handle = -1;
         active_clip_index = -1;
     }
-    
-    for (int i = 0; i < clips.size(); i++) {
-        Clip& clip = clips[i];
-        double x_position_start = bar_position.x + ((double)clip.time_start / video_duration) * bar_size.x;
-        double x_position_end = bar_position.x + ((double)clip.time_end / video_duration) * bar_size.x;
-        
-        ImVec2 top_left = ImVec2(x_position_start, bar_position.y);
-        ImVec2 bottom_right = ImVec2(x_position_end, bar_position.y + bar_size.y);
-        
-        // Draw clip box
-        ImGui::GetWindowDrawList()->AddRectFilled(top_left, bottom_right, IM_COL32(0, 255, 0, 50));
-        
-        // Handle config
-        double handle_h_padding = 3.0f;
-        double handle_v_padding = 1.0f;
-        auto handle_color = IM_COL32(0, 255, 0, 255);
-        
-        ImVec2 left_handle_min(x_position_start - handle_h_padding, bar_position.y - handle_v_padding);
-        ImVec2 left_handle_max(x_position_start + handle_h_padding, bottom_right.y + handle_v_padding);
-        ImVec2 right_handle_min(x_position_end - handle_h_padding, bar_position.y - handle_v_padding);
-        ImVec2 right_handle_max(x_position_end + handle_h_padding, bottom_right.y + handle_v_padding);
-        
-        // Draw handles
-        ImGui::GetWindowDrawList()->AddRectFilled(left_handle_min, left_handle_max, handle_color);
-        ImGui::GetWindowDrawList()->AddRectFilled(right_handle_min, right_handle_max, handle_color);
-        
-        // Check for handle interaction
-        if (dragging_handle == -1 && ImGui::IsMouseClicked(0)) {
-            // Left handle
-            if (mouse_pos.x >= left_handle_min.x && mouse_pos.x <= left_handle_max.x &&
-                mouse_pos.y >= left_handle_min.y && mouse_pos.y <= left_handle_max.y) {
-                dragging_handle = 0;
-                active_clip_index = i;
-            }
-            // Right handle
-            else if (mouse_pos.x >= right_handle_min.x && mouse_pos.x <= right_handle_max.x &&
-                     mouse_pos.y >= right_handle_min.y && mouse_pos.y <= right_handle_max.y) {
-                dragging_handle = 1;
-                active_clip_index = i;
-            }
+    if (video_duration <= 0.0 || bar_size.x <= 0.0f) {
+        return;
+    }
+
+    // Handle config
+    double handle_h_padding = 3.0f;
+    double handle_v_padding = 1.0f;
+    auto handle_color = IM_COL32(0, 255, 0, 255);
+    double seconds_per_pixel = video_duration / bar_size.x;
+
+    this->syncClipIndex();
+
+    // Grab the handle closest to the click, if it's within a handle's width
+    bool in_bar = mouse_pos.y >= bar_position.y - handle_v_padding && mouse_pos.y <= bar_position.y + bar_size.y + handle_v_padding;
+    if (dragging_handle == -1 && ImGui::IsMouseClicked(0) && in_bar) {
+        bool is_end = false;
+        int64_t nearest = this->clipIndex.nearestEdge((mouse_pos.x - bar_position.x) * seconds_per_pixel, handle_h_padding * seconds_per_pixel, &is_end);
+        if (nearest >= 0) {
+            dragging_handle = is_end ? 1 : 0;
+            active_clip_index = (int)nearest;
         }
-        
-        // Handle dragging
-        if (mouse_down && active_clip_index == i && dragging_handle != -1) {
-            double relative_x = (mouse_pos.x - bar_position.x) / bar_size.x;
-            double new_time = relative_x * video_duration;
-
-            // Snap to nearest pts
-            std::cout << new_time << std::endl;
-            new_time = this->findNearestPts(new_time);
-            std::cout << new_time << std::endl;
-            
-            new_time = std::min(std::max(new_time, 0.0), video_duration);
-            
-            if (dragging_handle == 0) {
-                // Left handle - update start time
-                clip.time_start = std::min(new_time, clip.time_end);
-            } else {
-                // Right handle - update end time
-                clip.time_end = std::max(new_time, clip.time_start);
-            }
+    }
+
+    // Handle dragging
+    if (mouse_down && dragging_handle != -1 && active_clip_index >= 0 && active_clip_index < (int)clips.size()) {
+        Clip& clip = clips[active_clip_index];
+        Clip before = clip;
+        double relative_x = (mouse_pos.x - bar_position.x) / bar_size.x;
+        double new_time = relative_x * video_duration;
+
+        // Snap to nearest pts
+        new_time = this->findNearestPts(new_time);
+        new_time = std::min(std::max(new_time, 0.0), video_duration);
+
+        if (dragging_handle == 0) {
+            // Left handle - update start time
+            clip.time_start = std::min(new_time, clip.time_end);
+        } else {
+            // Right handle - update end time
+            clip.time_end = std::max(new_time, clip.time_start);
+        }
+
+        // Every step of the drag folds into one history entry
+        if (clip.time_start != before.time_start || clip.time_end != before.time_end) {
+            this->recordEdit(&before, &clip, true);
+            // Only a start dragged past a neighbour's needs the index rebuilt
+            if (!this->clipIndex.update((uint32_t)active_clip_index, { clip.time_start, clip.time_end }))
+                this->clipsChanged = true;
         }
     }
-}
 
-double UIManager::findNearestPts(double x) {
-  std::vector<double> arr = this->mediaPlayer->videoPtsBuffer;
-  int left = 0, right = arr.size() - 1;
-  double closest = INT_MAX;
-  double closestDiff = INT_MAX;
+    // The bar shows the whole recording, so clips are merged per pixel column they start in: one box
+    // out to the furthest end among them, then a jump to the next column. Cost is bounded by the bar width.
+    this->syncClipIndex();
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    size_t position = this->clipIndex.lowerBound(0.0);
+    while (position < this->clipIndex.size()) {
+        double time_start = this->clipIndex.at(position).span.start;
+        if (time_start > video_duration) {
+            break;
+        }
+        double column = std::floor(time_start / seconds_per_pixel);
+        size_t next = std::max(this->clipIndex.lowerBound((column + 1.0) * seconds_per_pixel), position + 1);
+        double time_end = this->clipIndex.maxEnd(position, next);
+        position = next;
 
-  while (left <= right) {
-    int mid = left + (right - left) / 2;
+        float x_position_start = bar_position.x + (float)(time_start / video_duration) * bar_size.x;
+        float x_position_end = bar_position.x + (float)(std::min(time_end, video_duration) / video_duration) * bar_size.x;
 
-    double diff = std::abs(arr[mid] - x);
-    if (diff < closestDiff || (diff == closestDiff && arr[mid] < closest)) {
-      closest = arr[mid];
-      closestDiff = diff;
-    }
+        // Draw clip box
+        draw_list->AddRectFilled(ImVec2(x_position_start, bar_position.y), ImVec2(x_position_end, bar_position.y + bar_size.y), IM_COL32(0, 255, 0, 50));
 
-    if (arr[mid] == x) {
-      return arr[mid];
-    } else if (arr[mid] < x) {
-      left = mid + 1;
-    } else {
-      right = mid - 1;
+        // Draw handles
+        draw_list->AddRectFilled(ImVec2(x_position_start - handle_h_padding, bar_position.y - handle_v_padding),
+            ImVec2(x_position_start + handle_h_padding, bar_position.y + bar_size.y + handle_v_padding), handle_color);
+        draw_list->AddRectFilled(ImVec2(x_position_end - handle_h_padding, bar_position.y - handle_v_padding),
+            ImVec2(x_position_end + handle_h_padding, bar_position.y + bar_size.y + handle_v_padding), handle_color);
     }
+}
+
+void UIManager::syncClipIndex() {
+  if (!this->clipsChanged) {
+    return;
   }
 
-  return closest;
+  std::vector<TimeSpan> spans(this->clips.size());
+  for (size_t i = 0; i < this->clips.size(); i++)
+    spans[i] = { this->clips[i].time_start, this->clips[i].time_end };
+  this->clipIndex.build(spans);
+  this->clipsChanged = false;
+}
+
+double UIManager::findNearestPts(double x) {
+  std::shared_ptr<const TimelineIndex> index = this->mediaPlayer->getTimelineIndex();
+  if (!index) {
+    return 0.0;
+  }
+  return index->nearestPts(x);
 }
 
 void UIManager::renderVideoPlayer() {
 
 }
 
-void UIManager::renderBookmarks(ImVec2 barPos, std::vector<float> bookmarks) {
-  for (float bookmark : bookmarks) {
-      ImVec2 bar_size = ImGui::GetItemRectSize();
-      float x_position = barPos.x + bookmark * bar_size.x;
+void UIManager::renderBookmarks(ImVec2 barPos, const std::vector<Bookmark>& bookmarks, double duration) {
+  if (duration <= 0.0) {
+    return;
+  }
+
+  // At most one line per pixel column: after drawing one, skip ahead to the next column
+  ImVec2 bar_size = ImGui::GetItemRectSize();
+  size_t position = 0;
+  while (position < this->bookmarkIndex.size() && bar_size.x > 0.0f) {
+      const Bookmark& bookmark = bookmarks[this->bookmarkIndex.at(position).id];
+      float x_position = barPos.x + (float)(bookmark.time / duration) * bar_size.x;
       ImVec2 start = ImVec2(x_position, barPos.y);
       ImVec2 end = ImVec2(x_position, barPos.y + bar_size.y);
-      ImGui::GetWindowDrawList()->AddLine(start, end, IM_COL32(255, 0, 0, 255), 2.0f);
+      ImGui::GetWindowDrawList()->AddLine(start, end, bookmarkColor(bookmark.kind), 2.0f);
+
+      double nextColumn = (std::floor(x_position - barPos.x) + 1.0) / bar_size.x * duration;
+      position = std::max(position + 1, this->bookmarkIndex.lowerBound(nextColumn));
+  }
+
+  if (this->debug && ImGui::IsItemHovered()) {
+    SceneStats stats = this->sceneAnalyzer.getStats();
+    LoudnessStats loudness = this->loudnessAnalyzer.getStats();
+    ImGui::SetTooltip("Scene analysis: %.0fs, %llu frames at %.0f fps (%.1fx realtime)\n"
+      "Loudness: %.0fs (%.0fx realtime), %.1f LUFS, median %.1f, peaks above %.1f\n%zu bookmarks",
+      stats.analyzedSeconds, (unsigned long long)stats.framesAnalyzed, stats.fps, stats.speed,
+      loudness.analyzedSeconds, loudness.speed, loudness.shortTerm, loudness.median, loudness.threshold, bookmarks.size());
   }
 }
 
@@ -390,6 +1064,15 @@ void UIManager::renderMediaButtons() {
   if (off > 0.0f)
       ImGui::SetCursorPosX(ImGui::GetCursorPosX() + off);
 
+  // Center the play button, the step buttons sit on either side of it
+  float stepWidth = ImGui::CalcTextSize("<").x + style.FramePadding.x * 2.0f + style.ItemSpacing.x;
+  if (off > stepWidth)
+      ImGui::SetCursorPosX(ImGui::GetCursorPosX() - stepWidth);
+  if (ImGui::Button("<")) {
+    this->mediaPlayer->stepBackward();
+  }
+  ImGui::SameLine();
+
   if(ImGui::Button(label)) {
     paused = !paused;
     if (paused) {
@@ -398,4 +1081,57 @@ void UIManager::renderMediaButtons() {
       this->mediaPlayer->play();
     }
   }
+
+  ImGui::SameLine();
+  if (ImGui::Button(">")) {
+    this->mediaPlayer->stepForward();
+  }
+
+  // Speed selector and J/K/L shuttle
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(ImGui::CalcTextSize("0.25x").x + style.FramePadding.x * 2.0f + ImGui::GetFrameHeight());
+  char speedLabel[16];
+  snprintf(speedLabel, sizeof(speedLabel), "%s%gx", this->mediaPlayer->isReverse() ? "-" : "", this->mediaPlayer->getPlaybackSpeed());
+  if (ImGui::BeginCombo("##speed", speedLabel)) {
+    for (double speed : this->playbackSpeeds) {
+      char label[16];
+      snprintf(label, sizeof(label), "%gx", speed);
+      if (ImGui::Selectable(label, speed == this->mediaPlayer->getPlaybackSpeed())) {
+        this->mediaPlayer->setPlaybackSpeed(speed);
+      }
+    }
+    ImGui::EndCombo();
+  }
+  if (this->mediaPlayer->isKeyframeOnly()) {
+    ImGui::SameLine();
+    ImGui::TextDisabled("keyframes");
+  }
+
+  if (!ImGui::GetIO().WantTextInput) {
+    if (ImGui::IsKeyPressed(ImGuiKey_J, false))
+      this->mediaPlayer->shuttleBackward();
+    if (ImGui::IsKeyPressed(ImGuiKey_K, false))
+      this->mediaPlayer->shuttleStop();
+    if (ImGui::IsKeyPressed(ImGuiKey_L, false))
+      this->mediaPlayer->shuttleForward();
+    if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow))
+      this->mediaPlayer->stepBackward();
+    if (ImGui::IsKeyPressed(ImGuiKey_RightArrow))
+      this->mediaPlayer->stepForward();
+    if (ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_Z))
+      this->undo();
+    if (ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_Y) || ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiMod_Shift | ImGuiKey_Z))
+      this->redo();
+    if (ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_R))
+      this->toggleRecording();
+  }
+
+  if (this->mediaPlayer->isLiveFollow()) {
+    ImGui::SameLine();
+    if (this->mediaPlayer->isAtLiveEdge()) {
+      ImGui::TextColored(ImVec4(1.0f, 0.2f, 0.2f, 1.0f), "LIVE");
+    } else if (ImGui::Button("Go Live")) {
+      this->mediaPlayer->jumpToLive();
+    }
+  }
 }
@@ -5,6 +5,20 @@
 #include"imgui_impl_glfw.h"
 #include"imgui_impl_opengl3.h"
 #include "media_player.hpp"
+#include "thumbnail_engine.hpp"
+#include "thumbnail_atlas.hpp"
+#include "filmstrip_pyramid.hpp"
+#include "audio_peaks.hpp"
+#include "scene_analyzer.hpp"
+#include "loudness_analyzer.hpp"
+#include "clip_exporter.hpp"
+#include "interval_index.hpp"
+#include "string_arena.hpp"
+#include "clip.hpp"
+#include "project_file.hpp"
+#include "edit_history.hpp"
+#include "desktop_capture.hpp"
+#include "recorder.hpp"
 #include <vector>
 #include <iostream>
 
@@ -21,35 +35,6 @@ static void HelpMarker(const char* desc)
 }
 
 
-class Clip {
-public:
-  double time_start;
-  double time_end;
-  int buffer_size = 256;
-  char* name = new char[this->buffer_size];
-
-  Clip(double time_start, double time_end, char* name) {
-    this->time_start = time_start;
-    this->time_end = time_end;
-    this->setName(name);
-    std::cout << name << " " << this->name << std::endl;
-  }
-
-  ~Clip() {
-    //delete[] name;
-  }
-
-  void setName(char* newName) {
-    if (newName) {
-      strncpy(name, newName, this->buffer_size - 1);
-      name[this->buffer_size - 1] = '\0';
-    } else {
-      name[0] = '\0';
-    }
-  }
-};
-
-
 class UIManager {
 private:
   float* videoAspectRatio;
@@ -63,6 +48,91 @@ private:
   int* windowHeight;
   int* windowWidth;
   std::vector<Clip> clips;
+  uint32_t nextClipId = 1;
+  StringArena clipNames;
+  int renamingClip = -1;     // Row with the rename field open, the only one that needs a text buffer
+  char renameBuffer[256] = {};
+
+  // Clips and bookmarks by time, so only what's on screen is drawn and handles are hit-tested
+  // without walking every clip. The clip index is rebuilt lazily after an edit.
+  IntervalIndex clipIndex;
+  IntervalIndex bookmarkIndex;
+  bool clipsChanged = true;
+  std::vector<uint32_t> visibleItems;
+  void syncClipIndex();
+  void renderTimelineMarkers(ImVec2 trackPos, float trackWidth, float trackHeight);
+
+  // Seek preview thumbnails, decoded off-thread and drawn from one atlas texture
+  ThumbnailEngine thumbnailEngine;
+  ThumbnailAtlas thumbnailAtlas;
+  uint64_t thumbnailSourceId = 0;
+  void syncThumbnailSource();
+
+  // Zoomable filmstrip track, the visible window is [timelineStart, timelineStart + timelineSpan]
+  FilmstripPyramid filmstrip;
+  ThumbnailAtlas filmstripAtlas;
+  double timelineStart = 0.0;
+  double timelineSpan = 0.0;
+  void renderTimeline();
+
+  // Audio waveform under the seek bar and along the filmstrip
+  AudioPeakPyramid audioPeaks;
+  std::vector<AudioPeak> waveformColumns;
+  const float waveformHeight = 24.0f;
+  void renderWaveform(ImVec2 pos, float width, float height, double start, double end, ImU32 peakColor, ImU32 rmsColor);
+
+  // Bookmarks and dead time (still and silent at once) from the analyzers, copied over whenever they find more
+  SceneAnalyzer sceneAnalyzer;
+  LoudnessAnalyzer loudnessAnalyzer;
+  bool hasAudio = false;
+  std::vector<Bookmark> bookmarks;
+  std::vector<TimeSpan> deadSpans;
+  uint64_t analysisVersion = 0;
+  const double minDeadTime = 5.0;
+  void syncBookmarks();
+
+  // Project next to the recording: clips are journaled on every edit, markers now and then.
+  // Markers loaded from it stand in past the point the analyzers have reached this session.
+  ProjectFile project;
+  std::vector<Bookmark> storedBookmarks;
+  std::vector<TimeSpan> storedDeadSpans;
+  double markersSavedAt = 0.0;
+  uint64_t markersSavedVersion = 0;
+  const double markerSaveInterval = 30.0;
+  void openProject();
+  void saveClip(const Clip& clip);
+  void saveMarkers();
+
+  // Every clip edit goes through the history. Clips stay sorted by id so an edit finds its clip in O(log n).
+  EditHistory history;
+  void recordEdit(const Clip* before, const Clip* after, bool merge = false);
+  void setClip(uint32_t id, const Clip* clip);
+  void undo();
+  void redo();
+  void renderDeadTime(ImVec2 barPos, float barWidth, float barHeight, double duration);
+
+  // Stream copy export of a clip or the whole recording with the dead time cut out.
+  // Clips are exported plain (exact range, dead time kept) unless cutDeadTimeFromClips is set.
+  ClipExporter clipExporter;
+  ExportStatus exportStatus; // Copied when an export starts or ends, progress is polled in between
+  bool cutDeadTimeFromClips = false;
+  void exportRange(TimeSpan range, const std::string& suffix, bool cutDeadTime);
+  void renderExportStatus();
+  // Screen recording, opened for live playback once the first fragments are on disk.
+  // The recorder is declared after its source so it stops before the source goes away.
+  DesktopCapture screenCapture;
+  Recorder recorder;
+  std::string recordingFile;
+  double recordingStartedAt = 0.0;
+  bool recordingLoaded = false;
+  const double recordingLoadDelay = 2.0;
+  const double replayBufferSeconds = 60.0; // Kept in memory while recording, for instant review
+  void startRecording();
+  void stopRecording();
+  void toggleRecording();
+  void syncRecording();
+  void reviewReplayBuffer();
+  const std::vector<double> playbackSpeeds = { 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0, 32.0 };
 
   int toolBarHeight;
   int sideBarWidth;
@@ -75,8 +145,8 @@ private:
   void renderBottomBar();
   void renderVideoPlayer();
   void renderSeekBar();
-  void renderSeekPreview(int seekBarYPos);
-  void renderBookmarks(ImVec2 barPos, std::vector<float> bookmarks);
+  void renderSeekPreview(int seekBarYPos, double time);
+  void renderBookmarks(ImVec2 barPos, const std::vector<Bookmark>& bookmarks, double duration);
   void renderClipBoxes(ImVec2 bar_position, std::vector<Clip>& clips, double video_duration);
   void renderMediaButtons();
   double findNearestPts(double x);
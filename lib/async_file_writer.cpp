@@ -0,0 +1,433 @@
+#include "async_file_writer.hpp"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+  constexpr size_t ALIGNMENT = 4096;
+  constexpr int IO_BUFFER_SIZE = 64 * 1024;
+
+  double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+}
+
+AsyncFileWriter::AsyncFileWriter() {
+
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  close();
+  for (uint8_t* block : this->freeBlocks)
+    free(block);
+}
+
+bool AsyncFileWriter::open(const std::string& path, AsyncWriterConfig config) {
+  config.blockSize = std::max(ALIGNMENT, (config.blockSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+  config.ringDepth = std::max(1u, config.ringDepth);
+  this->config = config;
+  this->path = path;
+
+  this->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (this->fd < 0) {
+    std::cout << "Could not open output file " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+#ifdef O_DIRECT
+  // Second descriptor for aligned blocks, unaligned writes (header patches, tail) stay buffered
+  if (config.directIO) {
+    this->directFd = ::open(path.c_str(), O_WRONLY | O_DIRECT);
+    if (this->directFd < 0)
+      std::cout << "O_DIRECT not supported for " << path << ", using buffered writes" << std::endl;
+  }
+#endif
+
+  this->stats = AsyncWriterStats();
+  this->stats.backend = "pwrite";
+#ifdef REWIND_HAVE_IO_URING
+  if (io_uring_queue_init(config.ringDepth, &this->ring, 0) == 0) {
+    this->ringReady = true;
+    this->stats.backend = "io_uring";
+  } else {
+    std::cout << "io_uring unavailable, falling back to pwrite" << std::endl;
+  }
+#endif
+  if (this->directFd >= 0)
+    this->stats.backend += "+O_DIRECT";
+
+  this->current = Block();
+  this->current.data = this->allocateBlock();
+  this->current.queuedAt = now();
+  this->alignmentLost = false;
+  this->fileSize = 0;
+  this->allocated = 0;
+  this->canPreallocate = config.preallocateBytes > 0;
+  this->totalLatency = 0.0;
+  this->completedBlocks = 0;
+  this->finishing = false;
+  this->failed = false;
+  this->openedAt = now();
+  this->closedAt = 0.0;
+  this->thread = std::thread(&AsyncFileWriter::writerLoop, this);
+  return true;
+}
+
+AVIOContext* AsyncFileWriter::createContext() {
+  unsigned char* buffer = (unsigned char*)av_malloc(IO_BUFFER_SIZE);
+  return avio_alloc_context(buffer, IO_BUFFER_SIZE, 1, this, NULL, &AsyncFileWriter::writePacket, &AsyncFileWriter::seekPacket);
+}
+
+void AsyncFileWriter::freeContext(AVIOContext** context) {
+  if (!*context) {
+    return;
+  }
+  avio_flush(*context);
+  av_freep(&(*context)->buffer);
+  avio_context_free(context);
+}
+
+int AsyncFileWriter::writePacket(void* opaque, AVIOWriteBuffer buf, int size) {
+  return ((AsyncFileWriter*)opaque)->write(buf, size);
+}
+
+int64_t AsyncFileWriter::seekPacket(void* opaque, int64_t offset, int whence) {
+  return ((AsyncFileWriter*)opaque)->seek(offset, whence);
+}
+
+uint8_t* AsyncFileWriter::allocateBlock() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->freeBlocks.empty()) {
+      uint8_t* block = this->freeBlocks.back();
+      this->freeBlocks.pop_back();
+      return block;
+    }
+  }
+
+  void* block = nullptr;
+  if (posix_memalign(&block, ALIGNMENT, this->config.blockSize) != 0)
+    return nullptr;
+  return (uint8_t*)block;
+}
+
+int AsyncFileWriter::write(const uint8_t* buf, int size) {
+  if (this->failed || !this->current.data) {
+    return AVERROR(EIO);
+  }
+
+  int written = 0;
+  while (written < size) {
+    size_t count = std::min((size_t)(size - written), this->config.blockSize - this->current.length);
+    memcpy(this->current.data + this->current.length, buf + written, count);
+    this->current.length += count;
+    written += count;
+
+    if (this->current.length == this->config.blockSize) {
+      this->submitCurrent();
+      if (!this->current.data)
+        return AVERROR(ENOMEM);
+    }
+  }
+
+  this->fileSize = std::max(this->fileSize, this->current.offset + (int64_t)this->current.length);
+
+  // current.queuedAt holds when the block got its first byte until it is submitted
+  bool stale = now() - this->current.queuedAt >= this->config.maxBufferDelay;
+  if (this->current.length > 0 && (this->config.flushPartialBlocks || stale)) {
+    this->loseAlignment(this->current.offset + this->current.length);
+    this->submitCurrent();
+    if (!this->current.data)
+      return AVERROR(ENOMEM);
+  }
+  return size;
+}
+
+void AsyncFileWriter::loseAlignment(int64_t offset) {
+  if (this->directFd < 0 || this->alignmentLost || offset % ALIGNMENT == 0) {
+    return;
+  }
+
+  // Blocks continue from here, only aligned ones still go through O_DIRECT
+  std::cout << "Output " << this->path << " is no longer block-aligned at " << offset << ", later writes are buffered" << std::endl;
+  this->alignmentLost = true;
+}
+
+int64_t AsyncFileWriter::seek(int64_t offset, int whence) {
+  int64_t position = this->current.offset + this->current.length;
+
+  switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE: return this->fileSize;
+    case SEEK_SET: break;
+    case SEEK_CUR: offset += position; break;
+    case SEEK_END: offset += this->fileSize; break;
+    default: return AVERROR(EINVAL);
+  }
+
+  if (offset < 0) {
+    return AVERROR(EINVAL);
+  }
+
+  // Muxers seek back to patch sizes; start a new block at the target, it is written unaligned
+  if (offset != position) {
+    if (this->current.length > 0)
+      this->submitCurrent();
+    this->loseAlignment(offset);
+    this->current.offset = offset;
+  }
+  return offset;
+}
+
+void AsyncFileWriter::submitCurrent() {
+  Block block = this->current;
+  block.queuedAt = now();
+
+  // Never waits on the writer: a slow disk makes the queue grow, not the muxer stall
+  size_t depth;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->queue.push_back(block);
+    depth = this->queue.size();
+  }
+  this->condition.notify_one();
+
+  {
+    std::lock_guard<std::mutex> lock(this->statsMutex);
+    this->stats.bytesSubmitted += block.length;
+    this->stats.maxQueueDepth = std::max(this->stats.maxQueueDepth, depth);
+    if (depth > this->config.maxQueuedBlocks)
+      this->stats.spilledBlocks++;
+  }
+
+  this->current = Block();
+  this->current.offset = block.offset + block.length;
+  this->current.data = this->allocateBlock();
+  this->current.queuedAt = now();
+}
+
+int AsyncFileWriter::fdFor(const Block& block) {
+  bool aligned = block.offset % ALIGNMENT == 0 && block.length % ALIGNMENT == 0;
+  return (this->directFd >= 0 && aligned) ? this->directFd : this->fd;
+}
+
+void AsyncFileWriter::preallocate(const Block& block) {
+#ifdef __linux__
+  int64_t end = block.offset + block.length;
+  while (this->canPreallocate && end > this->allocated) {
+    // KEEP_SIZE reserves extents without changing the visible file size
+    if (fallocate(this->fd, FALLOC_FL_KEEP_SIZE, this->allocated, this->config.preallocateBytes) != 0) {
+      this->canPreallocate = false;
+      break;
+    }
+    this->allocated += this->config.preallocateBytes;
+  }
+#endif
+}
+
+bool AsyncFileWriter::writeBlockSync(const Block& block, size_t done) {
+  int target = this->fdFor(block);
+
+  while (done < block.length) {
+    ssize_t result = pwrite(target, block.data + done, block.length - done, block.offset + done);
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      // O_DIRECT can refuse a write the buffered descriptor accepts
+      if (target != this->fd) {
+        target = this->fd;
+        continue;
+      }
+      std::cout << "Write to " << this->path << " failed: " << strerror(errno) << std::endl;
+      return false;
+    }
+    done += result;
+
+    // Short write leaves the remainder unaligned
+    target = this->fd;
+  }
+  return true;
+}
+
+void AsyncFileWriter::completeBlock(const Block& block, bool written) {
+  double latency = now() - block.queuedAt;
+
+#ifdef __linux__
+  if (written && this->config.dropPageCache && this->fdFor(block) == this->fd) {
+    // Runs on the writer thread, so waiting for writeback here never stalls the muxer
+    sync_file_range(this->fd, block.offset, block.length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(this->fd, block.offset, block.length, POSIX_FADV_DONTNEED);
+  }
+#endif
+
+  {
+    // Blocks spilled past the pool go back to the system once the backlog clears
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->freeBlocks.size() < this->config.maxQueuedBlocks) {
+      this->freeBlocks.push_back(block.data);
+    } else {
+      free(block.data);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  if (written) {
+    this->stats.bytesWritten += block.length;
+  } else {
+    this->stats.failedBlocks++;
+  }
+  this->totalLatency += latency;
+  this->completedBlocks++;
+  this->stats.maxWriteLatency = std::max(this->stats.maxWriteLatency, latency);
+}
+
+#ifdef REWIND_HAVE_IO_URING
+void AsyncFileWriter::writeBatchUring(std::vector<Block>& batch, std::vector<bool>& written) {
+  // Linked so each write starts after the previous one finished. Completing out of order
+  // would grow the file past a block that is still zeros for anyone reading it live.
+  for (size_t i = 0; i < batch.size(); i++) {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&this->ring);
+    io_uring_prep_write(sqe, this->fdFor(batch[i]), batch[i].data, batch[i].length, batch[i].offset);
+    io_uring_sqe_set_data(sqe, (void*)i);
+    if (i + 1 < batch.size())
+      sqe->flags |= IOSQE_IO_LINK;
+  }
+  io_uring_submit(&this->ring);
+
+  std::vector<size_t> done(batch.size(), 0);
+  for (size_t completed = 0; completed < batch.size(); completed++) {
+    struct io_uring_cqe* cqe = nullptr;
+    if (io_uring_wait_cqe(&this->ring, &cqe) < 0) {
+      this->failed = true;
+      written.assign(batch.size(), false);
+      return;
+    }
+
+    size_t index = (size_t)io_uring_cqe_get_data(cqe);
+    done[index] = cqe->res > 0 ? (size_t)cqe->res : 0;
+    io_uring_cqe_seen(&this->ring, cqe);
+  }
+
+  // Errors, short writes and the links cancelled behind them are finished synchronously, in order
+  for (size_t i = 0; i < batch.size(); i++) {
+    written[i] = done[i] == batch[i].length || this->writeBlockSync(batch[i], done[i]);
+    if (!written[i])
+      this->failed = true;
+  }
+}
+#endif
+
+void AsyncFileWriter::writerLoop() {
+  std::vector<Block> batch;
+  std::vector<bool> written;
+
+  while (true) {
+    batch.clear();
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->condition.wait(lock, [this] { return !this->queue.empty() || this->finishing; });
+      if (this->queue.empty())
+        break;
+
+      // Take up to ringDepth blocks, stopping at one that overlaps an earlier one (header patches)
+      while (!this->queue.empty() && batch.size() < this->config.ringDepth) {
+        const Block& next = this->queue.front();
+        bool overlaps = false;
+        for (const Block& taken : batch) {
+          if (next.offset < taken.offset + (int64_t)taken.length && taken.offset < next.offset + (int64_t)next.length)
+            overlaps = true;
+        }
+        if (overlaps)
+          break;
+        batch.push_back(next);
+        this->queue.pop_front();
+      }
+    }
+
+    for (const Block& block : batch)
+      this->preallocate(block);
+
+    written.assign(batch.size(), false);
+#ifdef REWIND_HAVE_IO_URING
+    if (this->ringReady) {
+      this->writeBatchUring(batch, written);
+    } else
+#endif
+    {
+      for (size_t i = 0; i < batch.size(); i++) {
+        written[i] = this->writeBlockSync(batch[i], 0);
+        if (!written[i])
+          this->failed = true;
+      }
+    }
+
+    for (size_t i = 0; i < batch.size(); i++)
+      this->completeBlock(batch[i], written[i]);
+  }
+}
+
+bool AsyncFileWriter::close() {
+  if (this->fd < 0) {
+    return true;
+  }
+
+  if (this->current.length > 0)
+    this->submitCurrent();
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->finishing = true;
+  }
+  this->condition.notify_one();
+  if (this->thread.joinable())
+    this->thread.join();
+
+  if (this->current.data) {
+    this->freeBlocks.push_back(this->current.data);
+    this->current.data = nullptr;
+  }
+
+#ifdef REWIND_HAVE_IO_URING
+  if (this->ringReady) {
+    io_uring_queue_exit(&this->ring);
+    this->ringReady = false;
+  }
+#endif
+
+  // Release preallocated space past the end and make the data durable
+  if (ftruncate(this->fd, this->fileSize) != 0 || fdatasync(this->fd) != 0) {
+    std::cout << "Failed to finalize " << this->path << ": " << strerror(errno) << std::endl;
+    this->failed = true;
+  }
+
+  if (this->directFd >= 0)
+    ::close(this->directFd);
+  ::close(this->fd);
+  this->directFd = -1;
+  this->fd = -1;
+  {
+    std::lock_guard<std::mutex> lock(this->statsMutex);
+    this->closedAt = now();
+  }
+
+  return !this->failed;
+}
+
+AsyncWriterStats AsyncFileWriter::getStats() {
+  size_t depth;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    depth = this->queue.size();
+  }
+
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  AsyncWriterStats result = this->stats;
+  result.queueDepth = depth;
+  double elapsed = (this->closedAt > 0.0 ? this->closedAt : now()) - this->openedAt;
+  result.throughput = elapsed > 0.0 ? result.bytesWritten / elapsed / (1024.0 * 1024.0) : 0.0;
+  result.averageWriteLatency = this->completedBlocks > 0 ? this->totalLatency / this->completedBlocks : 0.0;
+  return result;
+}
@@ -0,0 +1,136 @@
+#ifndef ASYNCFILEWRITER_HPP
+#define ASYNCFILEWRITER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include "avio_compat.hpp"
+
+#ifdef REWIND_HAVE_IO_URING
+#include <liburing.h>
+#endif
+
+struct AsyncWriterConfig {
+  // Bytes per write request, a multiple of 4096 so blocks stay O_DIRECT-aligned
+  size_t blockSize = 1 << 20;
+
+  // Blocks kept for reuse. When the disk falls behind the queue grows past this with fresh
+  // blocks (counted as spilled) instead of making the muxer wait, they are freed once written.
+  size_t maxQueuedBlocks = 64;
+
+  // Hand the partial block to the writer at the end of every muxer write. Keeps a reader following
+  // the file current to the last fragment, but no block is ever full or aligned.
+  bool flushPartialBlocks = false;
+
+  // A partial block older than this is handed over on the next write, so a fragment reaches the
+  // disk within about this much of the next one being muxed
+  double maxBufferDelay = 0.5;
+
+  // Bypass the page cache for aligned blocks. Only pays off for writers that stay block-aligned,
+  // partial flushes and seeks continue unaligned and buffered.
+  bool directIO = false;
+
+  // Reserve disk space ahead of the write position in steps of this size (0 = off)
+  int64_t preallocateBytes = 256 << 20;
+
+  // Drop written pages from the page cache so long recordings don't evict everything else
+  bool dropPageCache = true;
+
+  // Writes in flight at once with io_uring
+  unsigned ringDepth = 8;
+};
+
+struct AsyncWriterStats {
+  std::string backend;
+  uint64_t bytesSubmitted = 0;
+  uint64_t bytesWritten = 0;
+  size_t queueDepth = 0;
+  size_t maxQueueDepth = 0;
+  uint64_t spilledBlocks = 0;       // Queued past maxQueuedBlocks, the disk was falling behind
+  uint64_t failedBlocks = 0;        // Not (completely) written, their bytes aren't in bytesWritten
+  double throughput = 0.0;          // MB/s since open
+  double averageWriteLatency = 0.0; // Seconds from hand-off to completion
+  double maxWriteLatency = 0.0;
+};
+
+// Output AVIOContext backend. The muxer only copies into aligned blocks; a writer thread
+// issues the actual writes (io_uring when available, pwrite otherwise). Writes land in file
+// order, so a reader following the file never sees a hole past a pending block.
+class AsyncFileWriter {
+private:
+  struct Block {
+    uint8_t* data = nullptr;
+    size_t length = 0;
+    int64_t offset = 0;
+    double queuedAt = 0.0;
+  };
+
+  AsyncWriterConfig config;
+  std::string path;
+  int fd = -1;
+  int directFd = -1;
+
+  // Muxer side
+  Block current;
+  int64_t fileSize = 0;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Block> queue;
+  std::vector<uint8_t*> freeBlocks;
+  bool finishing = false;
+  std::thread thread;
+  std::atomic<bool> failed{false};
+  bool alignmentLost = false;
+
+  // Writer thread side
+  int64_t allocated = 0;
+  bool canPreallocate = true;
+  double openedAt = 0.0;
+  double closedAt = 0.0; // Throughput stops counting time once the file is closed
+
+  std::mutex statsMutex;
+  AsyncWriterStats stats;
+  double totalLatency = 0.0;
+  uint64_t completedBlocks = 0;
+
+#ifdef REWIND_HAVE_IO_URING
+  struct io_uring ring;
+  bool ringReady = false;
+  void writeBatchUring(std::vector<Block>& batch, std::vector<bool>& written);
+#endif
+
+  uint8_t* allocateBlock();
+  void submitCurrent();
+  void loseAlignment(int64_t offset);
+  void writerLoop();
+  bool writeBlockSync(const Block& block, size_t done);
+  void preallocate(const Block& block);
+  void completeBlock(const Block& block, bool written);
+  int fdFor(const Block& block);
+
+  static int writePacket(void* opaque, AVIOWriteBuffer buf, int size);
+  static int64_t seekPacket(void* opaque, int64_t offset, int whence);
+
+public:
+  AsyncFileWriter();
+  ~AsyncFileWriter();
+  bool open(const std::string& path, AsyncWriterConfig config = AsyncWriterConfig());
+
+  // AVIOContext for a muxer, set AVFMT_FLAG_CUSTOM_IO and free with freeContext
+  AVIOContext* createContext();
+  static void freeContext(AVIOContext** context);
+
+  int write(const uint8_t* buf, int size);
+  int64_t seek(int64_t offset, int whence);
+
+  // Flush everything, wait for the writer thread and close the file
+  bool close();
+  AsyncWriterStats getStats();
+};
+
+#endif // ASYNCFILEWRITER_HPP
@@ -0,0 +1,219 @@
+#include "audio_decoder.hpp"
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+AudioDecoder::AudioDecoder() {
+
+}
+
+AudioDecoder::~AudioDecoder() {
+  this->close();
+}
+
+bool AudioDecoder::open(const std::string& fileName, int channels) {
+  this->close();
+  this->fileName = fileName;
+  this->memoryStream = nullptr;
+  this->requestedChannels = channels;
+  this->position = 0;
+  return this->openInput();
+}
+
+bool AudioDecoder::open(std::shared_ptr<MemoryStream> stream, int channels) {
+  this->close();
+  this->fileName = "replay buffer";
+  this->memoryStream = stream;
+  this->requestedChannels = channels;
+  this->position = 0;
+  return this->openInput();
+}
+
+bool AudioDecoder::reopen() {
+  int64_t position = this->position;
+  this->close();
+  return this->openInput() && this->seek(position);
+}
+
+bool AudioDecoder::openInput() {
+  if (!this->input.open(&this->formatContext, this->fileName, this->memoryStream)) {
+    std::cout << "Audio: could not open " << this->fileName << std::endl;
+    this->close();
+    return false;
+  }
+
+  this->streamIndex = -1;
+  for (unsigned int i = 0; i < this->formatContext->nb_streams; i++) {
+    AVStream* stream = this->formatContext->streams[i];
+    if (this->streamIndex < 0 && stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+      this->streamIndex = i;
+    } else {
+      // Don't demux video at all
+      stream->discard = AVDISCARD_ALL;
+    }
+  }
+
+  AVCodecParameters* params = this->streamIndex >= 0 ? this->formatContext->streams[this->streamIndex]->codecpar : nullptr;
+  const AVCodec* codec = params ? avcodec_find_decoder(params->codec_id) : nullptr;
+  if (!codec || params->sample_rate <= 0) {
+    std::cout << "Audio: no decodable audio stream in " << this->fileName << std::endl;
+    this->close();
+    return false;
+  }
+
+  this->codecContext = avcodec_alloc_context3(codec);
+  avcodec_parameters_to_context(this->codecContext, params);
+  this->codecContext->thread_count = 1;
+  if (avcodec_open2(this->codecContext, codec, NULL) < 0) {
+    std::cout << "Audio: could not open decoder" << std::endl;
+    this->close();
+    return false;
+  }
+
+  // Interleaved float at the source rate, so sample counts map straight to time
+  this->sampleRate = this->codecContext->sample_rate;
+  if (this->requestedChannels > 0) {
+    av_channel_layout_default(&this->layout, this->requestedChannels);
+  } else {
+    av_channel_layout_copy(&this->layout, &this->codecContext->ch_layout);
+  }
+  this->channels = this->layout.nb_channels;
+  if (swr_alloc_set_opts2(&this->swrContext, &this->layout, AV_SAMPLE_FMT_FLT, this->sampleRate,
+      &this->codecContext->ch_layout, this->codecContext->sample_fmt, this->sampleRate, 0, NULL) < 0
+      || swr_init(this->swrContext) < 0) {
+    std::cout << "Audio: could not create resampler" << std::endl;
+    this->close();
+    return false;
+  }
+
+  this->packet = av_packet_alloc();
+  this->frame = av_frame_alloc();
+  return this->packet && this->frame;
+}
+
+void AudioDecoder::close() {
+  swr_free(&this->swrContext);
+  av_frame_free(&this->frame);
+  av_packet_free(&this->packet);
+  avcodec_free_context(&this->codecContext);
+  this->input.close(&this->formatContext);
+  av_channel_layout_uninit(&this->layout);
+  this->silence = 0;
+  this->held.clear();
+}
+
+bool AudioDecoder::seek(int64_t position) {
+  if (!this->formatContext || !this->codecContext) {
+    return false;
+  }
+
+  AVStream* stream = this->formatContext->streams[this->streamIndex];
+  int64_t target = (int64_t)std::llround((double)position / this->sampleRate / av_q2d(stream->time_base));
+  if (av_seek_frame(this->formatContext, this->streamIndex, target, AVSEEK_FLAG_BACKWARD) < 0 && position > 0) {
+    return false;
+  }
+
+  avcodec_flush_buffers(this->codecContext);
+  this->position = position;
+  this->silence = 0;
+  this->held.clear();
+  return true;
+}
+
+bool AudioDecoder::decodePacket(std::vector<float>& samples, int64_t* start) {
+  samples.clear();
+  *start = INT64_MIN;
+
+  // Until one packet yields samples, drain the decoder once the input runs out
+  while (true) {
+    bool ended = av_read_frame(this->formatContext, this->packet) < 0;
+    if (ended) {
+      avcodec_send_packet(this->codecContext, NULL);
+    } else {
+      if (this->packet->stream_index == this->streamIndex)
+        avcodec_send_packet(this->codecContext, this->packet);
+      av_packet_unref(this->packet);
+    }
+
+    while (avcodec_receive_frame(this->codecContext, this->frame) == 0) {
+      if (samples.empty() && this->frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+        AVRational timeBase = this->formatContext->streams[this->streamIndex]->time_base;
+        *start = std::llround(this->frame->best_effort_timestamp * av_q2d(timeBase) * this->sampleRate);
+      }
+
+      size_t offset = samples.size();
+      int capacity = swr_get_out_samples(this->swrContext, this->frame->nb_samples);
+      samples.resize(offset + (size_t)std::max(capacity, 0) * this->channels);
+      uint8_t* out[1] = { (uint8_t*)(samples.data() + offset) };
+      int converted = swr_convert(this->swrContext, out, capacity, (const uint8_t**)this->frame->extended_data, this->frame->nb_samples);
+      samples.resize(offset + (size_t)std::max(converted, 0) * this->channels);
+      av_frame_unref(this->frame);
+    }
+
+    if (!samples.empty() || ended) {
+      return !samples.empty();
+    }
+  }
+}
+
+bool AudioDecoder::read(std::vector<float>& samples) {
+  if (!this->formatContext) {
+    return false;
+  }
+
+  while (true) {
+    // A gap comes out as silence in bounded pieces, then what was decoded after it
+    if (this->silence > 0) {
+      int64_t count = std::min<int64_t>(this->silence, 1 << 16);
+      samples.assign((size_t)count * this->channels, 0.0f);
+      this->silence -= count;
+      this->position += count;
+      return true;
+    }
+    if (!this->held.empty()) {
+      samples.swap(this->held);
+      this->held.clear();
+      this->position += samples.size() / this->channels;
+      return true;
+    }
+
+    int64_t start;
+    if (!this->decodePacket(samples, &start)) {
+      return false;
+    }
+
+    int64_t frames = samples.size() / this->channels;
+    int64_t offset = start == INT64_MIN ? 0 : this->position - start;
+    if (std::abs(offset) <= this->timestampSlack) {
+      offset = 0;
+    }
+    if (offset >= frames) {
+      continue;
+    }
+    if (offset < 0) {
+      this->silence = -offset;
+      this->held.swap(samples);
+      continue;
+    }
+
+    samples.erase(samples.begin(), samples.begin() + offset * this->channels);
+    this->position += frames - offset;
+    return true;
+  }
+}
+
+int64_t AudioDecoder::getPosition() {
+  return this->position;
+}
+
+int AudioDecoder::getSampleRate() {
+  return this->sampleRate;
+}
+
+int AudioDecoder::getChannels() {
+  return this->channels;
+}
+
+AVChannel AudioDecoder::getChannel(int index) {
+  return av_channel_layout_channel_from_index(&this->layout, index);
+}
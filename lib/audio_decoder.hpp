@@ -0,0 +1,71 @@
+#ifndef AUDIODECODER_HPP
+#define AUDIODECODER_HPP
+
+#include "memory_stream.hpp"
+#include "media_input.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+}
+
+// Demuxer and decoder of its own for the audio track, separate from the playback decoder.
+// Hands out interleaved float at the source rate as one continuous run of sample frames:
+// timestamp gaps come back as silence and overlaps after a seek are dropped, so a
+// sample frame's index is its time. Not thread safe, owned by one worker.
+class AudioDecoder {
+private:
+  const int64_t timestampSlack = 256; // Rounding in coarse time bases isn't a gap
+
+  std::string fileName;
+  std::shared_ptr<MemoryStream> memoryStream;
+  MediaInput input;
+  AVFormatContext* formatContext = nullptr;
+  AVCodecContext* codecContext = nullptr;
+  SwrContext* swrContext = nullptr;
+  AVPacket* packet = nullptr;
+  AVFrame* frame = nullptr;
+  int streamIndex = -1;
+  int sampleRate = 0;
+  int requestedChannels = 0;
+  int channels = 0;
+  AVChannelLayout layout = {}; // Of the output
+
+  int64_t position = 0;     // Sample frame the next read starts at
+  int64_t silence = 0;      // Gap still to hand out before held
+  std::vector<float> held;
+
+  bool openInput();
+  bool decodePacket(std::vector<float>& samples, int64_t* start);
+
+public:
+  AudioDecoder();
+  ~AudioDecoder();
+
+  // channels 0 keeps the source layout, 1 downmixes to mono
+  bool open(const std::string& fileName, int channels = 0);
+  bool open(std::shared_ptr<MemoryStream> stream, int channels = 0);
+  void close();
+
+  // Reopen the same source where reading left off, a growing file may have more now
+  bool reopen();
+
+  // Continue from a sample frame, decoding from the packet before it
+  bool seek(int64_t position);
+
+  // The next samples after the previous read. False at the end of what's there.
+  bool read(std::vector<float>& samples);
+
+  int64_t getPosition();
+  int getSampleRate();
+  int getChannels();
+  AVChannel getChannel(int index);
+};
+
+#endif // AUDIODECODER_HPP
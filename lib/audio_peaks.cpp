@@ -0,0 +1,442 @@
+#include "audio_peaks.hpp"
+#include "source_identity.hpp"
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+  const char sidecarMagic[4] = { 'R', 'W', 'P', 'K' };
+  const uint32_t sidecarVersion = 2;
+
+  struct SidecarHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t sampleRate;
+    uint32_t samplesPerBucket;
+    SourceIdentity source; // Recording the sidecar was built from
+  };
+  static_assert(sizeof(AudioPeak) == 12, "sidecar records are three floats");
+
+  typedef void (*ReduceKernel)(const float* samples, size_t count, AudioPeak* peak);
+
+  void reduceScalar(const float* samples, size_t count, AudioPeak* peak) {
+    float lo = samples[0];
+    float hi = samples[0];
+    float sum = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+      lo = std::min(lo, samples[i]);
+      hi = std::max(hi, samples[i]);
+      sum += samples[i] * samples[i];
+    }
+    peak->min = lo;
+    peak->max = hi;
+    peak->meanSquare = sum / count;
+  }
+
+#if defined(__SSE2__)
+  // Eight samples per step in two registers, two sums so the adds don't serialize
+  void reduceSse(const float* samples, size_t count, AudioPeak* peak) {
+    __m128 lo = _mm_set1_ps(samples[0]);
+    __m128 hi = lo;
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      __m128 a = _mm_loadu_ps(samples + i);
+      __m128 b = _mm_loadu_ps(samples + i + 4);
+      lo = _mm_min_ps(lo, _mm_min_ps(a, b));
+      hi = _mm_max_ps(hi, _mm_max_ps(a, b));
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(a, a));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(b, b));
+    }
+
+    float los[4], his[4], sums[4];
+    _mm_storeu_ps(los, lo);
+    _mm_storeu_ps(his, hi);
+    _mm_storeu_ps(sums, _mm_add_ps(sum0, sum1));
+    float sum = sums[0] + sums[1] + sums[2] + sums[3];
+    peak->min = std::min(std::min(los[0], los[1]), std::min(los[2], los[3]));
+    peak->max = std::max(std::max(his[0], his[1]), std::max(his[2], his[3]));
+    for (; i < count; i++) {
+      peak->min = std::min(peak->min, samples[i]);
+      peak->max = std::max(peak->max, samples[i]);
+      sum += samples[i] * samples[i];
+    }
+    peak->meanSquare = sum / count;
+  }
+#endif
+
+#if defined(__x86_64__)
+  // Same as the SSE kernel at twice the width, only picked when the CPU has AVX
+  __attribute__((target("avx")))
+  void reduceAvx(const float* samples, size_t count, AudioPeak* peak) {
+    __m256 lo = _mm256_set1_ps(samples[0]);
+    __m256 hi = lo;
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+      __m256 a = _mm256_loadu_ps(samples + i);
+      __m256 b = _mm256_loadu_ps(samples + i + 8);
+      lo = _mm256_min_ps(lo, _mm256_min_ps(a, b));
+      hi = _mm256_max_ps(hi, _mm256_max_ps(a, b));
+      sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(a, a));
+      sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(b, b));
+    }
+
+    float los[8], his[8], sums[8];
+    _mm256_storeu_ps(los, lo);
+    _mm256_storeu_ps(his, hi);
+    _mm256_storeu_ps(sums, _mm256_add_ps(sum0, sum1));
+    float sum = 0.0f;
+    peak->min = los[0];
+    peak->max = his[0];
+    for (int lane = 0; lane < 8; lane++) {
+      peak->min = std::min(peak->min, los[lane]);
+      peak->max = std::max(peak->max, his[lane]);
+      sum += sums[lane];
+    }
+    for (; i < count; i++) {
+      peak->min = std::min(peak->min, samples[i]);
+      peak->max = std::max(peak->max, samples[i]);
+      sum += samples[i] * samples[i];
+    }
+    peak->meanSquare = sum / count;
+  }
+#endif
+
+  ReduceKernel selectKernel() {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx"))
+      return reduceAvx;
+#endif
+#if defined(__SSE2__)
+    return reduceSse;
+#else
+    return reduceScalar;
+#endif
+  }
+
+  const ReduceKernel reduceBucket = selectKernel();
+}
+
+AudioPeakPyramid::AudioPeakPyramid() {
+
+}
+
+AudioPeakPyramid::~AudioPeakPyramid() {
+  this->close();
+}
+
+bool AudioPeakPyramid::open(const std::string& fileName) {
+  this->close();
+  if (!this->decoder.open(fileName, 1)) {
+    return false;
+  }
+  this->sampleRate = this->decoder.getSampleRate();
+
+  // Only decode what the sidecar doesn't have yet
+  this->sourcePath = fileName;
+  this->sidecarPath = fileName + ".peaks";
+  if (!this->openSidecar())
+    std::cout << "Audio peaks: not persisting to " << this->sidecarPath << std::endl;
+  if (this->samplePosition > 0)
+    this->decoder.seek(this->samplePosition);
+  return this->start(true);
+}
+
+bool AudioPeakPyramid::open(std::shared_ptr<MemoryStream> stream) {
+  this->close();
+  bool opened = this->decoder.open(stream, 1);
+  this->sampleRate = this->decoder.getSampleRate();
+  return this->start(opened);
+}
+
+bool AudioPeakPyramid::start(bool opened) {
+  if (!opened) {
+    return false;
+  }
+
+  this->running = true;
+  this->worker = std::thread(&AudioPeakPyramid::workLoop, this);
+  return true;
+}
+
+void AudioPeakPyramid::close() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->running = false;
+  }
+  this->condition.notify_all();
+  if (this->worker.joinable())
+    this->worker.join();
+
+  this->decoder.close();
+  if (this->sidecarFd >= 0) {
+    ::close(this->sidecarFd);
+    this->sidecarFd = -1;
+  }
+  this->sidecarPath.clear();
+  this->sourcePath.clear();
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (std::vector<AudioPeak>& level : this->levels)
+    level.clear();
+  this->pending.clear();
+  this->samplePosition = 0;
+  this->sampleRate = 0;
+  this->atEnd = false;
+  this->endFrameCount = 0;
+  this->index = nullptr;
+  this->stats = AudioPeakStats();
+}
+
+bool AudioPeakPyramid::openSidecar() {
+  this->sidecarFd = ::open(this->sidecarPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (this->sidecarFd < 0) {
+    return false;
+  }
+
+  // Start over if the file is from another rate or bucket size, or from a replaced recording
+  SidecarHeader header;
+  bool valid = pread(this->sidecarFd, &header, sizeof(header), 0) == sizeof(header)
+    && memcmp(header.magic, sidecarMagic, sizeof(sidecarMagic)) == 0 && header.version == sidecarVersion
+    && header.sampleRate == (uint32_t)this->sampleRate && header.samplesPerBucket == (uint32_t)this->samplesPerBucket
+    && isSameSource(header.source, this->sourcePath);
+
+  if (!valid) {
+    header = SidecarHeader();
+    if (!readSourceIdentity(this->sourcePath, &header.source)) {
+      ::close(this->sidecarFd);
+      this->sidecarFd = -1;
+      return false;
+    }
+    memcpy(header.magic, sidecarMagic, sizeof(sidecarMagic));
+    header.version = sidecarVersion;
+    header.sampleRate = this->sampleRate;
+    header.samplesPerBucket = this->samplesPerBucket;
+    if (ftruncate(this->sidecarFd, 0) < 0 || pwrite(this->sidecarFd, &header, sizeof(header), 0) != sizeof(header)) {
+      ::close(this->sidecarFd);
+      this->sidecarFd = -1;
+      return false;
+    }
+    return true;
+  }
+
+  // Load the base level and rebuild the rest, a torn record at the end is cut off
+  struct stat st;
+  fstat(this->sidecarFd, &st);
+  size_t count = (st.st_size - sizeof(SidecarHeader)) / sizeof(AudioPeak);
+  std::vector<AudioPeak> peaks(count);
+  ssize_t bytes = count * sizeof(AudioPeak);
+  if (count > 0 && pread(this->sidecarFd, peaks.data(), bytes, sizeof(SidecarHeader)) != bytes) {
+    count = 0;
+  }
+  int64_t end = sizeof(SidecarHeader) + count * sizeof(AudioPeak);
+  if (end < st.st_size && ftruncate(this->sidecarFd, end) < 0) {
+    std::cout << "Audio peaks: could not trim " << this->sidecarPath << std::endl;
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (size_t i = 0; i < count; i++)
+    this->appendBucket(peaks[i]);
+  this->samplePosition = (int64_t)count * this->samplesPerBucket;
+  this->stats.sidecarBuckets = count;
+  this->stats.decodedSeconds = (double)this->samplePosition / this->sampleRate;
+  return true;
+}
+
+void AudioPeakPyramid::workLoop() {
+  std::vector<float> samples;
+  std::vector<AudioPeak> added;
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  while (this->running) {
+    if (this->atEnd) {
+      // Caught up, pick up again once the recording has grown
+      if (!this->index || this->index->getFrameCount() <= this->endFrameCount) {
+        this->condition.wait(lock);
+        continue;
+      }
+      this->atEnd = false;
+      lock.unlock();
+      bool reopened = this->decoder.reopen();
+      lock.lock();
+      if (!reopened) {
+        this->atEnd = true;
+        this->endFrameCount = this->index->getFrameCount();
+        continue;
+      }
+    }
+    lock.unlock();
+
+    bool decoded = this->decoder.read(samples);
+
+    lock.lock();
+    if (!decoded) {
+      this->atEnd = true;
+      this->endFrameCount = this->index ? this->index->getFrameCount() : 0;
+      continue;
+    }
+    size_t first = this->levels[0].size();
+    this->append(samples.data(), samples.size(), added);
+
+    // The sidecar write can stall on disk, query() on the UI thread mustn't wait for it
+    if (this->sidecarFd >= 0 && !added.empty()) {
+      lock.unlock();
+      this->writeSidecar(added, first);
+      lock.lock();
+    }
+  }
+}
+
+// Copies the new base-level buckets into added for the sidecar
+void AudioPeakPyramid::append(const float* samples, size_t count, std::vector<AudioPeak>& added) {
+  size_t spb = this->samplesPerBucket;
+  size_t firstNew = this->levels[0].size();
+  size_t i = 0;
+
+  // Top up the partial bucket first, then whole buckets straight from the input
+  if (!this->pending.empty()) {
+    i = std::min(spb - this->pending.size(), count);
+    this->pending.insert(this->pending.end(), samples, samples + i);
+    if (this->pending.size() == spb) {
+      AudioPeak peak;
+      reduceBucket(this->pending.data(), spb, &peak);
+      this->appendBucket(peak);
+      this->pending.clear();
+    }
+  }
+  for (; i + spb <= count; i += spb) {
+    AudioPeak peak;
+    reduceBucket(samples + i, spb, &peak);
+    this->appendBucket(peak);
+  }
+  this->pending.insert(this->pending.end(), samples + i, samples + count);
+  this->samplePosition += count;
+  this->stats.decodedSeconds = (double)this->samplePosition / this->sampleRate;
+
+  added.assign(this->levels[0].begin() + firstNew, this->levels[0].end());
+}
+
+void AudioPeakPyramid::writeSidecar(const std::vector<AudioPeak>& peaks, size_t first) {
+  ssize_t bytes = peaks.size() * sizeof(AudioPeak);
+  int64_t offset = sizeof(SidecarHeader) + first * sizeof(AudioPeak);
+  if (pwrite(this->sidecarFd, peaks.data(), bytes, offset) != bytes) {
+    std::cout << "Audio peaks: could not write " << this->sidecarPath << std::endl;
+    ::close(this->sidecarFd);
+    this->sidecarFd = -1;
+  }
+}
+
+void AudioPeakPyramid::appendBucket(const AudioPeak& peak) {
+  this->levels[0].push_back(peak);
+
+  // Each coarser level keeps its last entry current, even while it has fewer than levelFactor children
+  for (int level = 1; level < LEVEL_COUNT; level++) {
+    const std::vector<AudioPeak>& children = this->levels[level - 1];
+    size_t parent = (children.size() - 1) / this->levelFactor;
+    size_t first = parent * this->levelFactor;
+
+    AudioPeak combined = children[first];
+    for (size_t child = first + 1; child < children.size(); child++) {
+      combined.min = std::min(combined.min, children[child].min);
+      combined.max = std::max(combined.max, children[child].max);
+      combined.meanSquare += children[child].meanSquare;
+    }
+    combined.meanSquare /= children.size() - first;
+
+    if (parent == this->levels[level].size()) {
+      this->levels[level].push_back(combined);
+    } else {
+      this->levels[level][parent] = combined;
+    }
+  }
+
+  this->stats.buckets = this->levels[0].size();
+}
+
+void AudioPeakPyramid::setIndex(std::shared_ptr<const TimelineIndex> index) {
+  if (!index) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (index == this->index) {
+    return;
+  }
+  this->index = index;
+  if (this->atEnd)
+    this->condition.notify_one();
+}
+
+size_t AudioPeakPyramid::query(double start, double end, size_t columns, AudioPeak* out) {
+  auto queryStart = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (columns == 0 || end <= start || this->sampleRate <= 0 || this->levels[0].empty()) {
+    return 0;
+  }
+
+  // Coarsest level whose buckets still fit inside a column, so a column reduces a few buckets at most
+  double samplesPerColumn = (end - start) * this->sampleRate / columns;
+  int level = 0;
+  double bucketSamples = this->samplesPerBucket;
+  while (level + 1 < LEVEL_COUNT && bucketSamples * this->levelFactor <= samplesPerColumn) {
+    level++;
+    bucketSamples *= this->levelFactor;
+  }
+
+  const std::vector<AudioPeak>& peaks = this->levels[level];
+  double bucketsPerColumn = samplesPerColumn / bucketSamples;
+  double firstBucket = start * this->sampleRate / bucketSamples;
+  size_t filled = 0;
+  for (size_t column = 0; column < columns; column++) {
+    double from = firstBucket + column * bucketsPerColumn;
+    int64_t first = (int64_t)std::floor(from);
+    int64_t last = std::max(first + 1, (int64_t)std::ceil(from + bucketsPerColumn));
+    if (last <= 0) {
+      out[column] = AudioPeak();
+      filled = column + 1;
+      continue;
+    }
+    first = std::max<int64_t>(first, 0);
+    if (first >= (int64_t)peaks.size()) {
+      break;
+    }
+    last = std::min<int64_t>(last, peaks.size());
+
+    AudioPeak peak = peaks[first];
+    for (int64_t bucket = first + 1; bucket < last; bucket++) {
+      peak.min = std::min(peak.min, peaks[bucket].min);
+      peak.max = std::max(peak.max, peaks[bucket].max);
+      peak.meanSquare += peaks[bucket].meanSquare;
+    }
+    peak.meanSquare /= last - first;
+    out[column] = peak;
+    filled = column + 1;
+  }
+
+  this->stats.lastQueryUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - queryStart).count();
+  return filled;
+}
+
+double AudioPeakPyramid::getDecodedDuration() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->sampleRate > 0 ? (double)this->samplePosition / this->sampleRate : 0.0;
+}
+
+AudioPeakStats AudioPeakPyramid::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->stats.memoryBytes = 0;
+  for (const std::vector<AudioPeak>& level : this->levels)
+    this->stats.memoryBytes += level.size() * sizeof(AudioPeak);
+  return this->stats;
+}
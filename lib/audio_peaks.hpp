@@ -0,0 +1,87 @@
+#ifndef AUDIOPEAKS_HPP
+#define AUDIOPEAKS_HPP
+
+#include "audio_decoder.hpp"
+#include "timeline_index.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+struct AudioPeak {
+  float min = 0.0f;
+  float max = 0.0f;
+  float meanSquare = 0.0f; // sqrt for RMS
+};
+
+struct AudioPeakStats {
+  size_t buckets = 0;        // Base level
+  size_t memoryBytes = 0;    // All levels
+  size_t sidecarBuckets = 0; // Read back instead of decoded
+  double decodedSeconds = 0.0;
+  double lastQueryUs = 0.0;
+};
+
+// Min/max/RMS of the audio track (downmixed to mono) in buckets of 256 samples, with
+// coarser levels of 4x each on top so any zoom reduces at most a handful of buckets per
+// pixel. Decodes on its own thread with its own decoder and keeps up with a growing
+// recording. The base level is appended to a sidecar next to the recording, reopening
+// it only decodes what's new.
+class AudioPeakPyramid {
+private:
+  static constexpr int LEVEL_COUNT = 8;
+  const int samplesPerBucket = 256;
+  const int levelFactor = 4;
+
+  AudioDecoder decoder;
+  int sampleRate = 0;
+
+  // Sidecar: header, then the base level as AudioPeak records
+  std::string sidecarPath;
+  std::string sourcePath;
+  int sidecarFd = -1; // Only the worker writes, outside the lock
+  bool openSidecar();
+  void writeSidecar(const std::vector<AudioPeak>& peaks, size_t first);
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool running = false;
+  bool atEnd = false;
+  size_t endFrameCount = 0; // Index size when the end was hit, grows while recording
+  std::shared_ptr<const TimelineIndex> index;
+
+  // Samples accounted for so far, those past the last full bucket wait in pending
+  int64_t samplePosition = 0;
+  std::vector<float> pending;
+  std::vector<AudioPeak> levels[LEVEL_COUNT];
+  AudioPeakStats stats;
+
+  bool start(bool opened);
+  void workLoop();
+  void append(const float* samples, size_t count, std::vector<AudioPeak>& added);
+  void appendBucket(const AudioPeak& peak);
+
+public:
+  AudioPeakPyramid();
+  ~AudioPeakPyramid();
+
+  // The sidecar is <fileName>.peaks, memory streams aren't persisted
+  bool open(const std::string& fileName);
+  bool open(std::shared_ptr<MemoryStream> stream);
+  void close();
+
+  // Latest video index, decoding resumes when it has grown past where the audio ended
+  void setIndex(std::shared_ptr<const TimelineIndex> index);
+
+  // Peaks of columns equal slices of [start, end] seconds. Returns how many leading
+  // columns have audio decoded, the rest are left untouched.
+  size_t query(double start, double end, size_t columns, AudioPeak* out);
+
+  double getDecodedDuration();
+  AudioPeakStats getStats();
+};
+
+#endif // AUDIOPEAKS_HPP
@@ -0,0 +1,16 @@
+#ifndef AVIOCOMPAT_HPP
+#define AVIOCOMPAT_HPP
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+// AVIOContext write callbacks take a const buffer since libavformat 61 (FFmpeg 7)
+#if LIBAVFORMAT_VERSION_MAJOR < 61
+typedef uint8_t* AVIOWriteBuffer;
+#else
+typedef const uint8_t* AVIOWriteBuffer;
+#endif
+
+#endif // AVIOCOMPAT_HPP
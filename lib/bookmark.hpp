@@ -0,0 +1,17 @@
+#ifndef BOOKMARK_HPP
+#define BOOKMARK_HPP
+
+enum class BookmarkKind {
+  SceneCut,
+  Motion,
+  Loudness
+};
+
+// A point on the timeline worth jumping to, placed by one of the analyzers
+struct Bookmark {
+  double time = 0.0;
+  BookmarkKind kind = BookmarkKind::SceneCut;
+  float score = 0.0f; // Detector specific strength
+};
+
+#endif // BOOKMARK_HPP
@@ -0,0 +1,15 @@
+#ifndef CLIP_HPP
+#define CLIP_HPP
+
+#include <cstdint>
+
+// A range of the recording, named by the user. The name is an id into the UI's string arena,
+// id stays the same across edits and sessions so the project journal can refer to it.
+struct Clip {
+  double time_start = 0.0;
+  double time_end = 0.0;
+  uint32_t name = 0;
+  uint32_t id = 0;
+};
+
+#endif // CLIP_HPP
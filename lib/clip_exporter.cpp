@@ -0,0 +1,334 @@
+#include "clip_exporter.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+// Segment bounds come from index timestamps, this absorbs rounding on the way back to ticks
+static const double timestampSlack = 1e-3;
+
+ClipExporter::ClipExporter() {
+
+}
+
+ClipExporter::~ClipExporter() {
+  this->cancel();
+}
+
+bool ClipExporter::start(const std::string& fileName, const std::string& outputFile, std::vector<TimeSpan> segments) {
+  if (this->isRunning()) {
+    return false;
+  }
+  this->fileName = fileName;
+  this->memoryStream = nullptr;
+  return this->launch(outputFile, std::move(segments));
+}
+
+bool ClipExporter::start(std::shared_ptr<MemoryStream> stream, const std::string& outputFile, std::vector<TimeSpan> segments) {
+  if (this->isRunning()) {
+    return false;
+  }
+  this->fileName = "replay buffer";
+  this->memoryStream = stream;
+  return this->launch(outputFile, std::move(segments));
+}
+
+bool ClipExporter::launch(const std::string& outputFile, std::vector<TimeSpan> segments) {
+  if (this->worker.joinable())
+    this->worker.join();
+
+  double kept = 0.0;
+  for (const TimeSpan& segment : segments)
+    kept += segment.end - segment.start;
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->outputFile = outputFile;
+  this->segments = std::move(segments);
+  this->status = ExportStatus();
+  this->status.outputFile = outputFile;
+  this->status.keptSeconds = kept;
+  if (this->segments.empty() || kept <= 0.0) {
+    this->status.error = "Nothing to export";
+    return false;
+  }
+
+  this->status.running = true;
+  this->running = true;
+  this->worker = std::thread(&ClipExporter::workLoop, this);
+  return true;
+}
+
+void ClipExporter::cancel() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->running = false;
+  }
+  if (this->worker.joinable())
+    this->worker.join();
+}
+
+ExportStatus ClipExporter::getStatus() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->status;
+}
+
+bool ClipExporter::isRunning() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->status.running;
+}
+
+double ClipExporter::getProgress() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->status.progress;
+}
+
+void ClipExporter::fail(const std::string& error) {
+  std::cout << "Export: " << error << std::endl;
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->status.error.empty())
+    this->status.error = error;
+}
+
+void ClipExporter::workLoop() {
+  bool succeeded = this->openInput() && this->openOutput();
+
+  double outputTime = 0.0;
+  for (size_t i = 0; succeeded && i < this->segments.size(); i++) {
+    double length = 0.0;
+    succeeded = this->copySegment(this->segments[i], outputTime, i == 0, &length);
+    outputTime += length;
+  }
+
+  if (succeeded && av_write_trailer(this->outputContext) < 0) {
+    this->fail("could not finish " + this->outputFile);
+    succeeded = false;
+  }
+  bool wroteFile = this->outputContext != nullptr;
+  this->closeStreams();
+
+  // Don't leave a half written file behind
+  if (!succeeded && wroteFile)
+    std::remove(this->outputFile.c_str());
+  if (succeeded)
+    std::cout << "Export: wrote " << outputTime << "s to " << this->outputFile << std::endl;
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->status.running = false;
+  this->status.succeeded = succeeded;
+  if (succeeded)
+    this->status.progress = 1.0;
+  if (!succeeded && this->status.error.empty())
+    this->status.error = "Cancelled";
+  this->running = false;
+}
+
+bool ClipExporter::openInput() {
+  // Same input paths as the player, with a context of its own. The mmap reader stays sequential.
+  if (!this->input.open(&this->inputContext, this->fileName, this->memoryStream)) {
+    this->fail("could not open " + this->fileName);
+    return false;
+  }
+
+  // First video stream plus every audio stream, the rest is left out
+  this->videoStream = -1;
+  this->streamMap.assign(this->inputContext->nb_streams, -1);
+  for (unsigned int i = 0; i < this->inputContext->nb_streams; i++) {
+    AVMediaType type = this->inputContext->streams[i]->codecpar->codec_type;
+    if (type == AVMEDIA_TYPE_VIDEO && this->videoStream < 0) {
+      this->videoStream = i;
+    } else if (type != AVMEDIA_TYPE_AUDIO) {
+      this->inputContext->streams[i]->discard = AVDISCARD_ALL;
+    }
+  }
+  if (this->videoStream < 0) {
+    this->fail("no video stream in " + this->fileName);
+    return false;
+  }
+
+  this->packet = av_packet_alloc();
+  return this->packet != nullptr;
+}
+
+bool ClipExporter::openOutput() {
+  if (avformat_alloc_output_context2(&this->outputContext, NULL, NULL, this->outputFile.c_str()) < 0 || !this->outputContext) {
+    this->fail("could not deduce output format for " + this->outputFile);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < this->inputContext->nb_streams; i++) {
+    AVStream* input = this->inputContext->streams[i];
+    if (input->discard == AVDISCARD_ALL || (input->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && (int)i != this->videoStream)) {
+      continue;
+    }
+
+    AVStream* output = avformat_new_stream(this->outputContext, NULL);
+    if (!output || avcodec_parameters_copy(output->codecpar, input->codecpar) < 0) {
+      this->fail("could not create output stream");
+      return false;
+    }
+    // The input container's tag may not be valid in the output one
+    output->codecpar->codec_tag = 0;
+    output->time_base = input->time_base;
+    this->streamMap[i] = output->index;
+  }
+  this->lastDts.assign(this->outputContext->nb_streams, AV_NOPTS_VALUE);
+
+  if (!(this->outputContext->oformat->flags & AVFMT_NOFILE) && avio_open(&this->outputContext->pb, this->outputFile.c_str(), AVIO_FLAG_WRITE) < 0) {
+    this->fail("could not open " + this->outputFile);
+    return false;
+  }
+  if (avformat_write_header(this->outputContext, NULL) < 0) {
+    this->fail("could not write header to " + this->outputFile);
+    return false;
+  }
+  return true;
+}
+
+bool ClipExporter::copySegment(const TimeSpan& segment, double outputTime, bool leadIn, double* outputLength) {
+  AVStream* video = this->inputContext->streams[this->videoStream];
+  int64_t target = (int64_t)std::llround(segment.start / av_q2d(video->time_base));
+  if (av_seek_frame(this->inputContext, this->videoStream, target, AVSEEK_FLAG_BACKWARD) < 0) {
+    this->fail("could not seek to " + std::to_string(segment.start) + "s");
+    return false;
+  }
+
+  // A stream is done once its decode time passes the end. Video packets are in decode order,
+  // so one shown after the end can still come before frames shown inside the segment.
+  std::vector<bool> done(this->streamMap.size(), false);
+  size_t open = 0;
+  for (int output : this->streamMap)
+    open += output >= 0;
+  bool videoStarted = false;
+  double videoFrom = segment.start - timestampSlack;
+  double length = segment.end - segment.start;
+  *outputLength = length;
+
+  while (open > 0) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (!this->running) {
+        return false;
+      }
+    }
+
+    int ret = av_read_frame(this->inputContext, this->packet);
+    if (ret == AVERROR_EOF) {
+      break;
+    }
+    if (ret < 0) {
+      this->fail("read error in " + this->fileName);
+      return false;
+    }
+
+    int input = this->packet->stream_index;
+    int output = this->streamMap[input];
+    if (output < 0 || done[input] || this->packet->pts == AV_NOPTS_VALUE) {
+      av_packet_unref(this->packet);
+      continue;
+    }
+
+    AVRational timeBase = this->inputContext->streams[input]->time_base;
+    double pts = this->packet->pts * av_q2d(timeBase);
+    double dts = (this->packet->dts != AV_NOPTS_VALUE ? this->packet->dts : this->packet->pts) * av_q2d(timeBase);
+    bool pastEnd = dts >= segment.end - timestampSlack;
+    if (pastEnd) {
+      done[input] = true;
+      open--;
+    }
+
+    // Audio is cut by presentation time. Video starts on the keyframe the segment was snapped to,
+    // or the one before it as a lead-in, and keeps everything decoded before the end.
+    bool keep;
+    if (input == this->videoStream) {
+      bool keyframe = this->packet->flags & AV_PKT_FLAG_KEY;
+      if (!videoStarted && keyframe && pts < segment.end - timestampSlack && (leadIn || pts >= segment.start - timestampSlack)) {
+        videoStarted = true;
+        videoFrom = std::min(videoFrom, pts - timestampSlack);
+      }
+      keep = videoStarted && !pastEnd && pts >= videoFrom;
+    } else {
+      keep = pts >= segment.start - timestampSlack && pts < segment.end - timestampSlack;
+    }
+    if (!keep) {
+      av_packet_unref(this->packet);
+      continue;
+    }
+
+    // A reference shown after the end pushes the next segment back
+    if (input == this->videoStream)
+      *outputLength = std::max(*outputLength, pts + this->packet->duration * av_q2d(timeBase) - segment.start);
+
+    // Move the segment to where the previous one ended
+    int64_t shift = (int64_t)std::llround((outputTime - segment.start) / av_q2d(timeBase));
+    this->packet->pts += shift;
+    if (this->packet->dts != AV_NOPTS_VALUE)
+      this->packet->dts += shift;
+    this->packet->stream_index = output;
+    this->packet->pos = -1;
+    av_packet_rescale_ts(this->packet, timeBase, this->outputContext->streams[output]->time_base);
+
+    // Joins can make decode times step back a tick, the muxer rejects that
+    if (this->packet->dts != AV_NOPTS_VALUE) {
+      if (this->lastDts[output] != AV_NOPTS_VALUE && this->packet->dts <= this->lastDts[output])
+        this->packet->dts = this->lastDts[output] + 1;
+      if (this->packet->pts < this->packet->dts)
+        this->packet->pts = this->packet->dts;
+      this->lastDts[output] = this->packet->dts;
+    }
+
+    if (av_interleaved_write_frame(this->outputContext, this->packet) < 0) {
+      this->fail("write error in " + this->outputFile);
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->status.keptSeconds > 0.0)
+      this->status.progress = std::min((outputTime + std::clamp(pts - segment.start, 0.0, length)) / this->status.keptSeconds, 1.0);
+  }
+  return true;
+}
+
+void ClipExporter::closeStreams() {
+  av_packet_free(&this->packet);
+  this->input.close(&this->inputContext);
+
+  if (this->outputContext) {
+    if (!(this->outputContext->oformat->flags & AVFMT_NOFILE))
+      avio_closep(&this->outputContext->pb);
+    avformat_free_context(this->outputContext);
+    this->outputContext = nullptr;
+  }
+  this->streamMap.clear();
+  this->lastDts.clear();
+}
+
+std::vector<TimeSpan> ClipExporter::planPlain(const TimelineIndex& index, TimeSpan range) {
+  std::vector<TimeSpan> segments;
+  if (index.empty()) {
+    return segments;
+  }
+
+  range.start = std::max(range.start, index.getStartPts());
+  range.end = std::min(range.end, index.getEndPts() + index.getAverageFrameDuration());
+  if (range.end > range.start)
+    segments.push_back(range);
+  return segments;
+}
+
+std::vector<TimeSpan> ClipExporter::planSegments(const TimelineIndex& index, TimeSpan range, const std::vector<TimeSpan>& deadSpans) {
+  std::vector<TimeSpan> segments;
+  if (index.empty()) {
+    return segments;
+  }
+
+  for (TimeSpan kept : subtractSpans(range, deadSpans)) {
+    // Back to the keyframe, so the cut keeps a little dead time rather than losing content
+    kept.start = index.ptsForFrame(index.previousKeyframe(index.frameForPts(kept.start)));
+    if (!segments.empty() && kept.start <= segments.back().end) {
+      segments.back().end = std::max(segments.back().end, kept.end);
+    } else if (kept.end > kept.start) {
+      segments.push_back(kept);
+    }
+  }
+  return segments;
+}
@@ -0,0 +1,87 @@
+#ifndef CLIPEXPORTER_HPP
+#define CLIPEXPORTER_HPP
+
+#include "memory_stream.hpp"
+#include "media_input.hpp"
+#include "timeline_index.hpp"
+#include "time_span.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+struct ExportStatus {
+  bool running = false;
+  bool succeeded = false;
+  double progress = 0.0;       // 0..1 of the kept duration
+  double keptSeconds = 0.0;
+  std::string outputFile;
+  std::string error;
+};
+
+// Writes segments of a recording back to back into a new file on its own thread. Packets are
+// stream copied, nothing is re-encoded, so each segment after the first has to start on a
+// keyframe; planSegments takes care of that. The first one may start anywhere: the lead-in from
+// the keyframe before gets negative timestamps and the MP4 edit list hides it. Video is cut by
+// decode time, so references that B-frames at the end of a segment need are kept (and shown,
+// the next segment moves back by that much). Timestamps are shifted to close the gaps.
+class ClipExporter {
+private:
+  std::string fileName;
+  std::shared_ptr<MemoryStream> memoryStream;
+  MediaInput input;
+  std::string outputFile;
+  std::vector<TimeSpan> segments;
+
+  AVFormatContext* inputContext = nullptr;
+  AVFormatContext* outputContext = nullptr;
+  AVPacket* packet = nullptr;
+  std::vector<int> streamMap;      // Input stream to output stream, -1 = not exported
+  std::vector<int64_t> lastDts;    // Per output stream, in its time base
+  int videoStream = -1;
+
+  std::thread worker;
+  std::mutex mutex;
+  bool running = false;
+  ExportStatus status;
+
+  bool launch(const std::string& outputFile, std::vector<TimeSpan> segments);
+  bool openInput();
+  bool openOutput();
+  bool copySegment(const TimeSpan& segment, double outputTime, bool leadIn, double* outputLength);
+  void closeStreams();
+  void fail(const std::string& error);
+  void workLoop();
+
+public:
+  ClipExporter();
+  ~ClipExporter();
+
+  // Export segments (sorted, starting on keyframes) of a file or the replay buffer. Fails if an export is running.
+  bool start(const std::string& fileName, const std::string& outputFile, std::vector<TimeSpan> segments);
+  bool start(std::shared_ptr<MemoryStream> stream, const std::string& outputFile, std::vector<TimeSpan> segments);
+
+  // Stop a running export and delete what it wrote so far
+  void cancel();
+  ExportStatus getStatus();
+
+  // Without copying the status strings, for polling every frame
+  bool isRunning();
+  double getProgress();
+
+  // What's left of range once the dead spans are cut out. Every piece is moved back to the keyframe
+  // at or before its start so it can be stream copied; pieces that run into each other are merged.
+  static std::vector<TimeSpan> planSegments(const TimelineIndex& index, TimeSpan range, const std::vector<TimeSpan>& deadSpans);
+
+  // The range as it is, dead time kept and the start exact (see the lead-in above)
+  static std::vector<TimeSpan> planPlain(const TimelineIndex& index, TimeSpan range);
+};
+
+#endif // CLIPEXPORTER_HPP
@@ -1,7 +1,24 @@
 #include "desktop_capture.hpp"
 #include <iostream>
+#include <string>
+#include <algorithm>
 #include <cstdlib>
 
+extern "C"
+{
+#include <libavdevice/avdevice.h>
+#include <libavutil/dict.h>
+}
+
+DesktopCapture::DesktopCapture(int frameRate) {
+    this->frameRate = std::max(1, frameRate);
+}
+
+DesktopCapture::~DesktopCapture() {
+    // Not virtual here, subclasses have closed their own state already
+    this->closeDevice();
+}
+
 Platform DesktopCapture::getCurrentPlatform() {
 #ifdef _WIN32
     return Platform::Windows;
@@ -38,3 +55,155 @@ void DesktopCapture::captureScreen() {
     std::cout << platformToString(currentPlatform) << std::endl;
 }
 
+bool DesktopCapture::open() {
+    this->closeDevice();
+    avdevice_register_all();
+
+    // Grabber and screen per platform. Wayland has no grabber in libavdevice, XWayland only shows X clients.
+    const char* format = nullptr;
+    std::string url;
+    AVDictionary* options = NULL;
+    av_dict_set(&options, "framerate", std::to_string(this->frameRate).c_str(), 0);
+    Platform platform = getCurrentPlatform();
+    switch (platform) {
+        case Platform::Windows:
+            format = "gdigrab";
+            url = "desktop";
+            break;
+        case Platform::MacOS:
+            format = "avfoundation";
+            url = "Capture screen 0";
+            av_dict_set(&options, "capture_cursor", "1", 0);
+            break;
+        case Platform::Linux_X11:
+            format = "x11grab";
+            url = getenv("DISPLAY");
+            av_dict_set(&options, "draw_mouse", "1", 0);
+            break;
+        default:
+            break;
+    }
+
+    const AVInputFormat* inputFormat = format ? av_find_input_format(format) : nullptr;
+    if (!inputFormat) {
+        std::cout << "Desktop capture is not supported on " << platformToString(platform) << std::endl;
+        av_dict_free(&options);
+        return false;
+    }
+
+    int response = avformat_open_input(&this->formatContext, url.c_str(), inputFormat, &options);
+    av_dict_free(&options);
+    if (response < 0) {
+        std::cout << "Could not open " << format << " on " << url << std::endl;
+        return false;
+    }
+
+    const AVCodec* codec = nullptr;
+    this->streamIndex = av_find_best_stream(this->formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (this->streamIndex < 0 || !codec) {
+        std::cout << "No video from " << format << std::endl;
+        this->closeDevice();
+        return false;
+    }
+
+    this->codecContext = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(this->codecContext, this->formatContext->streams[this->streamIndex]->codecpar);
+    if (avcodec_open2(this->codecContext, codec, NULL) < 0) {
+        std::cout << "Could not open the " << format << " decoder" << std::endl;
+        this->closeDevice();
+        return false;
+    }
+
+    // Chroma planes are subsampled, an odd edge row or column is dropped
+    this->width = this->codecContext->width & ~1;
+    this->height = this->codecContext->height & ~1;
+    this->swsContext = sws_getContext(this->codecContext->width, this->codecContext->height, this->codecContext->pix_fmt,
+        this->width, this->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+    this->packet = av_packet_alloc();
+    this->frame = av_frame_alloc();
+    if (this->width == 0 || this->height == 0 || !this->swsContext || !this->packet || !this->frame) {
+        this->closeDevice();
+        return false;
+    }
+
+    std::cout << "Capturing " << this->width << "x" << this->height << " at " << this->frameRate << " fps from " << format << std::endl;
+    return true;
+}
+
+void DesktopCapture::closeDevice() {
+    sws_freeContext(this->swsContext);
+    this->swsContext = nullptr;
+    av_packet_free(&this->packet);
+    av_frame_free(&this->frame);
+    avcodec_free_context(&this->codecContext);
+    avformat_close_input(&this->formatContext);
+    this->streamIndex = -1;
+    this->width = 0;
+    this->height = 0;
+    this->firstTimestamp = AV_NOPTS_VALUE;
+    this->lastPts = -1.0;
+}
+
+void DesktopCapture::close() {
+    this->closeDevice();
+}
+
+bool DesktopCapture::grabFrame(CaptureFrame& captured) {
+    if (!this->formatContext) {
+        return false;
+    }
+
+    // Blocks until the grabber has the next frame, it paces itself to the frame rate
+    while (av_read_frame(this->formatContext, this->packet) >= 0) {
+        if (this->packet->stream_index != this->streamIndex) {
+            av_packet_unref(this->packet);
+            continue;
+        }
+        int response = avcodec_send_packet(this->codecContext, this->packet);
+        av_packet_unref(this->packet);
+        if (response < 0) {
+            return false;
+        }
+        if (avcodec_receive_frame(this->codecContext, this->frame) < 0) {
+            continue;
+        }
+
+        captured.width = this->width;
+        captured.height = this->height;
+        captured.linesize[0] = this->width;
+        captured.linesize[1] = this->width / 2;
+        captured.linesize[2] = this->width / 2;
+        captured.data[0].resize((size_t)this->width * this->height);
+        captured.data[1].resize((size_t)(this->width / 2) * (this->height / 2));
+        captured.data[2].resize((size_t)(this->width / 2) * (this->height / 2));
+        uint8_t* planes[3] = { captured.data[0].data(), captured.data[1].data(), captured.data[2].data() };
+        sws_scale(this->swsContext, this->frame->data, this->frame->linesize, 0, this->frame->height, planes, captured.linesize);
+
+        // Seconds since the first frame by the grabber's clock. The recorder rounds to frame
+        // ticks, so frames closer than a tick are pushed apart rather than landing on one.
+        double pts = this->lastPts + 1.0 / this->frameRate;
+        int64_t timestamp = this->frame->best_effort_timestamp;
+        if (timestamp != AV_NOPTS_VALUE) {
+            if (this->firstTimestamp == AV_NOPTS_VALUE)
+                this->firstTimestamp = timestamp;
+            pts = std::max(pts, (timestamp - this->firstTimestamp) * av_q2d(this->formatContext->streams[this->streamIndex]->time_base));
+        }
+        captured.pts = std::max(pts, 0.0);
+        this->lastPts = captured.pts;
+        av_frame_unref(this->frame);
+        return true;
+    }
+    return false;
+}
+
+int DesktopCapture::getWidth() {
+    return this->width;
+}
+
+int DesktopCapture::getHeight() {
+    return this->height;
+}
+
+int DesktopCapture::getFrameRate() {
+    return this->frameRate;
+}
@@ -2,6 +2,15 @@
 #define DESKTOPCAPTURE_HPP
 
 #include <string>
+#include <vector>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
 
 enum class Platform {
     Windows,
@@ -11,12 +20,61 @@ enum class Platform {
     Unknown
 };
 
+// Raw YUV420P frame handed from a capture source to the recorder
+struct CaptureFrame {
+    std::vector<uint8_t> data[3];
+    int linesize[3];
+    int width;
+    int height;
+    double pts;
+
+    CaptureFrame() {
+        width = 0;
+        height = 0;
+        pts = 0.0;
+
+        for (int i = 0; i < 3; i++) {
+            data[i].clear();
+            linesize[i] = 0;
+        }
+    }
+};
+
+// Capture source interface, and the screen grabber itself. The base class grabs the desktop
+// through libavdevice (x11grab, gdigrab or avfoundation) and converts to YUV420P. Subclasses
+// override open/grabFrame to feed the recorder something else.
 class DesktopCapture {
+private:
+    AVFormatContext* formatContext = nullptr;
+    AVCodecContext* codecContext = nullptr;
+    SwsContext* swsContext = nullptr;
+    AVPacket* packet = nullptr;
+    AVFrame* frame = nullptr;
+    int streamIndex = -1;
+    int width = 0;
+    int height = 0;
+    int frameRate = 30;
+    int64_t firstTimestamp = AV_NOPTS_VALUE;
+    double lastPts = -1.0;
+
+    void closeDevice();
+
 public:
+    DesktopCapture(int frameRate = 30);
+    virtual ~DesktopCapture();
     Platform getCurrentPlatform();
     std::string platformToString(Platform platform);
     void captureScreen();
+
+    virtual bool open();
+    virtual void close();
+
+    // Fills frame with the next captured image, returns false when the source is exhausted
+    virtual bool grabFrame(CaptureFrame& frame);
+
+    virtual int getWidth();
+    virtual int getHeight();
+    virtual int getFrameRate();
 };
 
 #endif // DESKTOPCAPTURE_HPP
-
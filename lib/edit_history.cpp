@@ -0,0 +1,66 @@
+#include "edit_history.hpp"
+
+EditHistory::EditHistory(size_t maxBytes) {
+  this->maxBytes = maxBytes;
+}
+
+void EditHistory::record(const ClipEdit& edit, bool merge) {
+  this->redoStack.clear();
+  uint32_t clip = edit.hasAfter ? edit.after.id : edit.before.id;
+  if (merge && this->groupOpen && this->groupClip == clip && !this->undoStack.empty()) {
+    ClipEdit& group = this->undoStack.back();
+    group.after = edit.after;
+    group.hasAfter = edit.hasAfter;
+    return;
+  }
+
+  this->undoStack.push_back(edit);
+  this->groupOpen = merge;
+  this->groupClip = clip;
+  while (this->getMemoryBytes() > this->maxBytes && this->undoStack.size() > 1)
+    this->undoStack.pop_front();
+}
+
+void EditHistory::closeGroup() {
+  this->groupOpen = false;
+}
+
+bool EditHistory::undo(ClipEdit& edit) {
+  if (this->undoStack.empty()) {
+    return false;
+  }
+  edit = this->undoStack.back();
+  this->undoStack.pop_back();
+  this->redoStack.push_back(edit);
+  this->groupOpen = false;
+  return true;
+}
+
+bool EditHistory::redo(ClipEdit& edit) {
+  if (this->redoStack.empty()) {
+    return false;
+  }
+  edit = this->redoStack.back();
+  this->redoStack.pop_back();
+  this->undoStack.push_back(edit);
+  this->groupOpen = false;
+  return true;
+}
+
+bool EditHistory::canUndo() const {
+  return !this->undoStack.empty();
+}
+
+bool EditHistory::canRedo() const {
+  return !this->redoStack.empty();
+}
+
+void EditHistory::clear() {
+  this->undoStack.clear();
+  this->redoStack.clear();
+  this->groupOpen = false;
+}
+
+size_t EditHistory::getMemoryBytes() const {
+  return (this->undoStack.size() + this->redoStack.size()) * sizeof(ClipEdit);
+}
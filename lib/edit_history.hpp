@@ -0,0 +1,50 @@
+#ifndef EDITHISTORY_HPP
+#define EDITHISTORY_HPP
+
+#include "clip.hpp"
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+// One change to one clip: added (no before), removed (no after) or changed. Undoing puts
+// before back, redoing puts after back, so a command is a fixed-size value and never a
+// copy of the clip list.
+struct ClipEdit {
+  Clip before;
+  Clip after;
+  bool hadBefore = false;
+  bool hasAfter = false;
+};
+
+// Undo and redo stacks of clip edits. Both directions are O(1): the edit moves from one
+// stack to the other and the caller applies it. When the history outgrows its memory cap
+// the oldest edits are forgotten first.
+class EditHistory {
+private:
+  std::deque<ClipEdit> undoStack; // Oldest at the front
+  std::vector<ClipEdit> redoStack;
+  size_t maxBytes;
+
+  // A drag, or anything else made of many small steps, is one entry while it's open
+  bool groupOpen = false;
+  uint32_t groupClip = 0;
+
+public:
+  EditHistory(size_t maxBytes = 1 << 20);
+
+  // A new edit drops everything that could be redone. With merge set, an edit of the same
+  // clip as the open group's folds into it: the group keeps its before and takes the new after.
+  void record(const ClipEdit& edit, bool merge = false);
+  void closeGroup();
+
+  // The edit to apply, or false if there is none
+  bool undo(ClipEdit& edit);
+  bool redo(ClipEdit& edit);
+
+  bool canUndo() const;
+  bool canRedo() const;
+  void clear();
+  size_t getMemoryBytes() const;
+};
+
+#endif // EDITHISTORY_HPP
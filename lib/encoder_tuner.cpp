@@ -0,0 +1,158 @@
+#include "encoder_tuner.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+  // Fraction of the frame interval the encoder may use before we step down
+  constexpr double PRESSURE_RATIO = 0.9;
+
+  // Fraction of the frame interval below which we consider stepping back up
+  constexpr double HEADROOM_RATIO = 0.5;
+
+  // Consecutive calm windows required before stepping up (hysteresis)
+  constexpr int HEADROOM_WINDOWS = 5;
+
+  // Windows to wait after a change so the averages reflect the new settings
+  constexpr int COOLDOWN_WINDOWS = 2;
+
+  constexpr double EMA_WEIGHT = 0.1;
+
+  const char* PRESETS[] = { "ultrafast", "superfast", "veryfast", "faster", "fast", "medium" };
+  constexpr int PRESET_COUNT = sizeof(PRESETS) / sizeof(PRESETS[0]);
+}
+
+EncoderTuner::EncoderTuner() {
+  this->reset(this->frameRate, this->latencyBudget, true);
+}
+
+void EncoderTuner::reset(int frameRate, double latencyBudget, bool liveCrf) {
+  // Without a live crf change the only lever left is the frame rate
+  if (liveCrf) {
+    this->levels = {
+      { 0, 1 },
+      { 3, 1 },
+      { 6, 1 },
+      { 6, 2 },
+      { 8, 3 },
+    };
+  } else {
+    this->levels = {
+      { 0, 1 },
+      { 0, 2 },
+      { 0, 3 },
+    };
+  }
+  this->frameRate = std::max(1, frameRate);
+  this->latencyBudget = latencyBudget;
+  this->level = 0;
+  this->averageEncodeTime = 0.0;
+  this->maxQueueDepth = 0;
+  this->framesInWindow = 0;
+  this->cooldownWindows = 0;
+  this->headroomWindows = 0;
+  this->windowsAtLevel.assign(this->levels.size(), 0);
+  this->calmWindows = 0;
+}
+
+double EncoderTuner::frameInterval() {
+  return (double)this->levels[this->level].fpsDivisor / this->frameRate;
+}
+
+TunerDecision EncoderTuner::observe(size_t queueDepth, double encodeSeconds) {
+  TunerDecision decision;
+
+  this->averageEncodeTime = this->averageEncodeTime == 0.0 ? encodeSeconds :
+    this->averageEncodeTime + EMA_WEIGHT * (encodeSeconds - this->averageEncodeTime);
+  this->maxQueueDepth = std::max(this->maxQueueDepth, queueDepth);
+
+  // Evaluate roughly once per second of encoded video
+  int windowFrames = std::max(1, this->frameRate / this->levels[this->level].fpsDivisor);
+  if (++this->framesInWindow < windowFrames) {
+    decision.level = this->level;
+    decision.settings = this->levels[this->level];
+    return decision;
+  }
+
+  double interval = this->frameInterval();
+  double queuedLatency = this->maxQueueDepth * this->averageEncodeTime;
+  char reason[160];
+  int previousLevel = this->level;
+
+  this->windowsAtLevel[this->level]++;
+  if (this->level == 0 && this->averageEncodeTime < interval * HEADROOM_RATIO)
+    this->calmWindows++;
+
+  if (this->cooldownWindows > 0) {
+    this->cooldownWindows--;
+  } else if (this->averageEncodeTime > interval * PRESSURE_RATIO || queuedLatency > this->latencyBudget) {
+    this->headroomWindows = 0;
+    if (this->level + 1 < (int)this->levels.size()) {
+      this->level++;
+      if (queuedLatency > this->latencyBudget) {
+        snprintf(reason, sizeof(reason), "queued latency %.0fms over %.0fms budget (queue %zu)",
+                 queuedLatency * 1000.0, this->latencyBudget * 1000.0, this->maxQueueDepth);
+      } else {
+        snprintf(reason, sizeof(reason), "encode %.1fms over %.0f%% of %.1fms frame interval",
+                 this->averageEncodeTime * 1000.0, PRESSURE_RATIO * 100.0, interval * 1000.0);
+      }
+    }
+  } else if (this->averageEncodeTime < interval * HEADROOM_RATIO && this->maxQueueDepth <= 1) {
+    if (++this->headroomWindows >= HEADROOM_WINDOWS && this->level > 0) {
+      this->level--;
+      this->headroomWindows = 0;
+      snprintf(reason, sizeof(reason), "encode %.1fms under %.0f%% of %.1fms frame interval for %d windows",
+               this->averageEncodeTime * 1000.0, HEADROOM_RATIO * 100.0, interval * 1000.0, HEADROOM_WINDOWS);
+    }
+  } else {
+    this->headroomWindows = 0;
+  }
+
+  this->framesInWindow = 0;
+  this->maxQueueDepth = 0;
+
+  decision.level = this->level;
+  decision.settings = this->levels[this->level];
+
+  if (this->level != previousLevel) {
+    this->cooldownWindows = COOLDOWN_WINDOWS;
+    decision.changed = true;
+    decision.reason = reason;
+  }
+
+  return decision;
+}
+
+TunerLevel EncoderTuner::getSettings() {
+  return this->levels[this->level];
+}
+
+int EncoderTuner::getLevel() {
+  return this->level;
+}
+
+std::string EncoderTuner::suggestPreset(const std::string& currentPreset) {
+  int total = 0;
+  int constrained = 0;
+  for (size_t i = 0; i < this->windowsAtLevel.size(); i++) {
+    total += this->windowsAtLevel[i];
+    if (i >= 2)
+      constrained += this->windowsAtLevel[i];
+  }
+
+  int index = -1;
+  for (int i = 0; i < PRESET_COUNT; i++) {
+    if (currentPreset == PRESETS[i])
+      index = i;
+  }
+
+  if (total == 0 || index == -1)
+    return currentPreset;
+
+  // Mostly throttled: go faster. Always had headroom at the top level: try a slower, better preset.
+  if (constrained * 2 > total && index > 0)
+    return PRESETS[index - 1];
+  if (this->calmWindows == total && index + 1 < PRESET_COUNT)
+    return PRESETS[index + 1];
+
+  return currentPreset;
+}
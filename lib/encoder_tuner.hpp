@@ -0,0 +1,54 @@
+#ifndef ENCODERTUNER_HPP
+#define ENCODERTUNER_HPP
+
+#include <string>
+#include <vector>
+
+// One step on the quality/cost ladder. Level 0 is the most expensive.
+struct TunerLevel {
+  int crfOffset;  // Added to the configured crf
+  int fpsDivisor; // Encode every Nth captured frame
+};
+
+struct TunerDecision {
+  bool changed = false;
+  int level = 0;
+  TunerLevel settings = { 0, 1 };
+  std::string reason;
+};
+
+// Watches encode time and queue depth and steps the encoder settings up or down
+// so capture-to-mux latency stays inside a budget.
+class EncoderTuner {
+private:
+  std::vector<TunerLevel> levels;
+  int level = 0;
+  int frameRate = 60;
+  double latencyBudget = 0.25;
+
+  // Exponential moving average of encode time per frame
+  double averageEncodeTime = 0.0;
+  size_t maxQueueDepth = 0;
+  int framesInWindow = 0;
+  int cooldownWindows = 0;
+  int headroomWindows = 0;
+
+  // Time spent per level, used to suggest a preset for the next recording
+  std::vector<int> windowsAtLevel;
+  int calmWindows = 0;
+
+  double frameInterval();
+
+public:
+  EncoderTuner();
+  // liveCrf: the open encoder takes a crf change between frames (libx264 does, libx265 and mpeg4 don't)
+  void reset(int frameRate, double latencyBudget, bool liveCrf);
+  TunerDecision observe(size_t queueDepth, double encodeSeconds);
+  TunerLevel getSettings();
+  int getLevel();
+
+  // libx264 can't change preset on an open encoder, so presets are stepped between recordings
+  std::string suggestPreset(const std::string& currentPreset);
+};
+
+#endif // ENCODERTUNER_HPP
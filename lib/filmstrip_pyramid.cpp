@@ -0,0 +1,448 @@
+#include "filmstrip_pyramid.hpp"
+#include "source_identity.hpp"
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+  const char sidecarMagic[4] = { 'R', 'W', 'F', 'S' };
+  const uint32_t sidecarVersion = 2;
+  const uint32_t recordMagic = 0x454c4954; // "TILE"
+
+  struct SidecarHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t tileWidth;
+    uint32_t tileHeight;
+    SourceIdentity source; // Recording the sidecar was built from
+  };
+
+  struct RecordHeader {
+    uint32_t magic;
+    uint32_t level;
+    int64_t slot;
+  };
+}
+
+FilmstripPyramid::FilmstripPyramid() {
+
+}
+
+FilmstripPyramid::~FilmstripPyramid() {
+  this->close();
+}
+
+uint64_t FilmstripPyramid::makeKey(int level, int64_t slot) {
+  return ((uint64_t)level << 56) | ((uint64_t)slot & ((1ULL << 56) - 1));
+}
+
+int FilmstripPyramid::keyLevel(uint64_t key) {
+  return (int)(key >> 56);
+}
+
+int64_t FilmstripPyramid::keySlot(uint64_t key) {
+  return (int64_t)(key & ((1ULL << 56) - 1));
+}
+
+bool FilmstripPyramid::open(const std::string& fileName) {
+  this->close();
+  if (!this->decoder.open(fileName, this->tileWidth)) {
+    return false;
+  }
+
+  this->sourcePath = fileName;
+  this->sidecarPath = fileName + ".filmstrip";
+  if (!this->openSidecar())
+    std::cout << "Filmstrip: not persisting tiles to " << this->sidecarPath << std::endl;
+  return this->start(true);
+}
+
+bool FilmstripPyramid::open(std::shared_ptr<MemoryStream> stream) {
+  this->close();
+  return this->start(this->decoder.open(stream, this->tileWidth));
+}
+
+bool FilmstripPyramid::start(bool opened) {
+  if (!opened) {
+    return false;
+  }
+
+  this->running = true;
+  this->worker = std::thread(&FilmstripPyramid::workLoop, this);
+  return true;
+}
+
+void FilmstripPyramid::close() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->running = false;
+  }
+  this->condition.notify_all();
+  if (this->worker.joinable())
+    this->worker.join();
+
+  this->decoder.close();
+  if (this->sidecarFd >= 0) {
+    ::close(this->sidecarFd);
+    this->sidecarFd = -1;
+  }
+  this->sidecarOffsets.clear();
+  this->sidecarPath.clear();
+  this->sourcePath.clear();
+  sws_freeContext(this->packContext);
+  sws_freeContext(this->unpackContext);
+  this->packContext = nullptr;
+  this->unpackContext = nullptr;
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (Level& level : this->levels) {
+    level.tiles.clear();
+    level.lru.clear();
+    level.backgroundNext = 0;
+  }
+  this->wanted.clear();
+  this->wantedKeys.clear();
+  this->index = nullptr;
+  this->stats = FilmstripStats();
+}
+
+bool FilmstripPyramid::openSidecar() {
+  this->sidecarFd = ::open(this->sidecarPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (this->sidecarFd < 0) {
+    return false;
+  }
+
+  int width = this->decoder.getWidth();
+  int height = this->decoder.getHeight();
+  this->recordSize = sizeof(RecordHeader) + (size_t)width * height * 3 / 2;
+
+  // Start over if the file is from another tile size or format, or from a replaced recording
+  SidecarHeader header;
+  bool valid = pread(this->sidecarFd, &header, sizeof(header), 0) == sizeof(header)
+    && memcmp(header.magic, sidecarMagic, sizeof(sidecarMagic)) == 0 && header.version == sidecarVersion
+    && header.tileWidth == (uint32_t)width && header.tileHeight == (uint32_t)height
+    && isSameSource(header.source, this->sourcePath);
+
+  if (!valid) {
+    header = SidecarHeader();
+    if (!readSourceIdentity(this->sourcePath, &header.source)) {
+      ::close(this->sidecarFd);
+      this->sidecarFd = -1;
+      return false;
+    }
+    memcpy(header.magic, sidecarMagic, sizeof(sidecarMagic));
+    header.version = sidecarVersion;
+    header.tileWidth = width;
+    header.tileHeight = height;
+    if (ftruncate(this->sidecarFd, 0) < 0 || pwrite(this->sidecarFd, &header, sizeof(header), 0) != sizeof(header)) {
+      ::close(this->sidecarFd);
+      this->sidecarFd = -1;
+      return false;
+    }
+    return true;
+  }
+
+  // Index the records, a torn record at the end (crash mid-append) is cut off
+  struct stat st;
+  fstat(this->sidecarFd, &st);
+  int64_t offset = sizeof(SidecarHeader);
+  RecordHeader record;
+  while (offset + (int64_t)this->recordSize <= st.st_size) {
+    if (pread(this->sidecarFd, &record, sizeof(record), offset) != sizeof(record) || record.magic != recordMagic) {
+      break;
+    }
+    this->sidecarOffsets[makeKey(record.level, record.slot)] = offset;
+    offset += this->recordSize;
+  }
+  if (offset < st.st_size && ftruncate(this->sidecarFd, offset) < 0) {
+    std::cout << "Filmstrip: could not trim " << this->sidecarPath << std::endl;
+  }
+
+  this->stats.sidecarTiles = this->sidecarOffsets.size();
+  return true;
+}
+
+bool FilmstripPyramid::loadTile(uint64_t key, Thumbnail* tile) {
+  auto found = this->sidecarOffsets.find(key);
+  if (found == this->sidecarOffsets.end()) {
+    return false;
+  }
+
+  int width = this->decoder.getWidth();
+  int height = this->decoder.getHeight();
+  std::vector<uint8_t> record(this->recordSize);
+  if (pread(this->sidecarFd, record.data(), record.size(), found->second) != (ssize_t)record.size()) {
+    return false;
+  }
+
+  this->unpackContext = sws_getCachedContext(this->unpackContext, width, height, AV_PIX_FMT_YUV420P,
+    width, height, AV_PIX_FMT_RGBA, SWS_POINT, NULL, NULL, NULL);
+  if (!this->unpackContext) {
+    return false;
+  }
+
+  uint8_t* y = record.data() + sizeof(RecordHeader);
+  const uint8_t* src[3] = { y, y + width * height, y + width * height * 5 / 4 };
+  int srcStride[3] = { width, width / 2, width / 2 };
+  tile->width = width;
+  tile->height = height;
+  tile->pixels.resize((size_t)width * height * 4);
+  uint8_t* dst[1] = { tile->pixels.data() };
+  int dstStride[1] = { width * 4 };
+  sws_scale(this->unpackContext, src, srcStride, 0, height, dst, dstStride);
+  return true;
+}
+
+void FilmstripPyramid::storeTile(uint64_t key, const Thumbnail& tile) {
+  if (this->sidecarFd < 0 || this->sidecarOffsets.count(key)) {
+    return;
+  }
+
+  this->packContext = sws_getCachedContext(this->packContext, tile.width, tile.height, AV_PIX_FMT_RGBA,
+    tile.width, tile.height, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+  if (!this->packContext) {
+    return;
+  }
+
+  std::vector<uint8_t> record(this->recordSize);
+  RecordHeader header = { recordMagic, (uint32_t)keyLevel(key), keySlot(key) };
+  memcpy(record.data(), &header, sizeof(header));
+
+  uint8_t* y = record.data() + sizeof(RecordHeader);
+  uint8_t* dst[3] = { y, y + tile.width * tile.height, y + tile.width * tile.height * 5 / 4 };
+  int dstStride[3] = { tile.width, tile.width / 2, tile.width / 2 };
+  const uint8_t* src[1] = { tile.pixels.data() };
+  int srcStride[1] = { tile.width * 4 };
+  sws_scale(this->packContext, src, srcStride, 0, tile.height, dst, dstStride);
+
+  // Append only, the offset is known before the write lands
+  off_t offset = lseek(this->sidecarFd, 0, SEEK_END);
+  if (offset < 0 || pwrite(this->sidecarFd, record.data(), record.size(), offset) != (ssize_t)record.size()) {
+    return;
+  }
+  this->sidecarOffsets[key] = offset;
+}
+
+int64_t FilmstripPyramid::slotCount(int level, const TimelineIndex& snapshot) {
+  if (snapshot.empty()) {
+    return 0;
+  }
+  if (this->levelIntervals[level] <= 0.0) {
+    return (int64_t)snapshot.getFrameCount();
+  }
+  return (int64_t)(snapshot.getDuration() / this->levelIntervals[level]) + 1;
+}
+
+void FilmstripPyramid::workLoop() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  while (this->running) {
+    uint64_t key;
+    bool found = false;
+
+    if (!this->wanted.empty()) {
+      key = this->wanted.front();
+      this->wanted.pop_front();
+      this->wantedKeys.erase(key);
+      found = true;
+    } else if (this->index) {
+      // Idle, fill in the coarse levels from the start
+      for (int level = 0; level < this->backgroundLevels && !found; level++) {
+        Level& state = this->levels[level];
+        if (state.backgroundNext < this->slotCount(level, *this->index)) {
+          key = makeKey(level, state.backgroundNext++);
+          found = true;
+        }
+      }
+    }
+
+    if (!found) {
+      this->condition.wait(lock);
+      continue;
+    }
+    if (this->levels[keyLevel(key)].tiles.count(key)) {
+      continue;
+    }
+
+    std::shared_ptr<const TimelineIndex> snapshot = this->index;
+    lock.unlock();
+    std::vector<std::pair<uint64_t, std::shared_ptr<Thumbnail>>> built;
+    this->build(key, snapshot, built);
+    lock.lock();
+
+    for (auto& tile : built)
+      this->insert(tile.first, tile.second);
+  }
+}
+
+void FilmstripPyramid::build(uint64_t key, std::shared_ptr<const TimelineIndex> snapshot, std::vector<std::pair<uint64_t, std::shared_ptr<Thumbnail>>>& built) {
+  if (!snapshot || snapshot->empty()) {
+    return;
+  }
+
+  int level = keyLevel(key);
+  int64_t slot = keySlot(key);
+  if (slot >= this->slotCount(level, *snapshot)) {
+    return;
+  }
+
+  // Per-frame tiles decode a short run of the GOP at once, they're never persisted
+  if (this->levelIntervals[level] <= 0.0) {
+    size_t first = (size_t)slot;
+    size_t last = std::min(first + this->framesPerBatch, snapshot->nextKeyframe(first)) - 1;
+    this->decoder.decodeRange(snapshot->ptsForFrame(first), snapshot->ptsForFrame(last), [&](std::shared_ptr<Thumbnail> tile) {
+      tile->keyframe = snapshot->previousKeyframe(first);
+      built.push_back({ makeKey(level, (int64_t)snapshot->frameForPts(tile->pts)), tile });
+      return true;
+    });
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stats.tilesBuilt += built.size();
+    return;
+  }
+
+  auto tile = std::make_shared<Thumbnail>();
+  if (this->loadTile(key, tile.get())) {
+    tile->pts = snapshot->getStartPts() + slot * this->levelIntervals[level];
+    built.push_back({ key, tile });
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stats.tilesLoaded++;
+    return;
+  }
+
+  // First keyframe inside the slot, or the one before it when the GOP is longer than the slot
+  double time = snapshot->getStartPts() + slot * this->levelIntervals[level];
+  size_t frame = snapshot->frameForPts(time);
+  size_t keyframe = snapshot->previousKeyframe(frame);
+  if (snapshot->ptsForFrame(keyframe) < time)
+    keyframe = snapshot->nextKeyframe(frame);
+  if (keyframe >= snapshot->getFrameCount() || snapshot->ptsForFrame(keyframe) >= time + this->levelIntervals[level])
+    keyframe = snapshot->previousKeyframe(frame);
+
+  double pts = snapshot->ptsForFrame(keyframe);
+  std::shared_ptr<Thumbnail> decoded = this->decoder.decodeKeyframe(pts);
+  if (!decoded && this->decoder.reopen())
+    decoded = this->decoder.decodeKeyframe(pts);
+  if (!decoded) {
+    return;
+  }
+
+  // The tail of a growing recording may still get a better keyframe, only persist finished slots
+  decoded->keyframe = keyframe;
+  if (time + this->levelIntervals[level] <= snapshot->getEndPts())
+    this->storeTile(key, *decoded);
+  built.push_back({ key, decoded });
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->stats.tilesBuilt++;
+  this->stats.sidecarTiles = this->sidecarOffsets.size();
+}
+
+void FilmstripPyramid::insert(uint64_t key, std::shared_ptr<const Thumbnail> tile) {
+  Level& level = this->levels[keyLevel(key)];
+  auto existing = level.tiles.find(key);
+  if (existing != level.tiles.end()) {
+    this->stats.residentBytes -= existing->second.tile->pixels.size();
+    level.lru.erase(existing->second.lruPosition);
+    level.tiles.erase(existing);
+  }
+
+  level.lru.push_front(key);
+  level.tiles[key] = { tile, level.lru.begin() };
+  this->stats.residentBytes += tile->pixels.size();
+
+  while (level.tiles.size() > this->tilesPerLevel) {
+    auto evicted = level.tiles.find(level.lru.back());
+    this->stats.residentBytes -= evicted->second.tile->pixels.size();
+    level.tiles.erase(evicted);
+    level.lru.pop_back();
+  }
+}
+
+void FilmstripPyramid::setIndex(std::shared_ptr<const TimelineIndex> index) {
+  if (!index) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (index != this->index) {
+    this->index = index;
+    this->condition.notify_one();
+  }
+}
+
+int FilmstripPyramid::getLevelCount() {
+  return LEVEL_COUNT;
+}
+
+double FilmstripPyramid::getLevelInterval(int level) {
+  return this->levelIntervals[level];
+}
+
+int64_t FilmstripPyramid::slotForTime(int level, double time) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (!this->index || this->index->empty()) {
+    return 0;
+  }
+  if (this->levelIntervals[level] <= 0.0) {
+    return (int64_t)this->index->frameForPts(time);
+  }
+  return std::max((int64_t)0, (int64_t)std::floor((time - this->index->getStartPts()) / this->levelIntervals[level]));
+}
+
+double FilmstripPyramid::slotTime(int level, int64_t slot) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (!this->index || this->index->empty()) {
+    return 0.0;
+  }
+  if (this->levelIntervals[level] <= 0.0) {
+    return this->index->ptsForFrame((size_t)slot);
+  }
+  return this->index->getStartPts() + slot * this->levelIntervals[level];
+}
+
+std::shared_ptr<const Thumbnail> FilmstripPyramid::getTile(int level, int64_t slot, bool request) {
+  uint64_t key = makeKey(level, slot);
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  Level& state = this->levels[level];
+  auto resident = state.tiles.find(key);
+  if (resident != state.tiles.end()) {
+    state.lru.splice(state.lru.begin(), state.lru, resident->second.lruPosition);
+    return resident->second.tile;
+  }
+
+  if (request && this->running && !this->wantedKeys.count(key)) {
+    // Newest requests go first, what scrolled out of view long ago is dropped
+    this->wanted.push_front(key);
+    this->wantedKeys.insert(key);
+    if (this->wanted.size() > this->maxWanted) {
+      this->wantedKeys.erase(this->wanted.back());
+      this->wanted.pop_back();
+    }
+    this->condition.notify_one();
+  }
+  return nullptr;
+}
+
+uint64_t FilmstripPyramid::getTileKey(int level, int64_t slot) {
+  return makeKey(level, slot);
+}
+
+int FilmstripPyramid::getTileWidth() {
+  return this->decoder.getWidth();
+}
+
+int FilmstripPyramid::getTileHeight() {
+  return this->decoder.getHeight();
+}
+
+FilmstripStats FilmstripPyramid::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  FilmstripStats current = this->stats;
+  current.residentTiles = 0;
+  for (const Level& level : this->levels)
+    current.residentTiles += level.tiles.size();
+  return current;
+}
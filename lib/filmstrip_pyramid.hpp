@@ -0,0 +1,109 @@
+#ifndef FILMSTRIPPYRAMID_HPP
+#define FILMSTRIPPYRAMID_HPP
+
+#include "thumbnail_decoder.hpp"
+#include "timeline_index.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+struct FilmstripStats {
+  uint64_t tilesBuilt = 0;  // Decoded from the recording
+  uint64_t tilesLoaded = 0; // Read back from the sidecar
+  size_t residentTiles = 0;
+  size_t residentBytes = 0;
+  size_t sidecarTiles = 0;
+};
+
+// Filmstrip thumbnails at fixed intervals (64s, 8s, 1s) plus a per-frame level, for the
+// zoomable timeline. The 64s and 8s levels are built in the background, finer ones only
+// for what the timeline asks for. Interval tiles are appended to a sidecar next to the
+// recording so reopening it doesn't decode again. Each level keeps a bounded LRU in memory.
+class FilmstripPyramid {
+private:
+  static constexpr int LEVEL_COUNT = 4;
+  const double levelIntervals[LEVEL_COUNT] = { 64.0, 8.0, 1.0, 0.0 }; // 0 = one tile per frame
+  const int backgroundLevels = 2;
+  const int tileWidth = 96;
+  const size_t tilesPerLevel = 384;
+  const size_t maxWanted = 256;
+  const size_t framesPerBatch = 16;
+
+  ThumbnailDecoder decoder;
+
+  // Sidecar: header, then fixed size records of a tile key and the tile as YUV420P
+  std::string sidecarPath;
+  std::string sourcePath;
+  int sidecarFd = -1;
+  size_t recordSize = 0;
+  std::unordered_map<uint64_t, int64_t> sidecarOffsets;
+  SwsContext* packContext = nullptr;
+  SwsContext* unpackContext = nullptr;
+  bool openSidecar();
+  bool loadTile(uint64_t key, Thumbnail* tile);
+  void storeTile(uint64_t key, const Thumbnail& tile);
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool running = false;
+  std::shared_ptr<const TimelineIndex> index;
+
+  // Tiles the timeline asked for, newest first
+  std::deque<uint64_t> wanted;
+  std::unordered_set<uint64_t> wantedKeys;
+
+  struct CacheEntry {
+    std::shared_ptr<const Thumbnail> tile;
+    std::list<uint64_t>::iterator lruPosition;
+  };
+  struct Level {
+    std::unordered_map<uint64_t, CacheEntry> tiles;
+    std::list<uint64_t> lru;
+    int64_t backgroundNext = 0;
+  };
+  Level levels[LEVEL_COUNT];
+  FilmstripStats stats;
+
+  static uint64_t makeKey(int level, int64_t slot);
+  static int keyLevel(uint64_t key);
+  static int64_t keySlot(uint64_t key);
+  bool start(bool opened);
+  void workLoop();
+  void build(uint64_t key, std::shared_ptr<const TimelineIndex> snapshot, std::vector<std::pair<uint64_t, std::shared_ptr<Thumbnail>>>& built);
+  void insert(uint64_t key, std::shared_ptr<const Thumbnail> tile);
+  int64_t slotCount(int level, const TimelineIndex& snapshot);
+
+public:
+  FilmstripPyramid();
+  ~FilmstripPyramid();
+
+  // The sidecar is <fileName>.filmstrip, memory streams aren't persisted
+  bool open(const std::string& fileName);
+  bool open(std::shared_ptr<MemoryStream> stream);
+  void close();
+  void setIndex(std::shared_ptr<const TimelineIndex> index);
+
+  // Level 0 is the coarsest, the last level has one tile per frame
+  int getLevelCount();
+  double getLevelInterval(int level);
+  int64_t slotForTime(int level, double time);
+  double slotTime(int level, int64_t slot);
+
+  // Never waits. Returns null and (if request) queues the tile when it isn't resident.
+  std::shared_ptr<const Thumbnail> getTile(int level, int64_t slot, bool request = true);
+  uint64_t getTileKey(int level, int64_t slot);
+
+  int getTileWidth();
+  int getTileHeight();
+  FilmstripStats getStats();
+};
+
+#endif // FILMSTRIPPYRAMID_HPP
@@ -0,0 +1,145 @@
+#include "interval_index.hpp"
+#include <algorithm>
+#include <cmath>
+
+void IntervalIndex::build(const std::vector<TimeSpan>& spans) {
+  this->entries.resize(spans.size());
+  for (size_t i = 0; i < spans.size(); i++)
+    this->entries[i] = { spans[i], (uint32_t)i, spans[i].end };
+
+  // Stable so equal starts keep their list order
+  std::stable_sort(this->entries.begin(), this->entries.end(), [](const Entry& a, const Entry& b) { return a.span.start < b.span.start; });
+  this->buildNode(0, this->entries.size());
+
+  this->positions.resize(this->entries.size());
+  for (size_t i = 0; i < this->entries.size(); i++)
+    this->positions[this->entries[i].id] = (uint32_t)i;
+}
+
+double IntervalIndex::buildNode(size_t begin, size_t end) {
+  if (begin >= end) {
+    return -INFINITY;
+  }
+
+  size_t middle = begin + (end - begin) / 2;
+  Entry& node = this->entries[middle];
+  node.maxEnd = std::max({ node.span.end, this->buildNode(begin, middle), this->buildNode(middle + 1, end) });
+  return node.maxEnd;
+}
+
+double IntervalIndex::subtreeMaxEnd(size_t begin, size_t end) const {
+  return begin < end ? this->entries[begin + (end - begin) / 2].maxEnd : -INFINITY;
+}
+
+bool IntervalIndex::update(uint32_t id, TimeSpan span) {
+  if (id >= this->positions.size()) {
+    return false;
+  }
+
+  size_t position = this->positions[id];
+  if ((position > 0 && this->entries[position - 1].span.start > span.start) ||
+    (position + 1 < this->entries.size() && this->entries[position + 1].span.start < span.start)) {
+    return false;
+  }
+
+  this->entries[position].span = span;
+  this->updateNode(0, this->entries.size(), position);
+  return true;
+}
+
+double IntervalIndex::updateNode(size_t begin, size_t end, size_t position) {
+  // Only the nodes on the path down to position can have a different maxEnd
+  size_t middle = begin + (end - begin) / 2;
+  Entry& node = this->entries[middle];
+  double left = position < middle ? this->updateNode(begin, middle, position) : this->subtreeMaxEnd(begin, middle);
+  double right = position > middle ? this->updateNode(middle + 1, end, position) : this->subtreeMaxEnd(middle + 1, end);
+  node.maxEnd = std::max({ node.span.end, left, right });
+  return node.maxEnd;
+}
+
+void IntervalIndex::clear() {
+  this->entries.clear();
+  this->positions.clear();
+}
+
+size_t IntervalIndex::size() const {
+  return this->entries.size();
+}
+
+void IntervalIndex::query(double start, double end, std::vector<uint32_t>& out) const {
+  out.clear();
+  this->visit(0, this->entries.size(), start, end, [&](const Entry& entry) { out.push_back(entry.id); });
+}
+
+template<typename Visitor>
+void IntervalIndex::visit(size_t begin, size_t end, double start, double stop, const Visitor& visitor) const {
+  // Nothing below ends inside the range
+  if (begin >= end || this->entries[begin + (end - begin) / 2].maxEnd < start) {
+    return;
+  }
+
+  size_t middle = begin + (end - begin) / 2;
+  const Entry& node = this->entries[middle];
+  this->visit(begin, middle, start, stop, visitor);
+
+  // Everything from here on starts after the range
+  if (node.span.start > stop) {
+    return;
+  }
+  if (node.span.end >= start)
+    visitor(node);
+  this->visit(middle + 1, end, start, stop, visitor);
+}
+
+int64_t IntervalIndex::nearestEdge(double time, double maxDistance, bool* isEnd) const {
+  // Any span with an edge within maxDistance touches the window around time
+  int64_t best = -1;
+  double bestDistance = maxDistance;
+  this->visit(0, this->entries.size(), time - maxDistance, time + maxDistance, [&](const Entry& entry) {
+    double startDistance = std::abs(entry.span.start - time);
+    double endDistance = std::abs(entry.span.end - time);
+    if (startDistance <= bestDistance) {
+      best = entry.id;
+      bestDistance = startDistance;
+      if (isEnd)
+        *isEnd = false;
+    }
+    // Ends win ties so a zero length span can still be stretched to the right
+    if (endDistance <= bestDistance) {
+      best = entry.id;
+      bestDistance = endDistance;
+      if (isEnd)
+        *isEnd = true;
+    }
+  });
+  return best;
+}
+
+size_t IntervalIndex::lowerBound(double time) const {
+  return std::lower_bound(this->entries.begin(), this->entries.end(), time,
+    [](const Entry& entry, double t) { return entry.span.start < t; }) - this->entries.begin();
+}
+
+const IntervalIndex::Entry& IntervalIndex::at(size_t position) const {
+  return this->entries[position];
+}
+
+double IntervalIndex::maxEnd(size_t first, size_t last) const {
+  return this->maxEndIn(0, this->entries.size(), first, last);
+}
+
+double IntervalIndex::maxEndIn(size_t begin, size_t end, size_t first, size_t last) const {
+  if (begin >= end || last <= begin || first >= end) {
+    return -INFINITY;
+  }
+  // Subtrees entirely inside the range answer from their root
+  if (first <= begin && end <= last) {
+    return this->subtreeMaxEnd(begin, end);
+  }
+
+  size_t middle = begin + (end - begin) / 2;
+  double result = std::max(this->maxEndIn(begin, middle, first, last), this->maxEndIn(middle + 1, end, first, last));
+  if (middle >= first && middle < last)
+    result = std::max(result, this->entries[middle].span.end);
+  return result;
+}
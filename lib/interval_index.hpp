@@ -0,0 +1,56 @@
+#ifndef INTERVALINDEX_HPP
+#define INTERVALINDEX_HPP
+
+#include "time_span.hpp"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Static interval tree over a list of spans (points are spans with start == end). Entries are
+// sorted by start and the tree is implicit: the middle of every range is its node, with the
+// largest end below it stored alongside, so an overlap query skips whole subtrees that end
+// too early and stops at starts past the range. Rebuild after the spans change, or update()
+// one span in place while it keeps its place in start order.
+class IntervalIndex {
+public:
+  struct Entry {
+    TimeSpan span;
+    uint32_t id;     // Position in the list it was built from
+    double maxEnd;   // Largest end in the subtree this entry is the root of
+  };
+
+private:
+  std::vector<Entry> entries;
+  std::vector<uint32_t> positions; // Where each id ended up in entries
+
+  double buildNode(size_t begin, size_t end);
+  double subtreeMaxEnd(size_t begin, size_t end) const;
+  double updateNode(size_t begin, size_t end, size_t position);
+  double maxEndIn(size_t begin, size_t end, size_t first, size_t last) const;
+  template<typename Visitor>
+  void visit(size_t begin, size_t end, double start, double stop, const Visitor& visitor) const;
+
+public:
+  void build(const std::vector<TimeSpan>& spans);
+  void clear();
+  size_t size() const;
+
+  // Moves one span without a rebuild, O(log n). False if its new start would pass a neighbour's, then rebuild.
+  bool update(uint32_t id, TimeSpan span);
+
+  // Ids of the spans touching [start, end], in start order. Out is cleared first so it can be reused.
+  // A node is only skipped when nothing below it reaches start, so with k results this walks up to
+  // k root-to-leaf paths: O(k log n) at worst, never more than n.
+  void query(double start, double end, std::vector<uint32_t>& out) const;
+
+  // Id of the span with a start or end closest to time within maxDistance, -1 if none. isEnd tells which edge.
+  int64_t nearestEdge(double time, double maxDistance, bool* isEnd) const;
+
+  // Entries in start order, for walks that skip ahead: first one starting at or after time
+  size_t lowerBound(double time) const;
+  const Entry& at(size_t position) const;
+  // Largest end among the entries at positions [first, last), O(log n)
+  double maxEnd(size_t first, size_t last) const;
+};
+
+#endif // INTERVALINDEX_HPP
@@ -0,0 +1,391 @@
+#include "json.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+  // Recursive descent over the text, deep nesting is refused rather than overflowing the stack
+  class Parser {
+  private:
+    static constexpr int MAX_DEPTH = 256;
+
+    std::string_view text;
+    size_t pos = 0;
+    std::string& error;
+
+    void skipSpace() {
+      while (this->pos < this->text.size() && (this->text[this->pos] == ' ' || this->text[this->pos] == '\t' || this->text[this->pos] == '\n' || this->text[this->pos] == '\r'))
+        this->pos++;
+    }
+
+    bool fail(const std::string& message) {
+      if (this->error.empty())
+        this->error = message + " at offset " + std::to_string(this->pos);
+      return false;
+    }
+
+    bool consume(std::string_view word) {
+      if (this->text.substr(this->pos, word.size()) != word) {
+        return false;
+      }
+      this->pos += word.size();
+      return true;
+    }
+
+    bool parseHex(uint32_t& code) {
+      if (this->pos + 4 > this->text.size()) {
+        return this->fail("truncated \\u escape");
+      }
+      code = 0;
+      for (int i = 0; i < 4; i++) {
+        char c = this->text[this->pos++];
+        code <<= 4;
+        if (c >= '0' && c <= '9') {
+          code |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+          code |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+          code |= c - 'A' + 10;
+        } else {
+          return this->fail("bad \\u escape");
+        }
+      }
+      return true;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+      if (code < 0x80) {
+        out += (char)code;
+      } else if (code < 0x800) {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+      } else if (code < 0x10000) {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+      } else {
+        out += (char)(0xF0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3F));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+      }
+    }
+
+    bool parseString(std::string& out) {
+      this->pos++; // Opening quote
+      out.clear();
+      while (this->pos < this->text.size()) {
+        char c = this->text[this->pos++];
+        if (c == '"') {
+          return true;
+        }
+        if ((unsigned char)c < 0x20) {
+          return this->fail("control character in string");
+        }
+        if (c != '\\') {
+          out += c;
+          continue;
+        }
+
+        if (this->pos >= this->text.size()) {
+          break;
+        }
+        char escape = this->text[this->pos++];
+        switch (escape) {
+          case '"': out += '"'; break;
+          case '\\': out += '\\'; break;
+          case '/': out += '/'; break;
+          case 'b': out += '\b'; break;
+          case 'f': out += '\f'; break;
+          case 'n': out += '\n'; break;
+          case 'r': out += '\r'; break;
+          case 't': out += '\t'; break;
+          case 'u': {
+            uint32_t code;
+            if (!this->parseHex(code)) {
+              return false;
+            }
+            // Characters outside the BMP come as a surrogate pair
+            if (code >= 0xD800 && code < 0xDC00 && this->consume("\\u")) {
+              uint32_t low;
+              if (!this->parseHex(low)) {
+                return false;
+              }
+              if (low < 0xDC00 || low >= 0xE000) {
+                return this->fail("unpaired surrogate");
+              }
+              code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            } else if (code >= 0xD800 && code < 0xE000) {
+              return this->fail("unpaired surrogate");
+            }
+            appendUtf8(out, code);
+            break;
+          }
+          default:
+            return this->fail("bad escape");
+        }
+      }
+      return this->fail("unterminated string");
+    }
+
+    bool parseNumber(double& out) {
+      size_t start = this->pos;
+      if (this->pos < this->text.size() && this->text[this->pos] == '-')
+        this->pos++;
+      while (this->pos < this->text.size() && std::string_view("0123456789.eE+-").find(this->text[this->pos]) != std::string_view::npos)
+        this->pos++;
+
+      std::string digits(this->text.substr(start, this->pos - start));
+      char* end = nullptr;
+      out = std::strtod(digits.c_str(), &end);
+      if (digits.empty() || end != digits.c_str() + digits.size()) {
+        this->pos = start;
+        return this->fail("bad number");
+      }
+      return true;
+    }
+
+  public:
+    Parser(std::string_view text, std::string& error) : text(text), error(error) {
+
+    }
+
+    bool parseValue(JsonValue& value, int depth) {
+      if (depth > MAX_DEPTH) {
+        return this->fail("nested too deep");
+      }
+
+      this->skipSpace();
+      if (this->pos >= this->text.size()) {
+        return this->fail("unexpected end");
+      }
+
+      value = JsonValue();
+      char c = this->text[this->pos];
+      if (c == '{') {
+        value.type = JsonValue::Type::Object;
+        this->pos++;
+        this->skipSpace();
+        if (this->consume("}")) {
+          return true;
+        }
+        while (true) {
+          this->skipSpace();
+          if (this->pos >= this->text.size() || this->text[this->pos] != '"') {
+            return this->fail("expected member name");
+          }
+          value.members.emplace_back();
+          if (!this->parseString(value.members.back().first)) {
+            return false;
+          }
+          this->skipSpace();
+          if (!this->consume(":")) {
+            return this->fail("expected ':'");
+          }
+          if (!this->parseValue(value.members.back().second, depth + 1)) {
+            return false;
+          }
+          this->skipSpace();
+          if (this->consume("}")) {
+            return true;
+          }
+          if (!this->consume(",")) {
+            return this->fail("expected ',' or '}'");
+          }
+        }
+      }
+
+      if (c == '[') {
+        value.type = JsonValue::Type::Array;
+        this->pos++;
+        this->skipSpace();
+        if (this->consume("]")) {
+          return true;
+        }
+        while (true) {
+          value.items.emplace_back();
+          if (!this->parseValue(value.items.back(), depth + 1)) {
+            return false;
+          }
+          this->skipSpace();
+          if (this->consume("]")) {
+            return true;
+          }
+          if (!this->consume(",")) {
+            return this->fail("expected ',' or ']'");
+          }
+        }
+      }
+
+      if (c == '"') {
+        value.type = JsonValue::Type::String;
+        return this->parseString(value.string);
+      }
+      if (this->consume("true")) {
+        value.type = JsonValue::Type::Bool;
+        value.boolean = true;
+        return true;
+      }
+      if (this->consume("false")) {
+        value.type = JsonValue::Type::Bool;
+        return true;
+      }
+      if (this->consume("null")) {
+        return true;
+      }
+      value.type = JsonValue::Type::Number;
+      return this->parseNumber(value.number);
+    }
+
+    bool atEnd() {
+      this->skipSpace();
+      return this->pos == this->text.size() || this->fail("trailing characters");
+    }
+  };
+}
+
+bool JsonValue::isObject() const {
+  return this->type == Type::Object;
+}
+
+bool JsonValue::isArray() const {
+  return this->type == Type::Array;
+}
+
+const JsonValue* JsonValue::get(std::string_view name) const {
+  for (const auto& member : this->members) {
+    if (member.first == name) {
+      return &member.second;
+    }
+  }
+  return nullptr;
+}
+
+double JsonValue::getNumber(std::string_view name, double fallback) const {
+  const JsonValue* value = this->get(name);
+  return value && value->type == Type::Number ? value->number : fallback;
+}
+
+std::string JsonValue::getString(std::string_view name, const std::string& fallback) const {
+  const JsonValue* value = this->get(name);
+  return value && value->type == Type::String ? value->string : fallback;
+}
+
+bool JsonValue::getBool(std::string_view name, bool fallback) const {
+  const JsonValue* value = this->get(name);
+  return value && value->type == Type::Bool ? value->boolean : fallback;
+}
+
+bool parseJson(std::string_view text, JsonValue& value, std::string& error) {
+  error.clear();
+  Parser parser(text, error);
+  return parser.parseValue(value, 0) && parser.atEnd();
+}
+
+void JsonWriter::separate() {
+  if (this->afterKey) {
+    this->afterKey = false;
+    return;
+  }
+  if (!this->empty.empty()) {
+    if (!this->empty.back())
+      this->text += ',';
+    this->empty.back() = false;
+  }
+}
+
+JsonWriter& JsonWriter::beginObject() {
+  this->separate();
+  this->text += '{';
+  this->empty.push_back(true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+  this->text += '}';
+  this->empty.pop_back();
+  return *this;
+}
+
+JsonWriter& JsonWriter::beginArray() {
+  this->separate();
+  this->text += '[';
+  this->empty.push_back(true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+  this->text += ']';
+  this->empty.pop_back();
+  return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+  this->string(name);
+  this->text += ':';
+  this->afterKey = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::number(double value) {
+  if (!std::isfinite(value)) {
+    return this->null();
+  }
+  this->separate();
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.10g", value);
+  this->text += buffer;
+  return *this;
+}
+
+JsonWriter& JsonWriter::integer(int64_t value) {
+  this->separate();
+  this->text += std::to_string(value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::boolean(bool value) {
+  this->separate();
+  this->text += value ? "true" : "false";
+  return *this;
+}
+
+JsonWriter& JsonWriter::string(std::string_view value) {
+  this->separate();
+  this->text += '"';
+  for (char c : value) {
+    switch (c) {
+      case '"': this->text += "\\\""; break;
+      case '\\': this->text += "\\\\"; break;
+      case '\n': this->text += "\\n"; break;
+      case '\r': this->text += "\\r"; break;
+      case '\t': this->text += "\\t"; break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char buffer[8];
+          snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+          this->text += buffer;
+        } else {
+          this->text += c;
+        }
+    }
+  }
+  this->text += '"';
+  return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+  this->separate();
+  this->text += "null";
+  return *this;
+}
+
+const std::string& JsonWriter::str() const {
+  return this->text;
+}
+
+void JsonWriter::clear() {
+  this->text.clear();
+  this->empty.clear();
+  this->afterKey = false;
+}
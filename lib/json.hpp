@@ -0,0 +1,69 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Parsed JSON document, enough for job files and settings. Members keep their file order.
+struct JsonValue {
+  enum class Type {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object
+  };
+
+  Type type = Type::Null;
+  bool boolean = false;
+  double number = 0.0;
+  std::string string;
+  std::vector<JsonValue> items;
+  std::vector<std::pair<std::string, JsonValue>> members;
+
+  bool isObject() const;
+  bool isArray() const;
+
+  // Member by name, null if missing or this isn't an object
+  const JsonValue* get(std::string_view name) const;
+  double getNumber(std::string_view name, double fallback) const;
+  std::string getString(std::string_view name, const std::string& fallback) const;
+  bool getBool(std::string_view name, bool fallback) const;
+};
+
+// Whole text has to be one value, error says what went wrong where
+bool parseJson(std::string_view text, JsonValue& value, std::string& error);
+
+// Builds compact JSON text, one value after another. Keys go right before their value:
+// writer.beginObject().key("frames").integer(10).endObject();
+class JsonWriter {
+private:
+  std::string text;
+  std::vector<bool> empty; // Per open container, whether nothing has been written into it
+  bool afterKey = false;
+
+  void separate();
+
+public:
+  JsonWriter& beginObject();
+  JsonWriter& endObject();
+  JsonWriter& beginArray();
+  JsonWriter& endArray();
+  JsonWriter& key(std::string_view name);
+
+  // Non-finite numbers are written as null
+  JsonWriter& number(double value);
+  JsonWriter& integer(int64_t value);
+  JsonWriter& boolean(bool value);
+  JsonWriter& string(std::string_view value);
+  JsonWriter& null();
+
+  const std::string& str() const;
+  void clear();
+};
+
+#endif // JSON_HPP
@@ -0,0 +1,391 @@
+#include "loudness_analyzer.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+  // Mean square to LUFS as in BS.1770
+  float toLoudness(double meanSquare) {
+    return -0.691f + 10.0f * (float)std::log10(std::max(meanSquare, 1e-12));
+  }
+
+  // Both K-weighting biquads (transposed direct form II) over up to four interleaved
+  // channels at once, one per lane. Adds each lane's sum of squares to energy.
+#if defined(__SSE2__)
+  void kWeight(const float* samples, size_t count, int stride, int lanes, const float* s1, const float* s2, float state[4][4], double* energy) {
+    __m128 b10 = _mm_set1_ps(s1[0]), b11 = _mm_set1_ps(s1[1]), b12 = _mm_set1_ps(s1[2]);
+    __m128 a11 = _mm_set1_ps(s1[3]), a12 = _mm_set1_ps(s1[4]);
+    __m128 b20 = _mm_set1_ps(s2[0]), b21 = _mm_set1_ps(s2[1]), b22 = _mm_set1_ps(s2[2]);
+    __m128 a21 = _mm_set1_ps(s2[3]), a22 = _mm_set1_ps(s2[4]);
+    __m128 z11 = _mm_loadu_ps(state[0]);
+    __m128 z12 = _mm_loadu_ps(state[1]);
+    __m128 z21 = _mm_loadu_ps(state[2]);
+    __m128 z22 = _mm_loadu_ps(state[3]);
+    __m128 sum = _mm_setzero_ps();
+
+    float in[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < count; i++) {
+      const float* frame = samples + i * stride;
+      for (int lane = 0; lane < lanes; lane++)
+        in[lane] = frame[lane];
+      __m128 x = _mm_loadu_ps(in);
+
+      __m128 y = _mm_add_ps(_mm_mul_ps(b10, x), z11);
+      z11 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b11, x), _mm_mul_ps(a11, y)), z12);
+      z12 = _mm_sub_ps(_mm_mul_ps(b12, x), _mm_mul_ps(a12, y));
+
+      __m128 w = _mm_add_ps(_mm_mul_ps(b20, y), z21);
+      z21 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b21, y), _mm_mul_ps(a21, w)), z22);
+      z22 = _mm_sub_ps(_mm_mul_ps(b22, y), _mm_mul_ps(a22, w));
+
+      sum = _mm_add_ps(sum, _mm_mul_ps(w, w));
+    }
+
+    _mm_storeu_ps(state[0], z11);
+    _mm_storeu_ps(state[1], z12);
+    _mm_storeu_ps(state[2], z21);
+    _mm_storeu_ps(state[3], z22);
+    float sums[4];
+    _mm_storeu_ps(sums, sum);
+    for (int lane = 0; lane < lanes; lane++)
+      energy[lane] += sums[lane];
+  }
+#else
+  void kWeight(const float* samples, size_t count, int stride, int lanes, const float* s1, const float* s2, float state[4][4], double* energy) {
+    for (int lane = 0; lane < lanes; lane++) {
+      float z11 = state[0][lane], z12 = state[1][lane], z21 = state[2][lane], z22 = state[3][lane];
+      float sum = 0.0f;
+      for (size_t i = 0; i < count; i++) {
+        float x = samples[i * stride + lane];
+        float y = s1[0] * x + z11;
+        z11 = s1[1] * x - s1[3] * y + z12;
+        z12 = s1[2] * x - s1[4] * y;
+        float w = s2[0] * y + z21;
+        z21 = s2[1] * y - s2[3] * w + z22;
+        z22 = s2[2] * y - s2[4] * w;
+        sum += w * w;
+      }
+      state[0][lane] = z11;
+      state[1][lane] = z12;
+      state[2][lane] = z21;
+      state[3][lane] = z22;
+      energy[lane] += sum;
+    }
+  }
+#endif
+}
+
+LoudnessAnalyzer::LoudnessAnalyzer() {
+
+}
+
+LoudnessAnalyzer::~LoudnessAnalyzer() {
+  this->close();
+}
+
+bool LoudnessAnalyzer::open(const std::string& fileName) {
+  this->close();
+  bool opened = this->decoder.open(fileName);
+  if (opened && this->decoder.getChannels() > MAX_CHANNELS)
+    opened = this->decoder.open(fileName, 2);
+  return this->start(opened);
+}
+
+bool LoudnessAnalyzer::open(std::shared_ptr<MemoryStream> stream) {
+  this->close();
+  bool opened = this->decoder.open(stream);
+  if (opened && this->decoder.getChannels() > MAX_CHANNELS)
+    opened = this->decoder.open(stream, 2);
+  return this->start(opened);
+}
+
+bool LoudnessAnalyzer::start(bool opened) {
+  if (!opened) {
+    return false;
+  }
+
+  this->setupMeter();
+  this->running = true;
+  this->worker = std::thread(&LoudnessAnalyzer::workLoop, this);
+  return true;
+}
+
+void LoudnessAnalyzer::setupMeter() {
+  this->channels = this->decoder.getChannels();
+  this->sampleRate = this->decoder.getSampleRate();
+  this->blockSize = std::max(1, this->sampleRate / 10);
+
+  // K-weighting for any rate, from the BS.1770 analog prototypes (same as libebur128)
+  double K = std::tan(M_PI * 1681.974450955533 / this->sampleRate);
+  double Q = 0.7071752369554196;
+  double Vh = std::pow(10.0, 3.999843853973347 / 20.0);
+  double Vb = std::pow(Vh, 0.4996667741545416);
+  double a0 = 1.0 + K / Q + K * K;
+  this->stage1[0] = (float)((Vh + Vb * K / Q + K * K) / a0);
+  this->stage1[1] = (float)(2.0 * (K * K - Vh) / a0);
+  this->stage1[2] = (float)((Vh - Vb * K / Q + K * K) / a0);
+  this->stage1[3] = (float)(2.0 * (K * K - 1.0) / a0);
+  this->stage1[4] = (float)((1.0 - K / Q + K * K) / a0);
+
+  K = std::tan(M_PI * 38.13547087602444 / this->sampleRate);
+  Q = 0.5003270373238773;
+  a0 = 1.0 + K / Q + K * K;
+  this->stage2[0] = 1.0f;
+  this->stage2[1] = -2.0f;
+  this->stage2[2] = 1.0f;
+  this->stage2[3] = (float)(2.0 * (K * K - 1.0) / a0);
+  this->stage2[4] = (float)((1.0 - K / Q + K * K) / a0);
+
+  // Surrounds count a bit more, LFE not at all
+  for (int channel = 0; channel < this->channels; channel++) {
+    AVChannel position = this->decoder.getChannel(channel);
+    if (position == AV_CHAN_LOW_FREQUENCY || position == AV_CHAN_LOW_FREQUENCY_2) {
+      this->weights[channel] = 0.0f;
+    } else if (position == AV_CHAN_SIDE_LEFT || position == AV_CHAN_SIDE_RIGHT || position == AV_CHAN_BACK_LEFT || position == AV_CHAN_BACK_RIGHT) {
+      this->weights[channel] = 1.41f;
+    } else {
+      this->weights[channel] = 1.0f;
+    }
+  }
+
+  memset(this->filterState, 0, sizeof(this->filterState));
+  memset(this->energy, 0, sizeof(this->energy));
+  memset(this->window, 0, sizeof(this->window));
+  memset(this->histogram, 0, sizeof(this->histogram));
+  this->histogramCount = 0;
+  this->blockFill = 0;
+  this->blocks = 0;
+  this->inPeak = false;
+  this->lastPeak = -1e9;
+  this->silenceStart = -1.0;
+}
+
+void LoudnessAnalyzer::close() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->running = false;
+  }
+  this->condition.notify_all();
+  if (this->worker.joinable())
+    this->worker.join();
+
+  this->decoder.close();
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->atEnd = false;
+  this->endFrameCount = 0;
+  this->index = nullptr;
+  this->bookmarks.clear();
+  this->silentSpans.clear();
+  this->version++;
+  this->stats = LoudnessStats();
+}
+
+void LoudnessAnalyzer::workLoop() {
+#if defined(__SSE2__)
+  // Flush denormals, the filters decay into them over silence and crawl
+  _mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+  double busySeconds = 0.0;
+  std::vector<float> samples;
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  while (this->running) {
+    if (this->atEnd) {
+      // Caught up, pick up again once the recording has grown
+      if (!this->index || this->index->getFrameCount() <= this->endFrameCount) {
+        this->condition.wait(lock);
+        continue;
+      }
+      this->atEnd = false;
+      lock.unlock();
+      bool reopened = this->decoder.reopen();
+      lock.lock();
+      if (!reopened) {
+        this->atEnd = true;
+        this->endFrameCount = this->index->getFrameCount();
+        continue;
+      }
+    }
+    lock.unlock();
+
+    auto readStart = std::chrono::steady_clock::now();
+    bool decoded = this->decoder.read(samples);
+
+    lock.lock();
+    if (!decoded) {
+      this->atEnd = true;
+      this->endFrameCount = this->index ? this->index->getFrameCount() : 0;
+      this->version++; // The open silent span reaches the end now
+      continue;
+    }
+    this->process(samples.data(), samples.size() / this->channels);
+    busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count();
+    if (busySeconds > 0.0)
+      this->stats.speed = this->stats.analyzedSeconds / busySeconds;
+  }
+}
+
+void LoudnessAnalyzer::process(const float* samples, size_t frames) {
+  size_t done = 0;
+  while (done < frames) {
+    size_t count = std::min(frames - done, (size_t)(this->blockSize - this->blockFill));
+    for (int group = 0; group * 4 < this->channels; group++) {
+      int lanes = std::min(4, this->channels - group * 4);
+      kWeight(samples + done * this->channels + group * 4, count, this->channels, lanes, this->stage1, this->stage2,
+        this->filterState[group], this->energy + group * 4);
+    }
+
+    done += count;
+    this->blockFill += count;
+    if (this->blockFill == this->blockSize)
+      this->finishBlock();
+  }
+}
+
+float LoudnessAnalyzer::momentaryLoudness(int blocksBack) {
+  double sum = 0.0;
+  for (int block = 0; block < MOMENTARY_BLOCKS; block++)
+    sum += this->window[(this->blocks - 1 - blocksBack - block) % WINDOW_BLOCKS];
+  return toLoudness(sum / MOMENTARY_BLOCKS);
+}
+
+void LoudnessAnalyzer::finishBlock() {
+  double blockEnergy = 0.0;
+  for (int channel = 0; channel < this->channels; channel++) {
+    blockEnergy += this->weights[channel] * this->energy[channel];
+    this->energy[channel] = 0.0;
+  }
+  this->window[this->blocks % WINDOW_BLOCKS] = blockEnergy / this->blockSize;
+  this->blocks++;
+  this->blockFill = 0;
+  double time = (double)this->blocks * this->blockSize / this->sampleRate;
+  this->stats.analyzedSeconds = time;
+
+  // Silence goes by single blocks, the windows would smear its edges
+  double blockStart = time - (double)this->blockSize / this->sampleRate;
+  if (toLoudness(blockEnergy / this->blockSize) < this->silenceLoudness) {
+    if (this->silenceStart < 0.0)
+      this->silenceStart = blockStart;
+  } else if (this->silenceStart >= 0.0) {
+    if (blockStart - this->silenceStart >= this->minSilence) {
+      this->silentSpans.push_back({ this->silenceStart, blockStart });
+      this->version++;
+    }
+    this->silenceStart = -1.0;
+  }
+
+  if (this->blocks < WINDOW_BLOCKS) {
+    return;
+  }
+
+  double sum = 0.0;
+  for (int block = 0; block < WINDOW_BLOCKS; block++)
+    sum += this->window[block];
+  float shortTerm = toLoudness(sum / WINDOW_BLOCKS);
+
+  // Median of everything above the absolute gate so far
+  if (shortTerm > this->histogramFloor) {
+    int bin = std::min((int)((shortTerm - this->histogramFloor) / this->histogramStep), HISTOGRAM_BINS - 1);
+    this->histogram[bin]++;
+    this->histogramCount++;
+  }
+  float median = this->histogramFloor;
+  uint64_t seen = 0;
+  for (int bin = 0; bin < HISTOGRAM_BINS && this->histogramCount > 0; bin++) {
+    seen += this->histogram[bin];
+    if (seen * 2 >= this->histogramCount) {
+      median = this->histogramFloor + (bin + 0.5f) * this->histogramStep;
+      break;
+    }
+  }
+  float threshold = std::max(median + this->peakMargin, this->quietestPeak);
+
+  this->stats.shortTerm = shortTerm;
+  this->stats.median = median;
+  this->stats.threshold = threshold;
+  if (time < this->minHistory) {
+    return;
+  }
+
+  // The short-term window lags, so the loudest 400 ms is looked for across the whole
+  // window when a peak starts and followed from there
+  if (!this->inPeak && shortTerm > threshold) {
+    this->inPeak = true;
+    this->peakScore = 0.0f;
+    this->peakMomentary = -INFINITY;
+    for (int back = 0; back + MOMENTARY_BLOCKS <= WINDOW_BLOCKS; back++) {
+      float momentary = this->momentaryLoudness(back);
+      if (momentary > this->peakMomentary) {
+        this->peakMomentary = momentary;
+        this->peakTime = time - (back + MOMENTARY_BLOCKS * 0.5) * this->blockSize / this->sampleRate;
+      }
+    }
+  }
+  if (!this->inPeak) {
+    return;
+  }
+
+  this->peakScore = std::max(this->peakScore, shortTerm - median);
+  float momentary = this->momentaryLoudness(0);
+  if (momentary > this->peakMomentary) {
+    this->peakMomentary = momentary;
+    this->peakTime = time - MOMENTARY_BLOCKS * 0.5 * this->blockSize / this->sampleRate;
+  }
+
+  if (shortTerm < threshold - this->peakHysteresis) {
+    this->inPeak = false;
+    if (this->peakTime - this->lastPeak >= this->peakSpacing) {
+      this->bookmarks.push_back({ this->peakTime, BookmarkKind::Loudness, this->peakScore });
+      this->version++;
+      this->lastPeak = this->peakTime;
+    }
+  }
+}
+
+void LoudnessAnalyzer::setIndex(std::shared_ptr<const TimelineIndex> index) {
+  if (!index) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (index == this->index) {
+    return;
+  }
+  this->index = index;
+  if (this->atEnd)
+    this->condition.notify_one();
+}
+
+uint64_t LoudnessAnalyzer::getVersion() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->version;
+}
+
+std::vector<Bookmark> LoudnessAnalyzer::getBookmarks() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->bookmarks;
+}
+
+std::vector<TimeSpan> LoudnessAnalyzer::getSilentSpans() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::vector<TimeSpan> spans = this->silentSpans;
+  if (this->silenceStart >= 0.0 && this->stats.analyzedSeconds - this->silenceStart >= this->minSilence)
+    spans.push_back({ this->silenceStart, this->stats.analyzedSeconds });
+  return spans;
+}
+
+LoudnessStats LoudnessAnalyzer::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->stats;
+}
+
+bool LoudnessAnalyzer::isFinished() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return !this->running || (this->atEnd && this->index && this->index->getFrameCount() <= this->endFrameCount);
+}
@@ -0,0 +1,112 @@
+#ifndef LOUDNESSANALYZER_HPP
+#define LOUDNESSANALYZER_HPP
+
+#include "audio_decoder.hpp"
+#include "timeline_index.hpp"
+#include "bookmark.hpp"
+#include "time_span.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+struct LoudnessStats {
+  double analyzedSeconds = 0.0;
+  double speed = 0.0;          // Recording seconds per second of work
+  float shortTerm = -70.0f;    // LUFS, latest
+  float median = -70.0f;       // LUFS, of the recording so far
+  float threshold = -70.0f;    // LUFS, what a peak has to reach
+};
+
+// Short-term loudness in the EBU R128 sense (K-weighted, 3 s window, 100 ms steps) of the
+// audio track, decoded once on its own thread. Peaks standing well above the recording's
+// own median loudness become bookmarks at their loudest 400 ms. Memory is fixed whatever
+// the length: a 3 s ring of block energies and a histogram of past loudness. Runs of blocks
+// under the silence level are kept as spans, for dead time.
+class LoudnessAnalyzer {
+private:
+  static constexpr int MAX_CHANNELS = 8;
+  static constexpr int WINDOW_BLOCKS = 30;    // 3 s short-term window
+  static constexpr int MOMENTARY_BLOCKS = 4;  // 400 ms
+  static constexpr int HISTOGRAM_BINS = 160;  // 0.5 LU each from the floor
+  const float histogramFloor = -70.0f;        // LUFS, the R128 absolute gate
+  const float histogramStep = 0.5f;
+  const float peakMargin = 8.0f;              // LU over the median
+  const float peakHysteresis = 3.0f;          // LU under the threshold ends a peak
+  const float quietestPeak = -40.0f;          // LUFS
+  const double minHistory = 10.0;             // Seconds before the median means anything
+  const double peakSpacing = 5.0;
+  const float silenceLoudness = -50.0f;       // LUFS, per 100 ms block
+  const double minSilence = 2.0;
+
+  AudioDecoder decoder;
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool running = false;
+  bool atEnd = false;
+  size_t endFrameCount = 0; // Index size when the end was hit, grows while recording
+  std::shared_ptr<const TimelineIndex> index;
+
+  std::vector<Bookmark> bookmarks;
+  std::vector<TimeSpan> silentSpans;
+  uint64_t version = 0;
+  LoudnessStats stats;
+
+  // Meter state, touched by the worker with the lock held. K-weighting runs four channels per SIMD lane group.
+  int channels = 0;
+  int sampleRate = 0;
+  int blockSize = 0;
+  float stage1[5] = {};                 // b0 b1 b2 a1 a2
+  float stage2[5] = {};
+  float filterState[MAX_CHANNELS / 4][4][4] = {}; // Per group: z1, z2 of both stages, per lane
+  float weights[MAX_CHANNELS] = {};
+  double energy[MAX_CHANNELS] = {};    // Of the block being filled
+  int blockFill = 0;
+  int64_t blocks = 0;
+  double window[WINDOW_BLOCKS] = {};    // Mean square per block
+  uint32_t histogram[HISTOGRAM_BINS] = {};
+  uint64_t histogramCount = 0;
+
+  // Peak being tracked
+  bool inPeak = false;
+  float peakScore = 0.0f;
+  float peakMomentary = 0.0f;
+  double peakTime = 0.0;
+  double lastPeak = -1e9;
+
+  double silenceStart = -1.0;
+
+  bool start(bool opened);
+  void setupMeter();
+  void workLoop();
+  void process(const float* samples, size_t frames);
+  void finishBlock();
+  float momentaryLoudness(int blocksBack);
+
+public:
+  LoudnessAnalyzer();
+  ~LoudnessAnalyzer();
+  bool open(const std::string& fileName);
+  bool open(std::shared_ptr<MemoryStream> stream);
+  void close();
+
+  // Latest index, analysis resumes when the recording has grown past where it ended
+  void setIndex(std::shared_ptr<const TimelineIndex> index);
+
+  // Bumped whenever bookmarks or spans are added, so callers only copy them when something changed
+  uint64_t getVersion();
+  std::vector<Bookmark> getBookmarks();
+
+  // Where the audio is silent, including the stretch still going where the scan is
+  std::vector<TimeSpan> getSilentSpans();
+  LoudnessStats getStats();
+
+  // Caught up with the whole index, for batch runs that wait for the scan to end
+  bool isFinished();
+};
+
+#endif // LOUDNESSANALYZER_HPP
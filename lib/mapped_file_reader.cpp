@@ -0,0 +1,244 @@
+#include "mapped_file_reader.hpp"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+namespace {
+  constexpr int IO_BUFFER_SIZE = 256 * 1024;
+
+  // Page faults are counted around one read in this many and scaled up
+  constexpr uint64_t FAULT_SAMPLE_READS = 16;
+
+  // How often a read checks the file size while it stays inside the mapping
+  constexpr double SIZE_CHECK_INTERVAL = 0.1;
+
+  double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void pageFaults(uint64_t* minor, uint64_t* major) {
+    struct rusage usage;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    *minor = usage.ru_minflt;
+    *major = usage.ru_majflt;
+  }
+}
+
+MappedFileReader::MappedFileReader() {
+
+}
+
+MappedFileReader::~MappedFileReader() {
+  close();
+}
+
+bool MappedFileReader::open(const std::string& path) {
+  close();
+
+  // Counters carry over when the same file is opened again, a new file starts from zero
+  if (path != this->path) {
+    std::lock_guard<std::mutex> lock(this->statsMutex);
+    this->stats = MappedReaderStats();
+  }
+
+  this->path = path;
+  this->fd = ::open(path.c_str(), O_RDONLY);
+  if (this->fd < 0) {
+    std::cout << "Could not open " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->position = 0;
+  this->reads = 0;
+  this->lastSizeCheck = now();
+  return this->remap();
+}
+
+void MappedFileReader::close() {
+  if (this->mapping) {
+    munmap(this->mapping, this->mappedSize);
+    this->mapping = nullptr;
+  }
+  if (this->fd >= 0) {
+    ::close(this->fd);
+    this->fd = -1;
+  }
+  this->mappedSize = 0;
+}
+
+bool MappedFileReader::isOpen() {
+  return this->fd >= 0;
+}
+
+bool MappedFileReader::remap() {
+  struct stat info;
+  if (fstat(this->fd, &info) != 0) {
+    return false;
+  }
+
+  // Recordings may still be growing, map whatever is there now
+  if (info.st_size == this->mappedSize) {
+    return true;
+  }
+
+  if (info.st_size < this->mappedSize) {
+    std::cout << this->path << " was truncated from " << this->mappedSize << " to " << info.st_size << " bytes" << std::endl;
+  }
+
+  if (this->mapping) {
+    munmap(this->mapping, this->mappedSize);
+    this->mapping = nullptr;
+    this->mappedSize = 0;
+  }
+
+  if (info.st_size == 0) {
+    return true;
+  }
+
+  void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, this->fd, 0);
+  if (mapping == MAP_FAILED) {
+    std::cout << "Failed to map " << this->path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->mapping = (uint8_t*)mapping;
+  this->mappedSize = info.st_size;
+  madvise(this->mapping, this->mappedSize, this->pattern == AccessPattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  return true;
+}
+
+AVIOContext* MappedFileReader::createContext() {
+  unsigned char* buffer = (unsigned char*)av_malloc(IO_BUFFER_SIZE);
+  return avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, this, &MappedFileReader::readPacket, NULL, &MappedFileReader::seekPacket);
+}
+
+void MappedFileReader::freeContext(AVIOContext** context) {
+  if (!*context) {
+    return;
+  }
+  av_freep(&(*context)->buffer);
+  avio_context_free(context);
+}
+
+void MappedFileReader::resync(AVIOContext* context) {
+  // pos is the file offset right after what the context has buffered
+  this->position = context->pos;
+}
+
+int MappedFileReader::readPacket(void* opaque, uint8_t* buf, int size) {
+  return ((MappedFileReader*)opaque)->read(buf, size);
+}
+
+int64_t MappedFileReader::seekPacket(void* opaque, int64_t offset, int whence) {
+  return ((MappedFileReader*)opaque)->seek(offset, whence);
+}
+
+int MappedFileReader::read(uint8_t* buf, int size) {
+  // Growth is mapped in once the reader reaches the old end. A truncated MAP_SHARED mapping raises
+  // SIGBUS past the new end, so the size is also checked now and then. The recorder replaces files
+  // instead of truncating them, this only guards against other writers.
+  double start = now();
+  bool checkSize = this->position >= this->mappedSize || start - this->lastSizeCheck >= SIZE_CHECK_INTERVAL;
+  if (checkSize) {
+    this->lastSizeCheck = start;
+    struct stat info;
+    if (fstat(this->fd, &info) != 0) {
+      return AVERROR(EIO);
+    }
+    if ((info.st_size < this->mappedSize || this->position >= this->mappedSize) && !this->remap()) {
+      return AVERROR(EIO);
+    }
+  }
+  if (this->position >= this->mappedSize) {
+    return AVERROR_EOF;
+  }
+
+  int count = (int)std::min<int64_t>(size, this->mappedSize - this->position);
+
+  bool sampled = this->reads++ % FAULT_SAMPLE_READS == 0;
+  uint64_t minorBefore = 0, majorBefore = 0, minorAfter = 0, majorAfter = 0;
+  if (sampled)
+    pageFaults(&minorBefore, &majorBefore);
+  start = now();
+
+  memcpy(buf, this->mapping + this->position, count);
+
+  double elapsed = now() - start;
+  if (sampled)
+    pageFaults(&minorAfter, &majorAfter);
+
+  this->position += count;
+
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  this->stats.bytesRead += count;
+  this->stats.minorFaults += (minorAfter - minorBefore) * FAULT_SAMPLE_READS;
+  this->stats.majorFaults += (majorAfter - majorBefore) * FAULT_SAMPLE_READS;
+  this->stats.readSeconds += elapsed;
+  return count;
+}
+
+int64_t MappedFileReader::seek(int64_t offset, int whence) {
+  switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+      this->remap();
+      return this->mappedSize;
+    case SEEK_SET: break;
+    case SEEK_CUR: offset += this->position; break;
+    case SEEK_END: this->remap(); offset += this->mappedSize; break;
+    default: return AVERROR(EINVAL);
+  }
+
+  if (offset < 0) {
+    return AVERROR(EINVAL);
+  }
+  this->position = offset;
+  return offset;
+}
+
+void MappedFileReader::prefetch(int64_t offset, int64_t length) {
+  if (!this->mapping || offset >= this->mappedSize || length <= 0) {
+    return;
+  }
+
+  // madvise wants page aligned addresses
+  int64_t pageSize = sysconf(_SC_PAGESIZE);
+  int64_t start = offset / pageSize * pageSize;
+  int64_t end = std::min(offset + length, this->mappedSize);
+
+  madvise(this->mapping + start, end - start, MADV_WILLNEED);
+#ifdef POSIX_FADV_WILLNEED
+  posix_fadvise(this->fd, start, end - start, POSIX_FADV_WILLNEED);
+#endif
+
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  this->stats.bytesPrefetched += end - start;
+}
+
+void MappedFileReader::setAccessPattern(AccessPattern pattern) {
+  if (pattern == this->pattern) {
+    return;
+  }
+
+  this->pattern = pattern;
+  if (!this->mapping) {
+    return;
+  }
+
+  int advice = pattern == AccessPattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM;
+  madvise(this->mapping, this->mappedSize, advice);
+}
+
+MappedReaderStats MappedFileReader::getStats() {
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  return this->stats;
+}
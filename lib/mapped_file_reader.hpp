@@ -0,0 +1,71 @@
+#ifndef MAPPEDFILEREADER_HPP
+#define MAPPEDFILEREADER_HPP
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+struct MappedReaderStats {
+  uint64_t bytesRead = 0;
+  uint64_t bytesPrefetched = 0;
+  // Estimated from every Nth read, bracketing each one with getrusage would double the syscalls
+  uint64_t minorFaults = 0; // Page was cached, only needed mapping
+  uint64_t majorFaults = 0; // Page had to come from disk
+  double readSeconds = 0.0; // Time spent copying out of the mapping
+};
+
+enum class AccessPattern {
+  Sequential, // Forward playback, kernel read-ahead on
+  Random      // Seeking, scrubbing and reverse playback
+};
+
+// Input AVIOContext backend that reads a local file through mmap, with explicit
+// read-ahead hints so cold seeks into large recordings don't stall on small reads.
+class MappedFileReader {
+private:
+  std::string path;
+  int fd = -1;
+  uint8_t* mapping = nullptr;
+  int64_t mappedSize = 0;
+  int64_t position = 0;
+  AccessPattern pattern = AccessPattern::Sequential;
+  uint64_t reads = 0;
+  double lastSizeCheck = 0.0;
+
+  std::mutex statsMutex;
+  MappedReaderStats stats;
+
+  bool remap();
+  int read(uint8_t* buf, int size);
+  int64_t seek(int64_t offset, int whence);
+
+  static int readPacket(void* opaque, uint8_t* buf, int size);
+  static int64_t seekPacket(void* opaque, int64_t offset, int whence);
+
+public:
+  MappedFileReader();
+  ~MappedFileReader();
+  bool open(const std::string& path);
+  void close();
+  bool isOpen();
+
+  // Input context for avformat_open_input, set AVFMT_FLAG_CUSTOM_IO and free with freeContext
+  AVIOContext* createContext();
+  static void freeContext(AVIOContext** context);
+
+  // Another context read through this reader, continue from where context left off
+  void resync(AVIOContext* context);
+
+  // Ask the kernel to start reading a byte range, e.g. the GOPs around a seek target
+  void prefetch(int64_t offset, int64_t length);
+  void setAccessPattern(AccessPattern pattern);
+
+  MappedReaderStats getStats();
+};
+
+#endif // MAPPEDFILEREADER_HPP
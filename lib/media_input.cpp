@@ -0,0 +1,52 @@
+#include "media_input.hpp"
+
+MediaInput::MediaInput() {
+
+}
+
+MediaInput::~MediaInput() {
+  this->close(nullptr);
+}
+
+bool MediaInput::open(AVFormatContext** context, const std::string& fileName, std::shared_ptr<MemoryStream> stream) {
+  this->close(context);
+  *context = avformat_alloc_context();
+
+  // Same input paths as the player, but a separate context so seeks never touch playback
+  const char* url = fileName.c_str();
+  if (stream) {
+    this->customIO = stream->createReader();
+    this->fromMemory = true;
+    url = NULL;
+  } else if (this->mappedFile.open(fileName)) {
+    this->customIO = this->mappedFile.createContext();
+  }
+  if (this->customIO) {
+    (*context)->pb = this->customIO;
+    (*context)->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+
+  // avformat_open_input frees the context when it fails
+  if (avformat_open_input(context, url, NULL, NULL) < 0) {
+    this->close(context);
+    return false;
+  }
+  avformat_find_stream_info(*context, NULL);
+  return true;
+}
+
+void MediaInput::close(AVFormatContext** context) {
+  // The demuxer goes first, it may still read through the custom context while closing
+  if (context)
+    avformat_close_input(context);
+
+  if (this->customIO) {
+    if (this->fromMemory) {
+      MemoryStream::freeContext(&this->customIO, true);
+    } else {
+      MappedFileReader::freeContext(&this->customIO);
+    }
+  }
+  this->fromMemory = false;
+  this->mappedFile.close();
+}
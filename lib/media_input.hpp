@@ -0,0 +1,33 @@
+#ifndef MEDIAINPUT_HPP
+#define MEDIAINPUT_HPP
+
+#include "memory_stream.hpp"
+#include "mapped_file_reader.hpp"
+#include <string>
+#include <memory>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+// Demuxer input for the workers that read a recording next to the player: the replay buffer
+// through its memory stream, local files through mmap, anything else by URL. Opens and closes
+// the caller's AVFormatContext together with the custom AVIOContext behind it. Not thread safe.
+class MediaInput {
+private:
+  MappedFileReader mappedFile;
+  AVIOContext* customIO = nullptr;
+  bool fromMemory = false;
+
+public:
+  MediaInput();
+  ~MediaInput();
+
+  // Reads stream when there is one, fileName otherwise. Stream info is probed as well.
+  // On failure context is left null and nothing stays open.
+  bool open(AVFormatContext** context, const std::string& fileName, std::shared_ptr<MemoryStream> stream);
+  void close(AVFormatContext** context);
+};
+
+#endif // MEDIAINPUT_HPP
@@ -1,6 +1,7 @@
 #include "media_player.hpp"
 #include <iostream>
 #include <algorithm>
+#include <sys/stat.h>
 
 
 MediaPlayer::MediaPlayer() {
@@ -10,6 +11,7 @@ MediaPlayer::MediaPlayer() {
 MediaPlayer::~MediaPlayer() {
   avformat_close_input(&this->pFormatContext);
   avformat_free_context(this->pFormatContext);
+  this->closeCustomIO();
   av_frame_free(&this->videoFrame);
   av_frame_free(&this->audioFrame);
   av_packet_free(&this->packet);
@@ -53,10 +55,21 @@ bool MediaPlayer::initializeStreams() {
     }
   }
 
-  return false;
+  // Audio is optional, recordings are video only
+  return this->videoStreamIndex != -1;
 }
 
 void MediaPlayer::reset() {
+  // Release anything left from a previously loaded source
+  avformat_close_input(&this->pFormatContext);
+  this->closeCustomIO();
+  this->mappedFile.close();
+  avcodec_free_context(&this->videoCodecContext);
+  avcodec_free_context(&this->audioCodecContext);
+  av_frame_free(&this->videoFrame);
+  av_frame_free(&this->audioFrame);
+  av_packet_free(&this->packet);
+
   this->videoStreamIndex = -1;
   this->audioStreamIndex = -1;
   this->videoCodecParams = nullptr;
@@ -65,18 +78,50 @@ void MediaPlayer::reset() {
   this->audioCodec = nullptr;
   this->videoCodecContext = nullptr;
   this->audioCodecContext = nullptr;
+  this->lastVideoDts = AV_NOPTS_VALUE;
+  this->lastAudioDts = AV_NOPTS_VALUE;
+  std::atomic_store(&this->timelineIndex, std::shared_ptr<const TimelineIndex>());
+  std::atomic_store(&this->audioIndex, std::shared_ptr<const TimelineIndex>());
+  this->pendingVideoEntries.clear();
+  this->pendingAudioEntries.clear();
+  this->lastFillEnd = -1.0;
+  this->lastSourceSize = -1;
 }
 
-bool MediaPlayer::loadFile(const std::string fileName) {
-  reset();
-
-  this->fileName = fileName;
+void MediaPlayer::closeCustomIO() {
+  if (this->memoryStream) {
+    MemoryStream::freeContext(&this->customIO, true);
+  } else {
+    MappedFileReader::freeContext(&this->customIO);
+  }
+}
 
+bool MediaPlayer::openInput() {
   // Holds information about media file format
   this->pFormatContext = avformat_alloc_context();
 
+  // Replay buffer is read straight from memory through a custom AVIOContext
+  const char* url = this->fileName.c_str();
+  if (this->memoryStream) {
+    this->closeCustomIO();
+    this->customIO = this->memoryStream->createReader();
+    this->pFormatContext->pb = this->customIO;
+    this->pFormatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    url = NULL;
+  } else if (this->mappedFile.isOpen() || this->mappedFile.open(this->fileName)) {
+    // Local files are read through mmap so seeks can prefetch whole GOPs. A refresh reopen
+    // keeps the reader (and its file) open, it picks up growth by itself.
+    this->closeCustomIO();
+    this->customIO = this->mappedFile.createContext();
+    this->pFormatContext->pb = this->customIO;
+    this->pFormatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+
   // Read header info int pFormatContext
-  avformat_open_input(&pFormatContext, this->fileName.c_str(), NULL, NULL);
+  if (avformat_open_input(&pFormatContext, url, NULL, NULL) < 0) {
+    std::cout << "Could not open " << this->fileName << std::endl;
+    return false;
+  }
 
   // Initialize streams
   if (!this->initializeStreams()) {
@@ -86,18 +131,59 @@ bool MediaPlayer::loadFile(const std::string fileName) {
 
   // Load stream info into pFormatContext (codec type, duration, etc)
   avformat_find_stream_info(pFormatContext, NULL);
+  return true;
+}
+
+bool MediaPlayer::loadFile(const std::string fileName) {
+  reset();
+
+  this->fileName = fileName;
+  this->memoryStream = nullptr;
+  return this->loadSource();
+}
+
+bool MediaPlayer::loadStream(std::shared_ptr<MemoryStream> stream) {
+  reset();
+
+  this->fileName = "replay buffer";
+  this->memoryStream = stream;
+  return this->loadSource();
+}
+
+bool MediaPlayer::indexFile(const std::string fileName) {
+  reset();
+
+  this->fileName = fileName;
+  this->memoryStream = nullptr;
+  if (!this->openInput()) {
+    return false;
+  }
+
+  this->packet = av_packet_alloc();
+  this->indexPackets();
+  this->sourceId++;
+  return this->timelineIndex && !this->timelineIndex->empty();
+}
+
+bool MediaPlayer::loadSource() {
+  if (!this->openInput()) {
+    return false;
+  }
 
   // Allocate codec context
   this->videoCodecContext = avcodec_alloc_context3(this->videoCodec);
-  this->audioCodecContext = avcodec_alloc_context3(this->audioCodec);
 
   // Fill codec context with parameters
   avcodec_parameters_to_context(this->videoCodecContext, this->videoCodecParams);
-  avcodec_parameters_to_context(this->audioCodecContext, this->audioCodecParams);
   
   // Open codec
   avcodec_open2(this->videoCodecContext, this->videoCodec, NULL);
-  avcodec_open2(this->audioCodecContext, this->audioCodec, NULL);
+
+  if (this->audioCodec) {
+    this->audioCodecContext = avcodec_alloc_context3(this->audioCodec);
+    avcodec_parameters_to_context(this->audioCodecContext, this->audioCodecParams);
+    avcodec_open2(this->audioCodecContext, this->audioCodec, NULL);
+  }
 
   // Initialize packet (reused for both video and audio)
   this->packet = av_packet_alloc();
@@ -106,78 +192,174 @@ bool MediaPlayer::loadFile(const std::string fileName) {
   this->videoFrame = av_frame_alloc();
   this->audioFrame = av_frame_alloc();
 
-  int response;
-
-  // Read packets from streams
+  // Build the timestamp index from packet headers, no decoding required
   std::cout << "Reading packets..." << std::endl;
+  this->indexPackets();
+
+  if (!this->timelineIndex || this->timelineIndex->empty()) {
+    std::cout << "No video packets found" << std::endl;
+    return false;
+  }
+
+  std::cout << "Video Pts: " << this->timelineIndex->getFrameCount() << " (" << this->timelineIndex->getMemoryBytes() << " bytes)" << std::endl;
+  std::cout << "Audio Pts: " << this->getAudioPacketCount() << std::endl;
+
+  // Fill cache with initial frames
+  this->fillCacheFromPTS(this->timelineIndex->getStartPts(), this->cacheSize);
+
+  this->sourceId++;
+  return this->pFormatContext;
+}
+
+size_t MediaPlayer::indexPackets() {
+  size_t added = 0;
+
   while (av_read_frame(this->pFormatContext, this->packet) >= 0) {
-    // Determine which codec context to use (video or audio)
-    if (this->packet->stream_index == this->videoStreamIndex) {
-
-      // Send raw data packet to decoder
-      response = avcodec_send_packet(this->videoCodecContext, this->packet);
-      if (response < 0) {
-        std::cout << "Failed to send packet" << std::endl;
-        return false;
-      }
+    if (this->appendPacketToIndex(this->packet)) {
+      added++;
+    }
+    av_packet_unref(this->packet);
+  }
 
-      // Receive raw data frame
-      response = avcodec_receive_frame(this->videoCodecContext, this->videoFrame);
-      if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-        continue;
-      } else if (response < 0) {
-        std::cout << "Failed to receive frame" << std::endl;
-        return false;
-      }
+  // Publish a new snapshot, readers holding the old one are unaffected
+  if (!this->pendingVideoEntries.empty()) {
+    double timeBase = av_q2d(this->pFormatContext->streams[this->videoStreamIndex]->time_base);
+    std::atomic_store(&this->timelineIndex, TimelineIndex::extend(this->timelineIndex, std::move(this->pendingVideoEntries), timeBase));
+    this->pendingVideoEntries.clear();
+  }
+  if (!this->pendingAudioEntries.empty()) {
+    double timeBase = av_q2d(this->pFormatContext->streams[this->audioStreamIndex]->time_base);
+    std::atomic_store(&this->audioIndex, TimelineIndex::extend(this->audioIndex, std::move(this->pendingAudioEntries), timeBase));
+    this->pendingAudioEntries.clear();
+  }
 
-      this->videoPtsBuffer.push_back(this->videoFrame->pts * av_q2d(this->pFormatContext->streams[this->videoStreamIndex]->time_base));
+  return added;
+}
 
-    } else if (this->packet->stream_index == this->audioStreamIndex) {
+bool MediaPlayer::appendPacketToIndex(AVPacket* packet) {
+  bool isVideo = packet->stream_index == this->videoStreamIndex;
+  bool isAudio = packet->stream_index == this->audioStreamIndex;
+  if (!isVideo && !isAudio) {
+    return false;
+  }
 
-      // Send raw data packet to decoder
-      response = avcodec_send_packet(this->audioCodecContext, this->packet);
-      if (response < 0) {
-        std::cout << "Failed to send packet" << std::endl;
-        return false;
-      }
+  int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+  int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : pts;
+  if (pts == AV_NOPTS_VALUE) {
+    return false;
+  }
 
-      // Receive raw data frame
-      response = avcodec_receive_frame(this->audioCodecContext, this->audioFrame);
-      if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-        continue;
-      } else if (response < 0) {
-        std::cout << "Failed to receive frame" << std::endl;
-        return false;
-      }
+  // Skip packets already indexed before a refresh (dts is monotonic per stream)
+  int64_t& lastDts = isVideo ? this->lastVideoDts : this->lastAudioDts;
+  if (lastDts != AV_NOPTS_VALUE && dts <= lastDts) {
+    return false;
+  }
+  lastDts = dts;
 
-      this->audioPtsBuffer.push_back(this->audioFrame->pts);
+  AVStream* stream = this->pFormatContext->streams[packet->stream_index];
+  double time = pts * av_q2d(stream->time_base);
 
-    } else {
-      std::cout << "Unsupported stream type for packet" << std::endl;
-      continue;
-    }
+  // Sorted into presentation order when the snapshot is built
+  std::vector<TimelineEntry>& pending = isVideo ? this->pendingVideoEntries : this->pendingAudioEntries;
+  pending.push_back({ time, packet->pos, packet->size, (packet->flags & AV_PKT_FLAG_KEY) != 0 });
+  return true;
+}
+
+size_t MediaPlayer::refreshIndex() {
+  if (!this->pFormatContext || !this->timelineIndex || this->timelineIndex->empty()) {
+    return 0;
   }
 
-  //std::cout << "Video queue size: " << this->videoBuffer.size() << std::endl;
-  //std::cout << "Audio queue size: " << this->audioBuffer.size() << std::endl;
-  std::cout << "Video Pts: " << this->videoPtsBuffer.size() << std::endl;
-  std::cout << "Audio Pts: " << this->audioPtsBuffer.size() << std::endl;
-  
+  // Continue reading after the previous end of file, picks up appended fragments
+  int64_t size = this->getSourceSize();
+  if (this->pFormatContext->pb) {
+    this->pFormatContext->pb->eof_reached = 0;
+  }
+  size_t added = this->indexPackets();
+
+  // Reopening parses the header and probes the streams again, only worth it when the source changed
+  bool changed = size < 0 || size != this->lastSourceSize;
+  this->lastSourceSize = size;
+  if (added == 0 && changed) {
+    // The demuxer may only know the fragments present when it was opened. Reopen into a
+    // fresh context and only swap it in once it shows the same streams, the old one stays
+    // in place (and usable) otherwise.
+    AVFormatContext* previousContext = this->pFormatContext;
+    AVIOContext* previousIO = this->customIO;
+    int previousVideoStream = this->videoStreamIndex;
+    int previousAudioStream = this->audioStreamIndex;
+    AVCodecParameters* previousVideoParams = this->videoCodecParams;
+    AVCodecParameters* previousAudioParams = this->audioCodecParams;
+    const AVCodec* previousVideoCodec = this->videoCodec;
+    const AVCodec* previousAudioCodec = this->audioCodec;
+    this->pFormatContext = nullptr;
+    this->customIO = nullptr;
+    this->videoStreamIndex = -1;
+    this->audioStreamIndex = -1;
+
+    if (!this->openInput() || this->videoStreamIndex != previousVideoStream || this->audioStreamIndex != previousAudioStream) {
+      std::cout << "Failed to reopen " << this->fileName << " while refreshing index" << std::endl;
+      avformat_close_input(&this->pFormatContext);
+      this->closeCustomIO();
+      this->pFormatContext = previousContext;
+      this->customIO = previousIO;
+      this->videoStreamIndex = previousVideoStream;
+      this->audioStreamIndex = previousAudioStream;
+      this->videoCodecParams = previousVideoParams;
+      this->audioCodecParams = previousAudioParams;
+      this->videoCodec = previousVideoCodec;
+      this->audioCodec = previousAudioCodec;
+
+      // Both contexts read through the same mapped reader, move it back to where the old one expects
+      if (!this->memoryStream && this->customIO)
+        this->mappedFile.resync(this->customIO);
+      return 0;
+    }
 
-  // Fill cache with initial frames
-  this->fillCacheFromPTS(0, this->cacheSize);
+    avformat_close_input(&previousContext);
+    if (previousIO) {
+      if (this->memoryStream) {
+        MemoryStream::freeContext(&previousIO, true);
+      } else {
+        MappedFileReader::freeContext(&previousIO);
+      }
+    }
+
+    av_seek_frame(this->pFormatContext, this->videoStreamIndex, this->lastVideoDts, AVSEEK_FLAG_BACKWARD);
+    added = this->indexPackets();
+  }
 
-  //for (int i = 0; i < this->videoFrameCache.size(); i++)
-  //  std::cout << i << this->videoFrameCache[i].pts << ", ";
-  //std::cout << std::endl;
+  if (added > 0) {
+    std::cout << "Index extended by " << added << " packets" << std::endl;
+  }
+  this->trimToRing();
 
-  //this->fillCacheFromPTS(this->videoPtsBuffer[50], this->cacheSize);
-  //for (int i = 0; i < this->videoFrameCache.size(); i++)
-  //  std::cout << i << this->videoFrameCache[i].pts << ", ";
-  //std::cout << std::endl;
+  return added;
+}
 
+void MediaPlayer::trimToRing() {
+  if (!this->memoryStream || !this->timelineIndex || this->timelineIndex->empty()) {
+    return;
+  }
 
-  return this->pFormatContext;
+  // Fragment start times are in microseconds, half a frame keeps the oldest keyframe from rounding away
+  double start = this->memoryStream->getStartTime() - this->timelineIndex->getAverageFrameDuration() / 2.0;
+  std::shared_ptr<const TimelineIndex> video = TimelineIndex::dropBefore(this->timelineIndex, start);
+  // Nothing indexed yet from the fragments still held, keep what there is until the next refresh
+  if (video == this->timelineIndex || video->empty()) {
+    return;
+  }
+
+  // Frame positions shift down by what was dropped
+  int droppedVideo = (int)(this->timelineIndex->getFrameCount() - video->getFrameCount());
+  this->currentPtsInVideoBuffer = std::max(this->currentPtsInVideoBuffer - droppedVideo, 0);
+  std::atomic_store(&this->timelineIndex, video);
+  if (this->audioIndex) {
+    std::shared_ptr<const TimelineIndex> audio = TimelineIndex::dropBefore(this->audioIndex, start);
+    int droppedAudio = (int)(this->audioIndex->getFrameCount() - audio->getFrameCount());
+    this->currentPtsInAudioBuffer = std::max(this->currentPtsInAudioBuffer - droppedAudio, 0);
+    std::atomic_store(&this->audioIndex, audio);
+  }
 }
 
 VideoFrame MediaPlayer::processVideoFrame(AVFrame* frame) {
@@ -224,35 +406,52 @@ void MediaPlayer::pause() {
   }
 }
 
-// TODO: More efficient way to do this
 void MediaPlayer::seek(double targetTime) {
-
-  // Reset video frame index to closest
-  for (size_t i = 0; i < this->videoPtsBuffer.size()-1; ++i) {
-    if (this->videoPtsBuffer[i] >= targetTime) {
-      this->currentPtsInVideoBuffer = i;
-      break;
-    }
+  this->trimToRing();
+  if (!this->timelineIndex || this->timelineIndex->empty()) {
+    return;
   }
+  // Nothing before the oldest indexed frame can be read, that's where a seek into evicted data lands
+  targetTime = std::max(targetTime, this->timelineIndex->getStartPts());
+
+  // Reset video frame index to the first frame at or after the target
+  size_t frame = this->timelineIndex->frameForPts(targetTime);
+  if (this->timelineIndex->ptsForFrame(frame) < targetTime && frame + 1 < this->timelineIndex->getFrameCount())
+    frame++;
+  this->currentPtsInVideoBuffer = (int)frame;
 
   // Reset audio frame index to closest
-  for (size_t i = 0; i < this->audioPtsBuffer.size()-1; ++i) {
-    if (this->audioPtsBuffer[i] >= targetTime) {
-      this->currentPtsInAudioBuffer = i;
-      break;
-    }
+  if (this->audioIndex && !this->audioIndex->empty()) {
+    size_t audioFrame = this->audioIndex->frameForPts(targetTime);
+    if (this->audioIndex->ptsForFrame(audioFrame) < targetTime && audioFrame + 1 < this->audioIndex->getFrameCount())
+      audioFrame++;
+    this->currentPtsInAudioBuffer = (int)audioFrame;
+  } else {
+    this->currentPtsInAudioBuffer = 0;
   }
 
   this->lastFrameTime = this->currentTime;
-  this->playbackStartTime = this->currentTime - targetTime;
-  this->fillCacheFromPTS(this->videoPtsBuffer[this->currentPtsInVideoBuffer], this->cacheSize);
+  this->rebaseClock(targetTime);
+  this->fillCacheFromPTS(this->timelineIndex->ptsForFrame(frame), this->cacheSize);
+  this->videoCacheIndex = 0;
 }
 
 void MediaPlayer::syncMedia(double currentTime) {
   this->currentTime = currentTime;
 
+  if (this->liveFollow && this->currentTime - this->lastLiveRefresh >= this->liveRefreshInterval) {
+    this->lastLiveRefresh = this->currentTime;
+    if (this->refreshIndex() > 0) {
+      this->lastLiveGrowth = this->currentTime;
+    } else if (this->currentTime - this->lastLiveGrowth >= this->liveIdleTimeout) {
+      // The writer finished or went idle, stop polling
+      std::cout << "Stopped following " << this->fileName << ", no new packets for " << this->liveIdleTimeout << "s" << std::endl;
+      this->liveFollow = false;
+    }
+  }
+
   // Get current and elapsed time
-  double playbackTime = this->currentTime - this->playbackStartTime;
+  double playbackTime = this->getPlaybackTime();
 
   // Calculate timing based on video and audio
   double videoPts = this->getVideoFrame().pts;
@@ -265,37 +464,76 @@ void MediaPlayer::syncMedia(double currentTime) {
   //if (!audioVideoInSync)
   //  this->seek(videoPts);
 
-  // Determine if should render frame using elapsed time
   VideoFrame frame = this->getVideoFrame();
+
+  // Reverse walks the cache backwards and refills it with the window before the first cached frame
+  if (this->reverse) {
+    this->shouldRenderFrame = frame.pts >= playbackTime && !this->paused;
+    if (!this->shouldRenderFrame) {
+      return;
+    }
+    lastFrameTime = this->currentTime;
+
+    if (this->videoCacheIndex > 0) {
+      this->videoCacheIndex--;
+    } else if (this->currentPtsInVideoBuffer > 0) {
+      size_t lastFrame = std::min((size_t)this->currentPtsInVideoBuffer - 1, this->timelineIndex->frameForPts(playbackTime));
+      this->fillCacheBackward(lastFrame);
+    } else {
+      this->pause();
+      return;
+    }
+
+    while (this->videoCacheIndex > 0 && this->videoFrameCache[this->videoCacheIndex-1].pts >= playbackTime)
+      this->videoCacheIndex--;
+    this->currentPtsInVideoBuffer = (int)this->timelineIndex->frameForPts(this->getVideoFrame().pts);
+    return;
+  }
+
+  // Determine if should render frame using elapsed time
   this->shouldRenderFrame = ((frame.pts <= playbackTime) || (this->videoCacheIndex == 0)) && !this->paused;
 
   if (this->shouldRenderFrame) {
     lastFrameTime = this->currentTime;
 
     // TODO: double buffer cache and swap pointers for efficiency? (separate thread)
-    if ((float)this->videoCacheIndex >= this->cacheSize-1) {
+    // Cache may hold fewer frames than cacheSize near the end of a growing file
+    if (this->videoCacheIndex >= (int)this->videoFrameCache.size()-1) {
       std::cout << "Reached end of cache,  Refilling..." << std::endl;
 
-      size_t nextIndex = this->currentPtsInVideoBuffer + 1;
+      // Decoding fell behind the clock, skip ahead instead of playing late frames
+      size_t nextIndex = std::max((size_t)this->currentPtsInVideoBuffer + 1, this->timelineIndex->frameForPts(playbackTime));
+      if (this->isKeyframeOnly() && nextIndex > 0)
+        nextIndex = this->timelineIndex->nextKeyframe(nextIndex - 1);
 
-      if (nextIndex >= this->videoPtsBuffer.size()) {
+      if (nextIndex >= this->timelineIndex->getFrameCount()) {
+          // Caught up with the recording, wait for the next fragment instead of stopping
+          if (this->liveFollow) {
+            return;
+          }
           this->pause();
           return;
       }
     
-      double startPTS = this->videoPtsBuffer[nextIndex];
+      double startPTS = this->timelineIndex->ptsForFrame(nextIndex);
       this->fillCacheFromPTS(startPTS, this->cacheSize);
       std::cout << "PTS index: " << this->currentPtsInVideoBuffer << std::endl;
-      std::cout << "PTS: " << this->videoPtsBuffer[this->currentPtsInVideoBuffer] << std::endl;
+      std::cout << "PTS: " << this->timelineIndex->ptsForFrame(this->currentPtsInVideoBuffer) << std::endl;
       this->videoCacheIndex = 0;
       this->audioCacheIndex = 0;
     }
 
 
-    this->videoCacheIndex = std::clamp(this->videoCacheIndex+1, 0, std::min((int)this->videoFrameCache.size(), this->cacheSize)-1);
-    this->audioCacheIndex = std::clamp(this->audioCacheIndex+1, 0, std::min((int)this->audioFrameCache.size(), this->cacheSize)-1);
-    this->currentPtsInVideoBuffer = std::clamp(this->currentPtsInVideoBuffer+1, 0, (int)this->videoPtsBuffer.size()-1);
-    this->currentPtsInAudioBuffer = std::clamp(this->currentPtsInAudioBuffer+1, 0, (int)this->audioPtsBuffer.size()-1);
+    int lastCacheIndex = (int)this->videoFrameCache.size()-1;
+    this->videoCacheIndex = std::clamp(this->videoCacheIndex+1, 0, lastCacheIndex);
+
+    // Above 1x several cached frames can be due at once, only show the newest
+    while (this->videoCacheIndex < lastCacheIndex && this->videoFrameCache[this->videoCacheIndex+1].pts <= playbackTime)
+      this->videoCacheIndex++;
+
+    this->audioCacheIndex = std::clamp(this->audioCacheIndex+1, 0, std::max(std::min((int)this->audioFrameCache.size(), this->cacheSize)-1, 0));
+    this->currentPtsInVideoBuffer = (int)this->timelineIndex->frameForPts(this->getVideoFrame().pts);
+    this->currentPtsInAudioBuffer = std::clamp(this->currentPtsInAudioBuffer+1, 0, std::max((int)this->getAudioPacketCount()-1, 0));
   }
 }
 
@@ -306,11 +544,13 @@ void MediaPlayer::fillCacheFromPTS(double targetPTS, size_t frameCount) {
     AVRational time_base = this->pFormatContext->streams[videoStreamIndex]->time_base;
     int64_t seekPTS = (int64_t)(targetPTS * time_base.den / time_base.num);
 
-    if (targetPTS > videoPtsBuffer.back() || targetPTS < videoPtsBuffer.front()) {
+    if (targetPTS > this->timelineIndex->getEndPts() || targetPTS < this->timelineIndex->getStartPts()) {
         fprintf(stderr, "Invalid PTS value for seeking\n");
         return;
     }
 
+    this->prefetchAround(targetPTS, frameCount);
+
     // Seek to closest keyframe that is earlier than PTS
     if (av_seek_frame(this->pFormatContext, videoStreamIndex, seekPTS, AVSEEK_FLAG_BACKWARD) < 0) {
       fprintf(stderr, "Error while seeking.\n");
@@ -319,7 +559,13 @@ void MediaPlayer::fillCacheFromPTS(double targetPTS, size_t frameCount) {
     
     // Clear decoder buffers
     avcodec_flush_buffers(this->videoCodecContext);
-    avcodec_flush_buffers(this->audioCodecContext);
+    if (this->audioCodecContext)
+      avcodec_flush_buffers(this->audioCodecContext);
+
+    // Keep decode cost flat as speed rises
+    bool keyframeOnly = this->isKeyframeOnly();
+    bool decodeAudio = this->audioCodecContext && !this->isAudioMuted();
+    this->videoCodecContext->skip_frame = this->getDecodeDiscard();
 
     // Clear Caches
     for (auto& frame : videoFrameCache)
@@ -347,6 +593,12 @@ void MediaPlayer::fillCacheFromPTS(double targetPTS, size_t frameCount) {
     
 
     while (av_read_frame(this->pFormatContext, packet) >= 0) {
+      // Don't even hand inter frames to the decoder when they would be discarded
+      if (packet->stream_index == videoStreamIndex && keyframeOnly && !(packet->flags & AV_PKT_FLAG_KEY)) {
+        av_packet_unref(packet);
+        continue;
+      }
+
       if (packet->stream_index == videoStreamIndex) {
         ret = avcodec_send_packet(this->videoCodecContext, packet);
         if (ret < 0) {
@@ -375,7 +627,7 @@ void MediaPlayer::fillCacheFromPTS(double targetPTS, size_t frameCount) {
           fprintf(stderr, "Error receiving frame\n");
           break;
         }
-    } else if (packet->stream_index == audioStreamIndex) {
+    } else if (packet->stream_index == audioStreamIndex && decodeAudio) {
         ret = avcodec_send_packet(this->audioCodecContext, packet);
         if (ret < 0) {
           fprintf(stderr, "Error sending audio packet for decoding\n");
@@ -398,18 +650,298 @@ void MediaPlayer::fillCacheFromPTS(double targetPTS, size_t frameCount) {
 cleanup:
     av_packet_free(&packet);
     av_frame_free(&frame);
+
+    if (!this->videoFrameCache.empty())
+      this->lastFillEnd = this->videoFrameCache.back().pts;
+}
+
+void MediaPlayer::prefetchAround(double targetPTS, size_t frameCount) {
+  if (!this->customIO || this->memoryStream || this->timelineIndex->getFrameCount() < 2) {
+    return;
+  }
+
+  // A refill continuing right after the previous cache is playback, anything else is a seek
+  double frameDuration = this->timelineIndex->getAverageFrameDuration();
+  bool continuing = this->lastFillEnd >= 0.0 && targetPTS >= this->lastFillEnd && targetPTS - this->lastFillEnd <= 2.0 * frameDuration;
+  this->mappedFile.setAccessPattern(continuing ? AccessPattern::Sequential : AccessPattern::Random);
+
+  // Read ahead from the keyframe the decoder will start at to the keyframe after the last cached frame
+  PacketRange range = this->timelineIndex->packetRange(targetPTS, targetPTS + frameCount * frameDuration);
+  int64_t end = range.byteEnd >= 0 ? range.byteEnd : INT64_MAX;
+  if (range.byteStart >= 0 && end > range.byteStart)
+    this->mappedFile.prefetch(range.byteStart, end - range.byteStart);
+}
+
+MappedReaderStats MediaPlayer::getInputStats() {
+  return this->mappedFile.getStats();
 }
 
 VideoFrame MediaPlayer::getVideoFrame() {
+  if (this->videoFrameCache.empty()) {
+    return VideoFrame();
+  }
   return this->videoFrameCache[this->videoCacheIndex];
 }
 
 AudioFrame MediaPlayer::getAudioFrame() {
+  if (this->audioFrameCache.empty()) {
+    return AudioFrame();
+  }
   return this->audioFrameCache[this->audioCacheIndex];
 }
 
 double MediaPlayer::getTotalDuration() {
-  return this->videoPtsBuffer.back() - this->videoPtsBuffer.front();
+  if (!this->timelineIndex) {
+    return 0.0;
+  }
+  return this->timelineIndex->getDuration();
+}
+
+void MediaPlayer::setLiveFollow(bool liveFollow) {
+  this->liveFollow = liveFollow;
+  this->lastLiveRefresh = 0.0;
+  this->lastLiveGrowth = this->currentTime;
+}
+
+int64_t MediaPlayer::getSourceSize() {
+  if (this->memoryStream) {
+    return (int64_t)this->memoryStream->getSizeBytes();
+  }
+  struct stat info;
+  if (stat(this->fileName.c_str(), &info) != 0) {
+    return -1;
+  }
+  return info.st_size;
+}
+
+bool MediaPlayer::isLiveFollow() {
+  return this->liveFollow;
+}
+
+bool MediaPlayer::isAtLiveEdge() {
+  if (!this->liveFollow || !this->timelineIndex || this->videoFrameCache.empty()) {
+    return false;
+  }
+  return this->timelineIndex->getEndPts() - this->getVideoFrame().pts <= this->liveEdgeTolerance;
+}
+
+void MediaPlayer::jumpToLive() {
+  this->refreshIndex();
+  if (!this->timelineIndex || this->timelineIndex->empty()) {
+    return;
+  }
+
+  // Start a few frames behind the newest packet so there is something to decode into the cache,
+  // the keyframe interval bounds how much has to be decoded to get there
+  size_t frameCount = this->timelineIndex->getFrameCount();
+  size_t frame = frameCount - std::min(frameCount, (size_t)this->liveStartFrames);
+  this->seek(this->timelineIndex->ptsForFrame(frame));
+  this->play();
+}
+
+size_t MediaPlayer::getReverseWindow() {
+  // Size of one decoded frame, estimated from the stream until something has been decoded
+  size_t frameBytes = 0;
+  if (!this->videoFrameCache.empty()) {
+    for (int i = 0; i < 3; i++)
+      frameBytes += this->videoFrameCache.front().data[i].size();
+  } else if (this->videoCodecParams) {
+    frameBytes = (size_t)this->videoCodecParams->width * this->videoCodecParams->height * 3 / 2;
+  }
+  return std::max<size_t>(1, this->reverseCacheBytes / std::max<size_t>(1, frameBytes));
+}
+
+void MediaPlayer::fillCacheBackward(size_t lastFrame) {
+  size_t firstFrame;
+  size_t frameCount;
+
+  if (this->isKeyframeOnly()) {
+    // The previous cacheSize keyframes
+    firstFrame = this->timelineIndex->previousKeyframe(lastFrame);
+    frameCount = 1;
+    while (firstFrame > 0 && frameCount < (size_t)this->cacheSize) {
+      firstFrame = this->timelineIndex->previousKeyframe(firstFrame - 1);
+      frameCount++;
+    }
+  } else {
+    // The enclosing GOP up to lastFrame, or its tail when the GOP is longer than the reverse cache
+    size_t keyframe = this->timelineIndex->previousKeyframe(lastFrame);
+    size_t window = this->getReverseWindow();
+    size_t windowStart = lastFrame + 1 >= window ? lastFrame + 1 - window : 0;
+    firstFrame = std::max(keyframe, windowStart);
+    frameCount = lastFrame - firstFrame + 1;
+  }
+
+  this->fillCacheFromPTS(this->timelineIndex->ptsForFrame(firstFrame), frameCount);
+  this->videoCacheIndex = std::max((int)this->videoFrameCache.size() - 1, 0);
+}
+
+double MediaPlayer::getPlaybackVelocity() {
+  return this->reverse ? -this->playbackSpeed : this->playbackSpeed;
+}
+
+double MediaPlayer::getPlaybackTime() {
+  return (this->currentTime - this->playbackStartTime) * this->getPlaybackVelocity();
+}
+
+void MediaPlayer::rebaseClock(double playbackTime) {
+  // While paused the clock stands at the last frame, play() adds the paused time back
+  double reference = this->paused ? this->lastFrameTime : this->currentTime;
+  this->playbackStartTime = reference - playbackTime / this->getPlaybackVelocity();
+}
+
+void MediaPlayer::setReverse(bool reverse) {
+  if (reverse == this->reverse) {
+    return;
+  }
+
+  double reference = this->paused ? this->lastFrameTime : this->currentTime;
+  double playbackTime = (reference - this->playbackStartTime) * this->getPlaybackVelocity();
+  this->reverse = reverse;
+  this->rebaseClock(playbackTime);
+}
+
+bool MediaPlayer::isReverse() {
+  return this->reverse;
+}
+
+void MediaPlayer::stepForward() {
+  this->pause();
+  if (this->isKeyframeOnly()) {
+    this->setPlaybackSpeed(1.0);
+  }
+  if (!this->timelineIndex || this->videoFrameCache.empty()) {
+    return;
+  }
+
+  if (this->videoCacheIndex + 1 < (int)this->videoFrameCache.size()) {
+    this->videoCacheIndex++;
+  } else {
+    size_t nextFrame = this->currentPtsInVideoBuffer + 1;
+    if (nextFrame >= this->timelineIndex->getFrameCount()) {
+      return;
+    }
+    this->fillCacheFromPTS(this->timelineIndex->ptsForFrame(nextFrame), this->cacheSize);
+    this->videoCacheIndex = 0;
+  }
+
+  this->currentPtsInVideoBuffer = (int)this->timelineIndex->frameForPts(this->getVideoFrame().pts);
+  this->lastFrameTime = this->currentTime;
+  this->rebaseClock(this->getVideoFrame().pts);
+}
+
+void MediaPlayer::stepBackward() {
+  this->pause();
+  if (this->isKeyframeOnly()) {
+    this->setPlaybackSpeed(1.0);
+  }
+  if (!this->timelineIndex || this->videoFrameCache.empty()) {
+    return;
+  }
+
+  if (this->videoCacheIndex > 0) {
+    this->videoCacheIndex--;
+  } else if (this->currentPtsInVideoBuffer > 0) {
+    this->fillCacheBackward(this->currentPtsInVideoBuffer - 1);
+  } else {
+    return;
+  }
+
+  this->currentPtsInVideoBuffer = (int)this->timelineIndex->frameForPts(this->getVideoFrame().pts);
+  this->lastFrameTime = this->currentTime;
+  this->rebaseClock(this->getVideoFrame().pts);
+}
+
+enum AVDiscard MediaPlayer::getDecodeDiscard() {
+  if (this->playbackSpeed >= this->keyframeOnlySpeed) {
+    return AVDISCARD_NONKEY;
+  }
+  if (this->playbackSpeed > this->nonRefSpeed) {
+    return AVDISCARD_NONREF;
+  }
+  return AVDISCARD_DEFAULT;
+}
+
+void MediaPlayer::setPlaybackSpeed(double speed) {
+  speed = std::clamp(speed, this->minPlaybackSpeed, this->maxPlaybackSpeed);
+  if (speed == this->playbackSpeed) {
+    return;
+  }
+
+  // Rebase the clock so the playback position doesn't jump
+  double reference = this->paused ? this->lastFrameTime : this->currentTime;
+  double playbackTime = (reference - this->playbackStartTime) * this->getPlaybackVelocity();
+  bool wasKeyframeOnly = this->isKeyframeOnly();
+  this->playbackSpeed = speed;
+  this->rebaseClock(playbackTime);
+
+  // The cache was decoded for the other mode, refill from the current frame
+  if (wasKeyframeOnly != this->isKeyframeOnly() && !this->videoFrameCache.empty()) {
+    this->seek(this->getVideoFrame().pts);
+  }
+}
+
+double MediaPlayer::getPlaybackSpeed() {
+  return this->playbackSpeed;
+}
+
+bool MediaPlayer::isKeyframeOnly() {
+  return this->getDecodeDiscard() == AVDISCARD_NONKEY;
+}
+
+bool MediaPlayer::isAudioMuted() {
+  return this->reverse || this->playbackSpeed > this->maxAudioSpeed || this->playbackSpeed < 1.0 / this->maxAudioSpeed;
+}
+
+void MediaPlayer::shuttleForward() {
+  // Pressing against the current direction slows down first, then turns around at 1x
+  if (this->paused || (this->reverse && this->playbackSpeed <= 1.0)) {
+    this->setReverse(false);
+    this->setPlaybackSpeed(1.0);
+    this->play();
+  } else if (this->reverse) {
+    this->setPlaybackSpeed(this->playbackSpeed / 2.0);
+  } else {
+    this->setPlaybackSpeed(this->playbackSpeed < 1.0 ? 1.0 : this->playbackSpeed * 2.0);
+  }
+}
+
+void MediaPlayer::shuttleBackward() {
+  if (this->paused || (!this->reverse && this->playbackSpeed <= 1.0)) {
+    this->setReverse(true);
+    this->setPlaybackSpeed(1.0);
+    this->play();
+  } else if (!this->reverse) {
+    this->setPlaybackSpeed(this->playbackSpeed / 2.0);
+  } else {
+    this->setPlaybackSpeed(this->playbackSpeed < 1.0 ? 1.0 : this->playbackSpeed * 2.0);
+  }
+}
+
+void MediaPlayer::shuttleStop() {
+  this->pause();
+  this->setReverse(false);
+  this->setPlaybackSpeed(1.0);
+}
+
+uint64_t MediaPlayer::getSourceId() {
+  return this->sourceId;
+}
+
+std::string MediaPlayer::getFileName() {
+  return this->fileName;
+}
+
+std::shared_ptr<MemoryStream> MediaPlayer::getMemoryStream() {
+  return this->memoryStream;
+}
+
+size_t MediaPlayer::getAudioPacketCount() {
+  return this->audioIndex ? this->audioIndex->getFrameCount() : 0;
+}
+
+std::shared_ptr<const TimelineIndex> MediaPlayer::getTimelineIndex() {
+  return std::atomic_load(&this->timelineIndex);
 }
 
 bool MediaPlayer::isPaused() {
@@ -421,5 +953,6 @@ double MediaPlayer::getProgress() {
     return 0.0;
   }
   
-  return std::max(0.0, std::min(100.0, (this->getVideoFrame().pts / this->getTotalDuration()) * 100.0));
+  double start = this->timelineIndex && !this->timelineIndex->empty() ? this->timelineIndex->getStartPts() : 0.0;
+  return std::max(0.0, std::min(100.0, ((this->getVideoFrame().pts - start) / this->getTotalDuration()) * 100.0));
 }
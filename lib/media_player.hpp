@@ -7,6 +7,9 @@
 #include <memory>
 #include <condition_variable>
 #include <vector>
+#include "memory_stream.hpp"
+#include "mapped_file_reader.hpp"
+#include "timeline_index.hpp"
 
 extern "C"
 {
@@ -54,7 +57,35 @@ private:
   AVCodecContext* videoCodecContext = nullptr;
   AVCodecContext* audioCodecContext = nullptr;
   std::string fileName;
+  std::shared_ptr<MemoryStream> memoryStream;
+  uint64_t sourceId = 0;
+  AVIOContext* customIO = nullptr;
+  void closeCustomIO();
+
+  // Local files are read through mmap with keyframe-driven read-ahead
+  MappedFileReader mappedFile;
+  double lastFillEnd = -1.0;
+  void prefetchAround(double targetPTS, size_t frameCount);
+
+  bool openInput();
+  bool loadSource();
   bool initializeStreams();
+  size_t indexPackets();
+  bool appendPacketToIndex(AVPacket* packet);
+
+  // Video and audio packet indexes, replaced by a new snapshot whenever packets are added
+  std::shared_ptr<const TimelineIndex> timelineIndex;
+  std::shared_ptr<const TimelineIndex> audioIndex;
+  std::vector<TimelineEntry> pendingVideoEntries;
+  std::vector<TimelineEntry> pendingAudioEntries;
+  size_t getAudioPacketCount();
+
+  // The replay ring evicts its oldest fragments as it fills, the index is cut to what it still holds
+  void trimToRing();
+
+  // Last indexed decode timestamp per stream, in stream time base
+  int64_t lastVideoDts = AV_NOPTS_VALUE;
+  int64_t lastAudioDts = AV_NOPTS_VALUE;
   int videoStreamIndex = -1;
   int audioStreamIndex = -1;
   AVCodecParameters* videoCodecParams = nullptr;
@@ -85,11 +116,75 @@ private:
   double playbackStartTime = 0.0;
   void fillCacheFromPTS(double targetPTS, size_t frameCount);
 
+  // Live follow (timeshift) of a recording that is still being written
+  bool liveFollow = false;
+  double lastLiveRefresh = 0.0;
+  double lastLiveGrowth = 0.0;
+  int64_t lastSourceSize = -1; // Size seen by the last refresh, reopening is skipped while it stays put
+  const double liveRefreshInterval = 0.5;
+  const double liveIdleTimeout = 5.0; // Stop following once the source stopped growing for this long
+  const double liveEdgeTolerance = 1.0;
+  const int liveStartFrames = 4;
+
+  // Playback speed, decoding drops to reference frames and then keyframes as it rises
+  double playbackSpeed = 1.0;
+  const double minPlaybackSpeed = 0.25;
+  const double maxPlaybackSpeed = 32.0;
+  const double nonRefSpeed = 2.0;
+  const double keyframeOnlySpeed = 8.0;
+  const double maxAudioSpeed = 2.0;
+  bool reverse = false;
+  enum AVDiscard getDecodeDiscard();
+  double getPlaybackVelocity();
+  double getPlaybackTime();
+  void rebaseClock(double playbackTime);
+
+  // Stepping back and reverse playback decode the GOP before the current frame once and walk it
+  // from the cache. Bounded in bytes (about 32 frames at 1080p, half the forward cache); a GOP
+  // longer than that only keeps its tail and is decoded from its keyframe once per window.
+  const size_t reverseCacheBytes = 96 << 20;
+  size_t getReverseWindow();
+  void fillCacheBackward(size_t lastFrame);
 
 public:
   MediaPlayer();
   ~MediaPlayer();
   bool loadFile(const std::string fileName);
+
+  // Play the in-memory replay ring directly, no file I/O
+  bool loadStream(std::shared_ptr<MemoryStream> stream);
+
+  // Only build the packet index, no decoders or frame cache. For headless tools, load again before playing.
+  bool indexFile(const std::string fileName);
+
+  // Index packets appended to a file that is still being written, returns the number added
+  size_t refreshIndex();
+  int64_t getSourceSize();
+
+  // Keep extending the timeline while the file grows, playback waits at the end instead of pausing
+  void setLiveFollow(bool liveFollow);
+  bool isLiveFollow();
+  bool isAtLiveEdge();
+  void jumpToLive();
+
+  // Speed is clamped to 0.25x-32x. Above 2x non-reference frames are skipped, from 8x only keyframes are decoded.
+  void setPlaybackSpeed(double speed);
+  double getPlaybackSpeed();
+  bool isKeyframeOnly();
+  bool isAudioMuted();
+
+  // Reverse playback at the current speed, audio is muted
+  void setReverse(bool reverse);
+  bool isReverse();
+
+  // Pause and move exactly one frame, repeated back-steps are served from the reverse cache
+  void stepForward();
+  void stepBackward();
+
+  // J/K/L shuttle: L plays forward and doubles the speed, J does the same in reverse, K stops
+  void shuttleForward();
+  void shuttleBackward();
+  void shuttleStop();
   void play();
   void pause();
   void seek(double targetTime);
@@ -97,13 +192,22 @@ public:
   VideoFrame getVideoFrame();
   AudioFrame getAudioFrame();
   bool isPaused();
+
+  // Changes every time a file or stream is loaded, so helpers with their own decoders know to reopen
+  uint64_t getSourceId();
+  std::string getFileName();
+  std::shared_ptr<MemoryStream> getMemoryStream();
+
+  // Current index snapshot, shared with the UI and exporters. Safe to call from any thread.
+  std::shared_ptr<const TimelineIndex> getTimelineIndex();
+
+  // Bytes read and page faults of the mmap input, to compare cold and warm seeks
+  MappedReaderStats getInputStats();
   void reset();
   std::vector<VideoFrame> videoFrameCache;
   std::vector<AudioFrame> audioFrameCache;
   double getProgress();
   double getTotalDuration();
-  std::vector<double> videoPtsBuffer;
-  std::vector<double> audioPtsBuffer;
 
 };
 
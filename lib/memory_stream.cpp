@@ -0,0 +1,181 @@
+#include "memory_stream.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+  constexpr int IO_BUFFER_SIZE = 64 * 1024;
+}
+
+MemoryStream::MemoryStream(double retentionSeconds) {
+  this->retention = retentionSeconds;
+}
+
+AVIOContext* MemoryStream::createWriter() {
+  unsigned char* buffer = (unsigned char*)av_malloc(IO_BUFFER_SIZE);
+  AVIOContext* context = avio_alloc_context(buffer, IO_BUFFER_SIZE, 1, this, NULL, &MemoryStream::writePacket, NULL);
+
+  // Markers tell us where the header ends and where each fragment starts
+  context->write_data_type = &MemoryStream::writeDataType;
+  return context;
+}
+
+AVIOContext* MemoryStream::createReader() {
+  Reader* reader = new Reader();
+  reader->stream = shared_from_this();
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    reader->baseOffset = this->fragments.empty() ? this->nextOffset : this->fragments.front().offset;
+  }
+
+  unsigned char* buffer = (unsigned char*)av_malloc(IO_BUFFER_SIZE);
+  return avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, reader, &MemoryStream::readPacket, NULL, &MemoryStream::seekReader);
+}
+
+void MemoryStream::freeContext(AVIOContext** context, bool reader) {
+  if (!*context) {
+    return;
+  }
+  if (reader) {
+    delete (Reader*)(*context)->opaque;
+  }
+  av_freep(&(*context)->buffer);
+  avio_context_free(context);
+}
+
+int MemoryStream::writePacket(void* opaque, AVIOWriteBuffer buf, int size) {
+  ((MemoryStream*)opaque)->append(buf, size, AVIO_DATA_MARKER_UNKNOWN, AV_NOPTS_VALUE);
+  return size;
+}
+
+int MemoryStream::writeDataType(void* opaque, AVIOWriteBuffer buf, int size, enum AVIODataMarkerType type, int64_t time) {
+  ((MemoryStream*)opaque)->append(buf, size, type, time);
+  return size;
+}
+
+void MemoryStream::append(const uint8_t* buf, int size, enum AVIODataMarkerType type, int64_t time) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  // Everything before the first keyframe fragment is the init segment
+  if (!this->headerDone && type != AVIO_DATA_MARKER_SYNC_POINT) {
+    this->header.insert(this->header.end(), buf, buf + size);
+    return;
+  }
+  this->headerDone = true;
+
+  // A sync point is a fragment starting on a keyframe, the only place we can start reading from
+  if (type == AVIO_DATA_MARKER_SYNC_POINT || this->fragments.empty()) {
+    Fragment fragment;
+    fragment.offset = this->nextOffset;
+    fragment.startTime = time != AV_NOPTS_VALUE ? (double)time / AV_TIME_BASE : 0.0;
+    this->fragments.push_back(std::move(fragment));
+  }
+
+  Fragment& current = this->fragments.back();
+  current.data.insert(current.data.end(), buf, buf + size);
+  this->nextOffset += size;
+
+  this->evict();
+}
+
+void MemoryStream::evict() {
+  // Always keep the newest fragment, drop whole fragments from the front past the retention window
+  while (this->fragments.size() > 1 && this->fragments.back().startTime - this->fragments[1].startTime >= this->retention) {
+    this->fragments.pop_front();
+  }
+}
+
+int MemoryStream::read(Reader* reader, uint8_t* buf, int size) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  int64_t position = reader->position;
+  int copied = 0;
+
+  // Header first, then the retained fragments back to back
+  if (position < (int64_t)this->header.size()) {
+    int count = (int)std::min<int64_t>(size, this->header.size() - position);
+    memcpy(buf, this->header.data() + position, count);
+    copied += count;
+    position += count;
+  }
+
+  while (copied < size) {
+    int64_t offset = position - (int64_t)this->header.size() + reader->baseOffset;
+
+    auto it = std::upper_bound(this->fragments.begin(), this->fragments.end(), offset,
+      [](int64_t value, const Fragment& fragment) { return value < fragment.offset; });
+    if (it == this->fragments.begin()) {
+      // The data under the read position was evicted
+      if (copied == 0) {
+        std::cout << "Replay buffer overrun, reader fell behind the retention window" << std::endl;
+        return AVERROR(EIO);
+      }
+      break;
+    }
+
+    const Fragment& fragment = *(it - 1);
+    int64_t inFragment = offset - fragment.offset;
+    if (inFragment >= (int64_t)fragment.data.size()) {
+      break;
+    }
+
+    int count = (int)std::min<int64_t>(size - copied, fragment.data.size() - inFragment);
+    memcpy(buf + copied, fragment.data.data() + inFragment, count);
+    copied += count;
+    position += count;
+  }
+
+  reader->position = position;
+  return copied > 0 ? copied : AVERROR_EOF;
+}
+
+int64_t MemoryStream::size(Reader* reader) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return (int64_t)this->header.size() + this->nextOffset - reader->baseOffset;
+}
+
+int MemoryStream::readPacket(void* opaque, uint8_t* buf, int size) {
+  Reader* reader = (Reader*)opaque;
+  return reader->stream->read(reader, buf, size);
+}
+
+int64_t MemoryStream::seekReader(void* opaque, int64_t offset, int whence) {
+  Reader* reader = (Reader*)opaque;
+  int64_t size = reader->stream->size(reader);
+
+  switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE: return size;
+    case SEEK_SET: break;
+    case SEEK_CUR: offset += reader->position; break;
+    case SEEK_END: offset += size; break;
+    default: return AVERROR(EINVAL);
+  }
+
+  if (offset < 0) {
+    return AVERROR(EINVAL);
+  }
+  reader->position = offset;
+  return offset;
+}
+
+size_t MemoryStream::getSizeBytes() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  size_t total = this->header.size();
+  for (const Fragment& fragment : this->fragments) {
+    total += fragment.data.size();
+  }
+  return total;
+}
+
+double MemoryStream::getStartTime() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->fragments.empty() ? 0.0 : this->fragments.front().startTime;
+}
+
+double MemoryStream::getDuration() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->fragments.empty()) {
+    return 0.0;
+  }
+  return this->fragments.back().startTime - this->fragments.front().startTime;
+}
@@ -0,0 +1,63 @@
+#ifndef MEMORYSTREAM_HPP
+#define MEMORYSTREAM_HPP
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include "avio_compat.hpp"
+
+// In-memory replay ring holding a fragmented MP4 stream. The muxer writes into it
+// through a custom AVIOContext; players read it back through another one with no file I/O.
+// Only the init segment (ftyp+moov) and the newest whole fragments are kept.
+class MemoryStream : public std::enable_shared_from_this<MemoryStream> {
+private:
+  struct Fragment {
+    std::vector<uint8_t> data;
+    int64_t offset; // Position in the unbounded stream, counted from the end of the header
+    double startTime;
+  };
+
+  std::mutex mutex;
+  std::vector<uint8_t> header;
+  std::deque<Fragment> fragments;
+  int64_t nextOffset = 0;
+  double retention;
+  bool headerDone = false;
+
+  // Reader state, one per AVIOContext handed out by createReader
+  struct Reader {
+    std::shared_ptr<MemoryStream> stream;
+    int64_t baseOffset; // Stream offset of the first fragment visible to this reader
+    int64_t position = 0;
+  };
+
+  void append(const uint8_t* buf, int size, enum AVIODataMarkerType type, int64_t time);
+  void evict();
+  int read(Reader* reader, uint8_t* buf, int size);
+  int64_t size(Reader* reader);
+
+  static int writePacket(void* opaque, AVIOWriteBuffer buf, int size);
+  static int writeDataType(void* opaque, AVIOWriteBuffer buf, int size, enum AVIODataMarkerType type, int64_t time);
+  static int readPacket(void* opaque, uint8_t* buf, int size);
+  static int64_t seekReader(void* opaque, int64_t offset, int whence);
+
+public:
+  MemoryStream(double retentionSeconds);
+
+  // Output context for a muxer (write side). Free with freeContext.
+  AVIOContext* createWriter();
+
+  // Input context starting at the oldest retained fragment. Free with freeContext.
+  AVIOContext* createReader();
+  static void freeContext(AVIOContext** context, bool reader);
+
+  size_t getSizeBytes();
+  double getDuration();
+
+  // Start time of the oldest fragment still held, anything before it has been evicted
+  double getStartTime();
+};
+
+#endif // MEMORYSTREAM_HPP
@@ -0,0 +1,592 @@
+#include "project_file.hpp"
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+extern "C"
+{
+#include <libavutil/crc.h>
+}
+
+namespace {
+  const char projectMagic[4] = { 'R', 'W', 'P', 'J' };
+  const uint32_t projectVersion = 2; // 2 added MarkersEdit, 1 files are upgraded in place
+
+  // Superseded records can take this much before a compaction is worth it
+  const int64_t compactionSlack = 64 * 1024;
+
+  enum RecordType : uint32_t {
+    ClipPut = 1,
+    ClipRemove = 2,
+    Markers = 3,
+    MarkersEdit = 4
+  };
+
+  struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t reserved;
+  };
+
+  // Followed by size bytes of payload, padded to 8. The CRC covers the type and the payload.
+  struct RecordHeader {
+    uint32_t size;
+    uint32_t crc;
+    uint32_t type;
+    uint32_t reserved;
+  };
+
+  struct ClipPayload {
+    uint32_t id;
+    uint32_t nameLength; // Name bytes follow, not terminated
+    double start;
+    double end;
+  };
+
+  struct RemovePayload {
+    uint32_t id;
+    uint32_t reserved;
+  };
+
+  // Followed by the bookmarks, then the dead spans
+  struct MarkersPayload {
+    uint32_t bookmarkCount;
+    uint32_t spanCount;
+  };
+
+  // Keeps the first markers of the ones before it and appends these, laid out as in MarkersPayload
+  struct MarkersEditPayload {
+    uint32_t keptBookmarks;
+    uint32_t keptSpans;
+    uint32_t bookmarkCount;
+    uint32_t spanCount;
+  };
+
+  struct BookmarkPayload {
+    double time;
+    float score;
+    uint32_t kind;
+  };
+
+  static_assert(sizeof(FileHeader) == 16 && sizeof(RecordHeader) == 16, "records stay 8-byte aligned");
+  static_assert(sizeof(ClipPayload) == 24 && sizeof(BookmarkPayload) == 16 && sizeof(MarkersEditPayload) == 16, "payloads are packed");
+  static_assert(sizeof(TimeSpan) == 16, "dead spans are stored as is");
+
+  uint32_t recordCrc(uint32_t type, const uint8_t* payload, size_t size) {
+    const AVCRC* table = av_crc_get_table(AV_CRC_32_IEEE_LE);
+    uint32_t crc = av_crc(table, 0, (const uint8_t*)&type, sizeof(type));
+    return av_crc(table, crc, payload, size);
+  }
+
+  size_t paddedSize(size_t size) {
+    return (size + 7) & ~(size_t)7;
+  }
+
+  size_t markersRecordSize(size_t bookmarkCount, size_t spanCount) {
+    return sizeof(RecordHeader) + paddedSize(sizeof(MarkersPayload) + bookmarkCount * sizeof(BookmarkPayload) + spanCount * sizeof(TimeSpan));
+  }
+
+  void storeMarkers(uint8_t* out, const Bookmark* bookmarks, size_t bookmarkCount, const TimeSpan* spans, size_t spanCount) {
+    BookmarkPayload* stored = (BookmarkPayload*)out;
+    for (size_t i = 0; i < bookmarkCount; i++)
+      stored[i] = { bookmarks[i].time, bookmarks[i].score, (uint32_t)bookmarks[i].kind };
+    if (spanCount > 0)
+      memcpy(stored + bookmarkCount, spans, spanCount * sizeof(TimeSpan));
+  }
+
+  void loadMarkers(const uint8_t* in, uint32_t bookmarkCount, uint32_t spanCount, std::vector<Bookmark>& bookmarks, std::vector<TimeSpan>& spans) {
+    const BookmarkPayload* stored = (const BookmarkPayload*)in;
+    size_t first = bookmarks.size();
+    bookmarks.resize(first + bookmarkCount);
+    for (uint32_t i = 0; i < bookmarkCount; i++)
+      bookmarks[first + i] = { stored[i].time, (BookmarkKind)stored[i].kind, stored[i].score };
+    first = spans.size();
+    spans.resize(first + spanCount);
+    if (spanCount > 0)
+      memcpy((void*)(spans.data() + first), stored + bookmarkCount, spanCount * sizeof(TimeSpan));
+  }
+
+  // Markers as of the end of the journal: the last full record and the edits after it
+  void applyMarkers(const std::vector<const RecordHeader*>& records, std::vector<Bookmark>& bookmarks, std::vector<TimeSpan>& spans) {
+    bookmarks.clear();
+    spans.clear();
+    for (const RecordHeader* record : records) {
+      if (record->type == Markers) {
+        const MarkersPayload* payload = (const MarkersPayload*)(record + 1);
+        loadMarkers((const uint8_t*)(payload + 1), payload->bookmarkCount, payload->spanCount, bookmarks, spans);
+      } else {
+        const MarkersEditPayload* payload = (const MarkersEditPayload*)(record + 1);
+        bookmarks.resize(std::min<size_t>(bookmarks.size(), payload->keptBookmarks));
+        spans.resize(std::min<size_t>(spans.size(), payload->keptSpans));
+        loadMarkers((const uint8_t*)(payload + 1), payload->bookmarkCount, payload->spanCount, bookmarks, spans);
+      }
+    }
+  }
+
+  // A rename only survives a crash once the directory holding it is synced
+  bool syncDirectory(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+  }
+
+  // Walks the journal from the start and keeps the latest record of each clip, and the markers
+  // records from the last full one on. Stops at the first record that is cut short or fails
+  // its CRC, returns where that is.
+  size_t replay(const uint8_t* data, size_t size, std::unordered_map<uint32_t, const RecordHeader*>& clips, std::vector<const RecordHeader*>& markers) {
+    size_t offset = sizeof(FileHeader);
+    while (offset + sizeof(RecordHeader) <= size) {
+      const RecordHeader* record = (const RecordHeader*)(data + offset);
+      const uint8_t* payload = data + offset + sizeof(RecordHeader);
+      if (record->size % 8 != 0 || record->size > size - offset - sizeof(RecordHeader) || recordCrc(record->type, payload, record->size) != record->crc) {
+        break;
+      }
+
+      if (record->type == ClipPut && record->size >= sizeof(ClipPayload)) {
+        const ClipPayload* clip = (const ClipPayload*)payload;
+        if (sizeof(ClipPayload) + clip->nameLength <= record->size)
+          clips[clip->id] = record;
+      } else if (record->type == ClipRemove && record->size >= sizeof(RemovePayload)) {
+        clips.erase(((const RemovePayload*)payload)->id);
+      } else if (record->type == Markers && record->size >= sizeof(MarkersPayload)) {
+        const MarkersPayload* header = (const MarkersPayload*)payload;
+        if (sizeof(MarkersPayload) + (uint64_t)header->bookmarkCount * sizeof(BookmarkPayload) + (uint64_t)header->spanCount * sizeof(TimeSpan) <= record->size)
+          markers.assign(1, record);
+      } else if (record->type == MarkersEdit && record->size >= sizeof(MarkersEditPayload)) {
+        const MarkersEditPayload* header = (const MarkersEditPayload*)payload;
+        if (sizeof(MarkersEditPayload) + (uint64_t)header->bookmarkCount * sizeof(BookmarkPayload) + (uint64_t)header->spanCount * sizeof(TimeSpan) <= record->size)
+          markers.push_back(record);
+      }
+      offset += sizeof(RecordHeader) + record->size;
+    }
+    return offset;
+  }
+
+  std::vector<const RecordHeader*> sortedClips(const std::unordered_map<uint32_t, const RecordHeader*>& clips) {
+    std::vector<const RecordHeader*> records;
+    records.reserve(clips.size());
+    for (const auto& entry : clips)
+      records.push_back(entry.second);
+    std::sort(records.begin(), records.end(), [](const RecordHeader* a, const RecordHeader* b) {
+      return ((const ClipPayload*)(a + 1))->id < ((const ClipPayload*)(b + 1))->id;
+    });
+    return records;
+  }
+
+  bool writeAll(int fd, const uint8_t* data, size_t size, int64_t offset) {
+    while (size > 0) {
+      ssize_t written = pwrite(fd, data, size, offset);
+      if (written <= 0) {
+        return false;
+      }
+      data += written;
+      size -= written;
+      offset += written;
+    }
+    return true;
+  }
+}
+
+ProjectFile::ProjectFile() {
+
+}
+
+ProjectFile::~ProjectFile() {
+  this->close();
+}
+
+bool ProjectFile::open(const std::string& path, std::vector<Clip>& clips, StringArena& names, std::vector<Bookmark>& bookmarks, std::vector<TimeSpan>& deadSpans) {
+  this->close();
+  auto loadStart = std::chrono::steady_clock::now();
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cout << "Project: could not open " << path << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  FileHeader header;
+  bool readable = st.st_size >= (off_t)sizeof(FileHeader) && pread(fd, &header, sizeof(header), 0) == sizeof(header)
+    && memcmp(header.magic, projectMagic, sizeof(projectMagic)) == 0;
+
+  // A newer version is left alone, anything else that isn't a journal is kept aside rather than overwritten
+  if (readable && header.version > projectVersion) {
+    std::cout << "Project: " << path << " is version " << header.version << ", this build reads " << projectVersion << std::endl;
+    ::close(fd);
+    return false;
+  }
+  if (!readable && st.st_size > 0) {
+    std::string backupPath = path + ".bak";
+    ::close(fd);
+    if (rename(path.c_str(), backupPath.c_str()) < 0) {
+      std::cout << "Project: " << path << " is not a project file and could not be moved aside" << std::endl;
+      return false;
+    }
+    std::cout << "Project: " << path << " is not a project file, moved it to " << backupPath << std::endl;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      std::cout << "Project: could not create " << path << std::endl;
+      return false;
+    }
+  }
+
+  // New, start an empty journal
+  int64_t size = sizeof(FileHeader);
+  if (!readable) {
+    header = FileHeader();
+    memcpy(header.magic, projectMagic, sizeof(projectMagic));
+    header.version = projectVersion;
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) || fdatasync(fd) < 0) {
+      std::cout << "Project: could not write " << path << std::endl;
+      ::close(fd);
+      return false;
+    }
+  } else {
+    if (header.version < projectVersion) {
+      header.version = projectVersion;
+      if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) || fdatasync(fd) < 0) {
+        std::cout << "Project: could not upgrade " << path << std::endl;
+        ::close(fd);
+        return false;
+      }
+    }
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      std::cout << "Project: could not map " << path << std::endl;
+      ::close(fd);
+      return false;
+    }
+    const uint8_t* data = (const uint8_t*)mapping;
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+    std::unordered_map<uint32_t, const RecordHeader*> liveClips;
+    std::vector<const RecordHeader*> markers;
+    size = replay(data, st.st_size, liveClips, markers);
+
+    // Names are interned straight out of the mapping, markers are copied as they are laid out
+    std::vector<const RecordHeader*> records = sortedClips(liveClips);
+    clips.reserve(clips.size() + records.size());
+    for (const RecordHeader* record : records) {
+      const ClipPayload* payload = (const ClipPayload*)(record + 1);
+      std::string_view name((const char*)(payload + 1), payload->nameLength);
+      clips.push_back({ payload->start, payload->end, names.intern(name), payload->id });
+      this->clipBytes[payload->id] = sizeof(RecordHeader) + record->size;
+    }
+    if (!markers.empty()) {
+      applyMarkers(markers, this->savedBookmarks, this->savedSpans);
+      bookmarks = this->savedBookmarks;
+      deadSpans = this->savedSpans;
+      this->markerBytes = markersRecordSize(bookmarks.size(), deadSpans.size());
+    }
+    munmap(mapping, st.st_size);
+
+    // Drop a record torn by a crash, appends continue from the last good one
+    if (size < st.st_size) {
+      std::cout << "Project: dropping " << (st.st_size - size) << " bytes of incomplete records from " << path << std::endl;
+      if (ftruncate(fd, size) < 0)
+        std::cout << "Project: could not trim " << path << std::endl;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->path = path;
+  this->fd = fd;
+  this->fileSize = size;
+  this->stats = ProjectStats();
+  this->stats.fileBytes = size;
+  this->stats.liveBytes = sizeof(FileHeader) + this->markerBytes;
+  for (const auto& entry : this->clipBytes)
+    this->stats.liveBytes += entry.second;
+  this->stats.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+  return true;
+}
+
+void ProjectFile::close() {
+  if (this->compactor.joinable())
+    this->compactor.join();
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->fd >= 0) {
+    ::close(this->fd);
+    this->fd = -1;
+  }
+  this->path.clear();
+  this->fileSize = 0;
+  this->clipBytes.clear();
+  this->markerBytes = 0;
+  this->savedBookmarks.clear();
+  this->savedSpans.clear();
+  this->stats = ProjectStats();
+}
+
+bool ProjectFile::isOpen() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->fd >= 0;
+}
+
+const std::string& ProjectFile::getPath() {
+  return this->path;
+}
+
+uint8_t* ProjectFile::startRecord(uint32_t type, size_t size) {
+  size_t padded = paddedSize(size);
+  this->buffer.assign(sizeof(RecordHeader) + padded, 0);
+  RecordHeader* header = (RecordHeader*)this->buffer.data();
+  header->size = (uint32_t)padded;
+  header->type = type;
+  return this->buffer.data() + sizeof(RecordHeader);
+}
+
+int64_t ProjectFile::writeRecord() {
+  RecordHeader* header = (RecordHeader*)this->buffer.data();
+  header->crc = recordCrc(header->type, this->buffer.data() + sizeof(RecordHeader), header->size);
+
+  int syncFd = -1;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->fd < 0) {
+      return 0;
+    }
+    if (!writeAll(this->fd, this->buffer.data(), this->buffer.size(), this->fileSize)) {
+      // Whatever made it to disk is a torn record, the next append overwrites it
+      std::cout << "Project: could not write " << this->path << std::endl;
+      return 0;
+    }
+    this->fileSize += this->buffer.size();
+    this->stats.fileBytes = this->fileSize;
+    this->stats.appends++;
+
+    // Synced on a descriptor of its own, the compactor may swap files meanwhile. A swap carries
+    // this record over and syncs it in the new file.
+    syncFd = dup(this->fd);
+  }
+
+  // An edit only counts once it is on disk, a crash can then tear at most the record after it
+  bool synced = syncFd >= 0 && fdatasync(syncFd) == 0;
+  if (syncFd >= 0)
+    ::close(syncFd);
+  if (!synced) {
+    std::cout << "Project: could not sync " << this->path << std::endl;
+    return 0;
+  }
+  return this->buffer.size();
+}
+
+void ProjectFile::putClip(const Clip& clip, const char* name) {
+  if (!this->isOpen()) {
+    return;
+  }
+
+  size_t nameLength = name ? strlen(name) : 0;
+  ClipPayload* payload = (ClipPayload*)this->startRecord(ClipPut, sizeof(ClipPayload) + nameLength);
+  payload->id = clip.id;
+  payload->nameLength = (uint32_t)nameLength;
+  payload->start = clip.time_start;
+  payload->end = clip.time_end;
+  if (nameLength > 0)
+    memcpy(payload + 1, name, nameLength);
+
+  int64_t written = this->writeRecord();
+  if (written > 0) {
+    uint32_t& live = this->clipBytes[clip.id];
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stats.liveBytes += written - live;
+    live = (uint32_t)written;
+  }
+  this->maybeCompact();
+}
+
+void ProjectFile::removeClip(uint32_t id) {
+  if (!this->isOpen()) {
+    return;
+  }
+
+  RemovePayload* payload = (RemovePayload*)this->startRecord(ClipRemove, sizeof(RemovePayload));
+  payload->id = id;
+  if (this->writeRecord() > 0) {
+    auto found = this->clipBytes.find(id);
+    if (found != this->clipBytes.end()) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->stats.liveBytes -= found->second;
+      this->clipBytes.erase(found);
+    }
+  }
+  this->maybeCompact();
+}
+
+void ProjectFile::putMarkers(const std::vector<Bookmark>& bookmarks, const std::vector<TimeSpan>& deadSpans) {
+  if (!this->isOpen()) {
+    return;
+  }
+
+  // Markers only grow or change near the end while a recording is analyzed, so only what
+  // differs from the last save is journaled
+  size_t keptBookmarks = 0;
+  size_t keptSpans = 0;
+  while (keptBookmarks < std::min(bookmarks.size(), this->savedBookmarks.size())) {
+    const Bookmark& a = bookmarks[keptBookmarks];
+    const Bookmark& b = this->savedBookmarks[keptBookmarks];
+    if (a.time != b.time || a.kind != b.kind || a.score != b.score)
+      break;
+    keptBookmarks++;
+  }
+  while (keptSpans < std::min(deadSpans.size(), this->savedSpans.size())
+      && deadSpans[keptSpans].start == this->savedSpans[keptSpans].start && deadSpans[keptSpans].end == this->savedSpans[keptSpans].end)
+    keptSpans++;
+  if (keptBookmarks == bookmarks.size() && keptBookmarks == this->savedBookmarks.size()
+      && keptSpans == deadSpans.size() && keptSpans == this->savedSpans.size()) {
+    return;
+  }
+
+  size_t bookmarkCount = bookmarks.size() - keptBookmarks;
+  size_t spanCount = deadSpans.size() - keptSpans;
+  size_t size = sizeof(MarkersEditPayload) + bookmarkCount * sizeof(BookmarkPayload) + spanCount * sizeof(TimeSpan);
+  MarkersEditPayload* payload = (MarkersEditPayload*)this->startRecord(MarkersEdit, size);
+  payload->keptBookmarks = (uint32_t)keptBookmarks;
+  payload->keptSpans = (uint32_t)keptSpans;
+  payload->bookmarkCount = (uint32_t)bookmarkCount;
+  payload->spanCount = (uint32_t)spanCount;
+  storeMarkers((uint8_t*)(payload + 1), bookmarks.data() + keptBookmarks, bookmarkCount, deadSpans.data() + keptSpans, spanCount);
+
+  // A failed write may or may not have landed, the next save then starts from nothing kept
+  if (this->writeRecord() == 0) {
+    this->savedBookmarks.clear();
+    this->savedSpans.clear();
+    this->maybeCompact();
+    return;
+  }
+  this->savedBookmarks = bookmarks;
+  this->savedSpans = deadSpans;
+
+  // Compaction folds the edits into one full record, that is what's live
+  int64_t live = markersRecordSize(bookmarks.size(), deadSpans.size());
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stats.liveBytes += live - this->markerBytes;
+    this->markerBytes = live;
+  }
+  this->maybeCompact();
+}
+
+void ProjectFile::maybeCompact() {
+  bool worthIt = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    worthIt = !this->compacting && this->fileSize > this->stats.liveBytes * 2 + compactionSlack;
+  }
+  if (worthIt)
+    this->compact();
+}
+
+void ProjectFile::compact() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->compacting || this->fd < 0) {
+    return;
+  }
+
+  // The last one is done, it cleared compacting on its way out
+  if (this->compactor.joinable())
+    this->compactor.join();
+  this->compacting = true;
+  this->compactor = std::thread(&ProjectFile::compactWorker, this, this->fileSize);
+}
+
+void ProjectFile::compactWorker(int64_t end) {
+  // Everything before end is settled, appends only ever go after it. The descriptor is
+  // only swapped by this thread, so it can be read without the lock.
+  std::string tmpPath = this->path + ".tmp";
+  void* mapping = end > 0 ? mmap(NULL, end, PROT_READ, MAP_PRIVATE, this->fd, 0) : MAP_FAILED;
+  int tmpFd = mapping != MAP_FAILED ? ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+  if (tmpFd < 0) {
+    std::cout << "Project: could not compact " << this->path << std::endl;
+    if (mapping != MAP_FAILED)
+      munmap(mapping, end);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->compacting = false;
+    return;
+  }
+
+  // Live clip records are copied as they are, CRCs and all. The markers and their edits are folded into one record.
+  const uint8_t* data = (const uint8_t*)mapping;
+  std::unordered_map<uint32_t, const RecordHeader*> clips;
+  std::vector<const RecordHeader*> markers;
+  replay(data, end, clips, markers);
+
+  std::vector<uint8_t> out(data, data + sizeof(FileHeader));
+  for (const RecordHeader* record : sortedClips(clips))
+    out.insert(out.end(), (const uint8_t*)record, (const uint8_t*)(record + 1) + record->size);
+  if (!markers.empty()) {
+    std::vector<Bookmark> bookmarks;
+    std::vector<TimeSpan> spans;
+    applyMarkers(markers, bookmarks, spans);
+    size_t offset = out.size();
+    out.resize(offset + markersRecordSize(bookmarks.size(), spans.size()), 0);
+    RecordHeader* header = (RecordHeader*)(out.data() + offset);
+    MarkersPayload* payload = (MarkersPayload*)(header + 1);
+    header->size = (uint32_t)(out.size() - offset - sizeof(RecordHeader));
+    header->type = Markers;
+    payload->bookmarkCount = (uint32_t)bookmarks.size();
+    payload->spanCount = (uint32_t)spans.size();
+    storeMarkers((uint8_t*)(payload + 1), bookmarks.data(), bookmarks.size(), spans.data(), spans.size());
+    header->crc = recordCrc(header->type, (const uint8_t*)payload, header->size);
+  }
+  munmap(mapping, end);
+  bool written = writeAll(tmpFd, out.data(), out.size(), 0);
+
+  // Catch up with what was appended meanwhile, then sync and swap the names. All without the
+  // lock so edits aren't held up, appends only ever go past what was copied.
+  int64_t copied = end;
+  std::vector<uint8_t> tail;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    tail.resize(this->fileSize - copied);
+  }
+  written = written && (tail.empty() || pread(this->fd, tail.data(), tail.size(), copied) == (ssize_t)tail.size())
+    && writeAll(tmpFd, tail.data(), tail.size(), out.size()) && fdatasync(tmpFd) == 0
+    && rename(tmpPath.c_str(), this->path.c_str()) == 0;
+  copied += tail.size();
+  if (!written) {
+    std::cout << "Project: could not compact " << this->path << std::endl;
+    ::close(tmpFd);
+    unlink(tmpPath.c_str());
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->compacting = false;
+    return;
+  }
+  if (!syncDirectory(this->path))
+    std::cout << "Project: could not sync the directory of " << this->path << std::endl;
+
+  // Edits that landed in the old file since the catch-up are carried over and synced here, the
+  // name already points at the new one. Rarely more than nothing.
+  std::lock_guard<std::mutex> lock(this->mutex);
+  tail.resize(this->fileSize - copied);
+  if (!tail.empty() && (pread(this->fd, tail.data(), tail.size(), copied) != (ssize_t)tail.size()
+      || !writeAll(tmpFd, tail.data(), tail.size(), out.size() + copied - end) || fdatasync(tmpFd) < 0)) {
+    std::cout << "Project: could not carry the latest edits over to the compacted " << this->path << std::endl;
+  }
+
+  ::close(this->fd);
+  this->fd = tmpFd;
+  this->fileSize = out.size() + (copied - end) + tail.size();
+  this->stats.fileBytes = this->fileSize;
+  this->stats.compactions++;
+  this->compacting = false;
+}
+
+ProjectStats ProjectFile::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->stats;
+}
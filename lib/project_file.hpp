@@ -0,0 +1,70 @@
+#ifndef PROJECTFILE_HPP
+#define PROJECTFILE_HPP
+
+#include "clip.hpp"
+#include "bookmark.hpp"
+#include "time_span.hpp"
+#include "string_arena.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+
+struct ProjectStats {
+  int64_t fileBytes = 0;
+  int64_t liveBytes = 0;   // What the file would be right after compaction
+  uint64_t appends = 0;
+  uint64_t compactions = 0;
+  double loadMs = 0.0;
+};
+
+// Clips and analysis markers of one recording, kept next to it as an append-only journal.
+// Every edit is one small write at the end followed by fdatasync, so autosaving after each edit
+// costs the size of the edit; markers only journal what changed since the last save. Records carry a CRC and a torn one at the end (a crash mid-write) is cut off on
+// open. Once most of the file is superseded records, a thread rewrites it with only the live
+// ones and swaps it in, edits made meanwhile are carried over. Records are 8-byte aligned so
+// loading walks the mapped file and copies markers straight out of it.
+class ProjectFile {
+private:
+  std::string path;
+  int fd = -1;
+  int64_t fileSize = 0;
+  std::vector<uint8_t> buffer;                         // Record being written, reused
+  std::unordered_map<uint32_t, uint32_t> clipBytes;    // Live record size per clip id
+  int64_t markerBytes = 0;
+  std::vector<Bookmark> savedBookmarks;                // Markers as the journal has them
+  std::vector<TimeSpan> savedSpans;
+  ProjectStats stats;
+
+  std::mutex mutex;       // Guards fd and fileSize against the compactor swapping files, syncs happen outside it
+  std::thread compactor;
+  bool compacting = false;
+
+  uint8_t* startRecord(uint32_t type, size_t size);
+  int64_t writeRecord();
+  void maybeCompact();
+  void compactWorker(int64_t end);
+
+public:
+  ProjectFile();
+  ~ProjectFile();
+
+  // Open or create the project file and read back what it holds. A file that isn't a project is
+  // moved to path.bak and a new one started, one from a newer version is refused.
+  bool open(const std::string& path, std::vector<Clip>& clips, StringArena& names, std::vector<Bookmark>& bookmarks, std::vector<TimeSpan>& deadSpans);
+  void close();
+  bool isOpen();
+  const std::string& getPath();
+
+  void putClip(const Clip& clip, const char* name);
+  void removeClip(uint32_t id);
+  void putMarkers(const std::vector<Bookmark>& bookmarks, const std::vector<TimeSpan>& deadSpans);
+
+  // Rewrite with only the live records, in the background
+  void compact();
+  ProjectStats getStats();
+};
+
+#endif // PROJECTFILE_HPP
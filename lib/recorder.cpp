@@ -0,0 +1,533 @@
+#include "recorder.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+static double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Recorder::Recorder() {
+
+}
+
+Recorder::~Recorder() {
+  stop();
+  closeOutput();
+}
+
+bool Recorder::start(DesktopCapture* source, const std::string fileName, RecorderConfig config) {
+  if (this->running || this->encodeThread.joinable()) {
+    std::cout << "Recorder is already running" << std::endl;
+    return false;
+  }
+
+  if (!source || !source->open()) {
+    std::cout << "Failed to open capture source" << std::endl;
+    return false;
+  }
+
+  this->source = source;
+  this->fileName = fileName;
+  this->config = config;
+  this->frameRate = source->getFrameRate();
+  this->captureFinished = false;
+  this->stats = RecorderStats();
+  this->fileWriter.reset();
+  this->fpsDivisor = 1;
+  this->lastForcedKeyframe = 0.0;
+  this->lastKeyframePts = 0.0;
+
+  // Start from the preset the previous auto-tuned recording settled on
+  if (config.autoTune && !this->tunedPreset.empty())
+    this->config.preset = this->tunedPreset;
+
+  if (!this->openOutput()) {
+    this->closeOutput();
+    source->close();
+    return false;
+  }
+  this->tuner.reset(this->frameRate, config.latencyBudget, this->liveCrf);
+
+  this->startTime = now();
+  this->running = true;
+  this->captureThread = std::thread(&Recorder::captureLoop, this);
+  this->encodeThread = std::thread(&Recorder::encodeLoop, this);
+  return true;
+}
+
+void Recorder::stop() {
+  this->running = false;
+  this->queueCondition.notify_all();
+  wait();
+}
+
+void Recorder::wait() {
+  if (this->captureThread.joinable())
+    this->captureThread.join();
+  if (this->encodeThread.joinable())
+    this->encodeThread.join();
+}
+
+bool Recorder::isRecording() {
+  return this->running;
+}
+
+void Recorder::forceKeyframe(double pts) {
+  this->requestedKeyframe = std::max(pts, 0.0);
+}
+
+RecorderStats Recorder::getStats() {
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  return this->stats;
+}
+
+// Empty moov up front, then a moof+mdat pair per fragment. Every fragment starts on a keyframe.
+static void setFragmentOptions(AVDictionary** options, double fragmentDuration) {
+  av_dict_set(options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+  av_dict_set_int(options, "frag_duration", (int64_t)(fragmentDuration * AV_TIME_BASE), 0);
+
+  // Push each finished fragment out right away so readers see it
+  av_dict_set(options, "flush_packets", "1", 0);
+}
+
+bool Recorder::openOutput() {
+  bool writeFile = !this->fileName.empty();
+
+  if (writeFile && (avformat_alloc_output_context2(&this->outputContext, NULL, NULL, this->fileName.c_str()) < 0 || !this->outputContext)) {
+    std::cout << "Could not deduce output format for " << this->fileName << std::endl;
+    return false;
+  }
+
+  if (!this->openEncoder()) {
+    return false;
+  }
+
+  if (this->config.replayBufferSeconds > 0.0 && !this->openReplayOutput()) {
+    return false;
+  }
+
+  if (!writeFile) {
+    if (!this->replayContext) {
+      std::cout << "Recorder has neither an output file nor a replay buffer" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  this->videoStream = avformat_new_stream(this->outputContext, NULL);
+  if (!this->videoStream) {
+    std::cout << "Failed to create output stream" << std::endl;
+    return false;
+  }
+  avcodec_parameters_from_context(this->videoStream->codecpar, this->encoderContext);
+  this->videoStream->time_base = this->encoderContext->time_base;
+
+  if (!(this->outputContext->oformat->flags & AVFMT_NOFILE)) {
+    // Replace an earlier recording instead of truncating it in place, a player may still
+    // have it mapped and would take SIGBUS on the pages cut off under it
+    std::remove(this->fileName.c_str());
+
+    if (this->config.asyncWriter) {
+      // Muxer only copies into memory, a writer thread owns the disk I/O
+      // The muxer flushes partial fragments and seeks back to patch headers, so its blocks
+      // never stay aligned for O_DIRECT
+      AsyncWriterConfig writerConfig = this->config.writerConfig;
+      writerConfig.directIO = false;
+      this->fileWriter.reset(new AsyncFileWriter());
+      if (!this->fileWriter->open(this->fileName, writerConfig)) {
+        return false;
+      }
+      this->outputContext->pb = this->fileWriter->createContext();
+      this->outputContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    } else if (avio_open(&this->outputContext->pb, this->fileName.c_str(), AVIO_FLAG_WRITE) < 0) {
+      std::cout << "Could not open output file " << this->fileName << std::endl;
+      return false;
+    }
+  }
+
+  AVDictionary* options = NULL;
+  std::string formatName = this->outputContext->oformat->name;
+  if (this->config.fragmented && (formatName.find("mp4") != std::string::npos || formatName.find("mov") != std::string::npos)) {
+    setFragmentOptions(&options, this->config.fragmentDuration);
+  }
+
+  int response = avformat_write_header(this->outputContext, &options);
+  av_dict_free(&options);
+  if (response < 0) {
+    std::cout << "Failed to write output header" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool Recorder::openReplayOutput() {
+  this->replayBuffer = std::make_shared<MemoryStream>(this->config.replayBufferSeconds);
+
+  if (avformat_alloc_output_context2(&this->replayContext, NULL, "mp4", NULL) < 0 || !this->replayContext) {
+    std::cout << "Could not create replay buffer muxer" << std::endl;
+    return false;
+  }
+
+  this->replayStream = avformat_new_stream(this->replayContext, NULL);
+  if (!this->replayStream) {
+    std::cout << "Failed to create replay buffer stream" << std::endl;
+    return false;
+  }
+  avcodec_parameters_from_context(this->replayStream->codecpar, this->encoderContext);
+  this->replayStream->time_base = this->encoderContext->time_base;
+
+  // Muxer writes fragments straight into the in-memory ring
+  this->replayIO = this->replayBuffer->createWriter();
+  this->replayContext->pb = this->replayIO;
+  this->replayContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+  AVDictionary* options = NULL;
+  setFragmentOptions(&options, this->config.fragmentDuration);
+  int response = avformat_write_header(this->replayContext, &options);
+  av_dict_free(&options);
+  if (response < 0) {
+    std::cout << "Failed to write replay buffer header" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+AsyncWriterStats Recorder::getWriterStats() {
+  if (!this->fileWriter) {
+    return AsyncWriterStats();
+  }
+  return this->fileWriter->getStats();
+}
+
+std::shared_ptr<MemoryStream> Recorder::getReplayBuffer() {
+  return this->replayBuffer;
+}
+
+bool Recorder::openEncoder() {
+  const AVCodec* codec = avcodec_find_encoder_by_name(this->config.encoderName.c_str());
+  if (!codec) {
+    std::cout << "Encoder " << this->config.encoderName << " not found, falling back to default H.264 encoder" << std::endl;
+    codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+  }
+  if (!codec) {
+    std::cout << "No H.264 encoder available" << std::endl;
+    return false;
+  }
+
+  this->encoderContext = avcodec_alloc_context3(codec);
+  this->encoderContext->width = this->source->getWidth();
+  this->encoderContext->height = this->source->getHeight();
+  this->encoderContext->pix_fmt = AV_PIX_FMT_YUV420P;
+  this->encoderContext->time_base = AVRational{ 1, this->frameRate };
+  this->encoderContext->framerate = AVRational{ this->frameRate, 1 };
+  this->encoderContext->gop_size = this->frameRate * 2;
+
+  // Keyframes are forced from frame pts in encodeFrame, the GOP size is only a backstop
+  if (this->config.keyframeInterval > 0.0) {
+    this->encoderContext->gop_size = std::max(1, (int)std::ceil(this->config.keyframeInterval * this->frameRate));
+    this->encoderContext->keyint_min = std::max(1, this->encoderContext->gop_size / 4);
+  }
+
+  // No B-frames, keeps encode latency and muxing simple
+  this->encoderContext->max_b_frames = 0;
+
+  // The replay buffer is always MP4, which wants global headers
+  bool globalHeader = this->config.replayBufferSeconds > 0.0 ||
+    (this->outputContext && (this->outputContext->oformat->flags & AVFMT_GLOBALHEADER));
+  if (globalHeader)
+    this->encoderContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+  // Unknown options are left in the dictionary by encoders that don't support them
+  AVDictionary* options = NULL;
+  av_dict_set(&options, "preset", this->config.preset.c_str(), 0);
+  av_dict_set_int(&options, "crf", this->config.crf, 0);
+
+  // Forced I frames become IDR frames so every forced keyframe is a clean cut point
+  av_dict_set(&options, "forced-idr", "1", 0);
+  // Each of libx264 and libx265 reads only its own params, so both are set
+  if (!this->config.sceneCutKeyframes) {
+    av_dict_set(&options, "x264-params", "scenecut=0", 0);
+    av_dict_set(&options, "x265-params", "scenecut=0", 0);
+  }
+
+  int response = avcodec_open2(this->encoderContext, codec, &options);
+  av_dict_free(&options);
+  if (response < 0) {
+    std::cout << "Failed to open encoder " << codec->name << std::endl;
+    return false;
+  }
+
+  // Only libx264 reconfigures itself when crf changes on an open encoder
+  this->liveCrf = strcmp(codec->name, "libx264") == 0;
+
+  this->frame = av_frame_alloc();
+  this->frame->format = this->encoderContext->pix_fmt;
+  this->frame->width = this->encoderContext->width;
+  this->frame->height = this->encoderContext->height;
+  if (av_frame_get_buffer(this->frame, 0) < 0) {
+    std::cout << "Failed to allocate encoder frame" << std::endl;
+    return false;
+  }
+
+  this->packet = av_packet_alloc();
+  return true;
+}
+
+void Recorder::closeOutput() {
+  if (this->outputContext) {
+    if (this->fileWriter) {
+      AsyncFileWriter::freeContext(&this->outputContext->pb);
+      this->fileWriter->close();
+    } else if (this->outputContext->pb && !(this->outputContext->oformat->flags & AVFMT_NOFILE)) {
+      avio_closep(&this->outputContext->pb);
+    }
+    avformat_free_context(this->outputContext);
+    this->outputContext = nullptr;
+  }
+  if (this->replayContext) {
+    avformat_free_context(this->replayContext);
+    this->replayContext = nullptr;
+  }
+  // The ring itself stays alive for readers, only the writer side goes away
+  MemoryStream::freeContext(&this->replayIO, false);
+  this->replayStream = nullptr;
+  avcodec_free_context(&this->encoderContext);
+  av_frame_free(&this->frame);
+  av_packet_free(&this->packet);
+  this->videoStream = nullptr;
+}
+
+void Recorder::captureLoop() {
+  uint64_t frameIndex = 0;
+
+  while (this->running) {
+    CaptureFrame captured;
+
+    double grabStart = now();
+    bool grabbed = this->source->grabFrame(captured);
+    double grabEnd = now();
+
+    if (!grabbed)
+      break;
+
+    {
+      std::lock_guard<std::mutex> lock(this->statsMutex);
+      this->stats.framesCaptured++;
+      this->stats.captureSeconds += grabEnd - grabStart;
+    }
+
+    if (frameIndex++ % this->fpsDivisor != 0) {
+      std::lock_guard<std::mutex> lock(this->statsMutex);
+      this->stats.framesDecimated++;
+      continue;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(this->queueMutex);
+      if (this->frameQueue.size() >= this->config.queueCapacity) {
+        if (this->config.dropWhenFull) {
+          std::lock_guard<std::mutex> statsLock(this->statsMutex);
+          this->stats.framesDropped++;
+          continue;
+        }
+
+        // Offline sources wait for the encoder instead of dropping
+        this->queueCondition.wait(lock, [this] { return this->frameQueue.size() < this->config.queueCapacity || !this->running; });
+      }
+      this->frameQueue.push(std::move(captured));
+    }
+    this->queueCondition.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->queueMutex);
+    this->captureFinished = true;
+  }
+  this->queueCondition.notify_all();
+  this->source->close();
+}
+
+void Recorder::encodeLoop() {
+  while (true) {
+    CaptureFrame captured;
+    size_t queueDepth;
+
+    {
+      std::unique_lock<std::mutex> lock(this->queueMutex);
+      this->queueCondition.wait(lock, [this] { return !this->frameQueue.empty() || this->captureFinished; });
+      if (this->frameQueue.empty())
+        break;
+      queueDepth = this->frameQueue.size();
+      captured = std::move(this->frameQueue.front());
+      this->frameQueue.pop();
+    }
+    this->queueCondition.notify_all();
+
+    double encodeStart = now();
+    bool encoded = this->encodeFrame(&captured);
+    double encodeEnd = now();
+
+    {
+      std::lock_guard<std::mutex> lock(this->statsMutex);
+      this->stats.encodeSeconds += encodeEnd - encodeStart;
+      this->stats.elapsedSeconds = encodeEnd - this->startTime;
+    }
+
+    if (!encoded) {
+      std::cout << "Encoding failed, stopping recording" << std::endl;
+      this->running = false;
+      this->queueCondition.notify_all();
+      break;
+    }
+
+    if (this->config.autoTune) {
+      TunerDecision decision = this->tuner.observe(queueDepth, encodeEnd - encodeStart);
+      if (decision.changed)
+        this->applyTuning(decision);
+    }
+  }
+
+  if (this->config.autoTune) {
+    this->tunedPreset = this->tuner.suggestPreset(this->config.preset);
+    if (this->tunedPreset != this->config.preset)
+      std::cout << "[Tuner]: Next recording will use preset " << this->tunedPreset << " (was " << this->config.preset << ")" << std::endl;
+  }
+
+  // Drain delayed packets and finalize the file
+  this->encodeFrame(nullptr);
+  if (this->outputContext)
+    av_write_trailer(this->outputContext);
+  if (this->replayContext)
+    av_write_trailer(this->replayContext);
+  this->closeOutput();
+  this->requestedKeyframe = -1.0;
+
+  {
+    std::lock_guard<std::mutex> lock(this->statsMutex);
+    this->stats.elapsedSeconds = now() - this->startTime;
+  }
+  this->running = false;
+}
+
+void Recorder::applyTuning(const TunerDecision& decision) {
+  int crf = this->config.crf + decision.settings.crfOffset;
+  int fps = this->frameRate / decision.settings.fpsDivisor;
+
+  // libx264 picks up a changed crf on the next frame. Other encoders get an fps-only ladder from
+  // the tuner, so the crf stays what the encoder was opened with.
+  std::string crfNote = "crf " + std::to_string(this->config.crf) + " unchanged";
+  if (this->liveCrf) {
+    if (av_opt_set_double(this->encoderContext->priv_data, "crf", crf, 0) >= 0) {
+      crfNote = "crf " + std::to_string(crf);
+    } else {
+      crfNote = "crf " + std::to_string(crf) + " refused by " + this->encoderContext->codec->name;
+    }
+  }
+  this->fpsDivisor = decision.settings.fpsDivisor;
+
+  std::cout << "[Tuner]: Level " << decision.level << " (" << crfNote << ", " << fps << " fps): " << decision.reason << std::endl;
+
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  this->stats.tunerLevel = decision.level;
+}
+
+bool Recorder::encodeFrame(const CaptureFrame* captured) {
+  int response;
+
+  if (captured) {
+    if (captured->width != this->frame->width || captured->height != this->frame->height) {
+      std::cout << "Capture size changed mid-recording, skipping frame" << std::endl;
+      return true;
+    }
+
+    if (av_frame_make_writable(this->frame) < 0)
+      return false;
+
+    // Copy planes row by row, linesizes may differ
+    for (int i = 0; i < 3; i++) {
+      int planeWidth = i == 0 ? captured->width : captured->width / 2;
+      int planeHeight = i == 0 ? captured->height : captured->height / 2;
+      for (int y = 0; y < planeHeight; y++) {
+        memcpy(this->frame->data[i] + y * this->frame->linesize[i], captured->data[i].data() + y * captured->linesize[i], planeWidth);
+      }
+    }
+
+    this->frame->pts = llround(captured->pts * this->frameRate);
+    this->frame->pict_type = AV_PICTURE_TYPE_NONE;
+
+    bool intervalElapsed = this->config.keyframeInterval > 0.0 &&
+      captured->pts - this->lastForcedKeyframe >= this->config.keyframeInterval;
+    double requested = this->requestedKeyframe;
+    bool requestDue = requested >= 0.0 && captured->pts >= requested;
+    if (requestDue || intervalElapsed) {
+      this->frame->pict_type = AV_PICTURE_TYPE_I;
+      this->lastForcedKeyframe = captured->pts;
+    }
+    // A newer request that came in meanwhile is kept
+    if (requestDue && this->requestedKeyframe.compare_exchange_strong(requested, -1.0)) {
+      std::lock_guard<std::mutex> lock(this->statsMutex);
+      this->stats.requestedKeyframePts = captured->pts;
+    }
+
+    response = avcodec_send_frame(this->encoderContext, this->frame);
+  } else {
+    response = avcodec_send_frame(this->encoderContext, NULL);
+  }
+
+  if (response < 0) {
+    fprintf(stderr, "Error sending frame to encoder\n");
+    return false;
+  }
+
+  return this->writePackets();
+}
+
+bool Recorder::writePackets() {
+  int response;
+
+  while ((response = avcodec_receive_packet(this->encoderContext, this->packet)) == 0) {
+    int size = this->packet->size;
+    bool keyframe = this->packet->flags & AV_PKT_FLAG_KEY;
+    double packetPts = this->packet->pts * av_q2d(this->encoderContext->time_base);
+
+    if (this->replayContext) {
+      AVPacket* replayPacket = av_packet_clone(this->packet);
+      av_packet_rescale_ts(replayPacket, this->encoderContext->time_base, this->replayStream->time_base);
+      replayPacket->stream_index = this->replayStream->index;
+      int written = av_interleaved_write_frame(this->replayContext, replayPacket);
+      av_packet_free(&replayPacket);
+      if (written < 0) {
+        fprintf(stderr, "Error writing packet to replay buffer\n");
+        return false;
+      }
+    }
+
+    if (this->outputContext) {
+      av_packet_rescale_ts(this->packet, this->encoderContext->time_base, this->videoStream->time_base);
+      this->packet->stream_index = this->videoStream->index;
+      if (av_interleaved_write_frame(this->outputContext, this->packet) < 0) {
+        fprintf(stderr, "Error writing packet\n");
+        return false;
+      }
+    } else {
+      av_packet_unref(this->packet);
+    }
+
+    std::lock_guard<std::mutex> lock(this->statsMutex);
+    this->stats.framesEncoded++;
+    this->stats.bytesWritten += size;
+    if (keyframe) {
+      this->stats.keyframes++;
+      this->lastKeyframePts = packetPts;
+    }
+    this->stats.maxKeyframeGap = std::max(this->stats.maxKeyframeGap, packetPts - this->lastKeyframePts);
+  }
+
+  return response == AVERROR(EAGAIN) || response == AVERROR_EOF;
+}
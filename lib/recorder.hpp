@@ -0,0 +1,144 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include "desktop_capture.hpp"
+#include "encoder_tuner.hpp"
+#include "memory_stream.hpp"
+#include "async_file_writer.hpp"
+#include <string>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+
+struct RecorderConfig {
+  std::string encoderName = "libx264";
+  std::string preset = "veryfast";
+  int crf = 23;
+
+  // Frames waiting for the encoder before capture starts dropping
+  size_t queueCapacity = 8;
+
+  // Drop frames when the queue is full (live sources) instead of blocking capture (synthetic/offline)
+  bool dropWhenFull = true;
+
+  // Maximum seconds between keyframes (0 = encoder default). Bounds seek decode cost and stream-copy cut error.
+  double keyframeInterval = 1.0;
+
+  // Let the encoder insert extra keyframes on scene changes
+  bool sceneCutKeyframes = true;
+
+  // Write MP4 as short self-contained fragments. The file stays readable while it grows
+  // and survives a crash, at the cost of a slightly larger index.
+  bool fragmented = true;
+  double fragmentDuration = 1.0;
+
+  // Write the file from a dedicated I/O thread (io_uring/pwrite) instead of libavformat's file protocol
+  bool asyncWriter = false;
+  AsyncWriterConfig writerConfig;
+
+  // Seconds of video kept in an in-memory replay ring for instant review (0 = disabled)
+  double replayBufferSeconds = 0.0;
+
+  // Step crf and capture fps at runtime to keep capture-to-mux latency under latencyBudget
+  bool autoTune = false;
+  double latencyBudget = 0.25;
+};
+
+struct RecorderStats {
+  uint64_t framesCaptured = 0;
+  uint64_t framesEncoded = 0;
+  uint64_t framesDropped = 0;
+  uint64_t framesDecimated = 0; // Skipped on purpose by the tuner's fps divisor
+  uint64_t bytesWritten = 0;
+  double captureSeconds = 0.0; // Time spent inside the capture source
+  double encodeSeconds = 0.0;  // Time spent inside the encoder and muxer
+  double elapsedSeconds = 0.0;
+  int tunerLevel = 0;
+  uint64_t keyframes = 0;
+  double maxKeyframeGap = 0.0; // Longest GOP written so far, in seconds
+  double requestedKeyframePts = -1.0; // Where the last forceKeyframe() request landed
+};
+
+// Pulls frames from a capture source, encodes and muxes them to a file
+class Recorder {
+private:
+  DesktopCapture* source = nullptr;
+  RecorderConfig config;
+  std::string fileName;
+  AVFormatContext* outputContext = nullptr;
+  AVCodecContext* encoderContext = nullptr;
+  AVStream* videoStream = nullptr;
+  AVFrame* frame = nullptr;
+  AVPacket* packet = nullptr;
+  int frameRate = 0;
+
+  // In-memory replay ring, fed by a second fragmented MP4 muxer
+  std::shared_ptr<MemoryStream> replayBuffer;
+  AVFormatContext* replayContext = nullptr;
+  AVStream* replayStream = nullptr;
+  AVIOContext* replayIO = nullptr;
+
+  std::unique_ptr<AsyncFileWriter> fileWriter;
+
+  std::thread captureThread;
+  std::thread encodeThread;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  std::queue<CaptureFrame> frameQueue;
+  std::atomic<bool> running{false};
+  bool captureFinished = false;
+
+  std::mutex statsMutex;
+  RecorderStats stats;
+  double startTime = 0.0;
+
+  EncoderTuner tuner;
+  bool liveCrf = false;
+  std::atomic<int> fpsDivisor{1};
+  std::string tunedPreset;
+  void applyTuning(const TunerDecision& decision);
+
+  std::atomic<double> requestedKeyframe{-1.0}; // Capture pts to force a keyframe at, -1 if none
+  double lastForcedKeyframe = 0.0;
+  double lastKeyframePts = 0.0;
+
+  bool openOutput();
+  bool openReplayOutput();
+  bool openEncoder();
+  void closeOutput();
+  void captureLoop();
+  void encodeLoop();
+  bool encodeFrame(const CaptureFrame* captured);
+  bool writePackets();
+
+public:
+  Recorder();
+  ~Recorder();
+  bool start(DesktopCapture* source, const std::string fileName, RecorderConfig config = RecorderConfig());
+  void stop();
+  void wait();
+  bool isRecording();
+
+  // Make the first frame at or after pts (capture time, the recording's own timeline) an IDR frame,
+  // e.g. where the user drops a clip. A pts already passed lands on the next frame. Can be asked
+  // before start(), a request is dropped once the recording ends.
+  void forceKeyframe(double pts);
+
+  // Ring of the last replayBufferSeconds, open it with MediaPlayer::loadStream. Empty file name = ring only.
+  std::shared_ptr<MemoryStream> getReplayBuffer();
+  RecorderStats getStats();
+
+  // Throughput and queue depth of the output writer thread
+  AsyncWriterStats getWriterStats();
+};
+
+#endif // RECORDER_HPP
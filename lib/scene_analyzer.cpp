@@ -0,0 +1,271 @@
+#include "scene_analyzer.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+  typedef uint64_t (*SadKernel)(const uint8_t* a, const uint8_t* b, size_t count);
+
+  uint64_t sadScalar(const uint8_t* a, const uint8_t* b, size_t count) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++)
+      total += std::abs((int)a[i] - (int)b[i]);
+    return total;
+  }
+
+#if defined(__SSE2__)
+  uint64_t sadSse(const uint8_t* a, const uint8_t* b, size_t count) {
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+      __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+      sum = _mm_add_epi64(sum, _mm_sad_epu8(x, y));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, sum);
+    return lanes[0] + lanes[1] + sadScalar(a + i, b + i, count - i);
+  }
+#endif
+
+#if defined(__x86_64__)
+  // psadbw sums 8 byte differences into each 64 bit lane, 32 pixels per step
+  __attribute__((target("avx2")))
+  uint64_t sadAvx2(const uint8_t* a, const uint8_t* b, size_t count) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+      __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+      __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+      sum = _mm256_add_epi64(sum, _mm256_sad_epu8(x, y));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sadScalar(a + i, b + i, count - i);
+  }
+#endif
+
+  SadKernel selectKernel() {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+      return sadAvx2;
+#endif
+#if defined(__SSE2__)
+    return sadSse;
+#else
+    return sadScalar;
+#endif
+  }
+
+  const SadKernel sumAbsDiff = selectKernel();
+}
+
+SceneAnalyzer::SceneAnalyzer() {
+
+}
+
+SceneAnalyzer::~SceneAnalyzer() {
+  this->close();
+}
+
+bool SceneAnalyzer::open(const std::string& fileName) {
+  this->close();
+  this->decoder.setScanMode(this->scanThreads, true);
+  return this->start(this->decoder.open(fileName, this->analysisWidth, AV_PIX_FMT_GRAY8));
+}
+
+bool SceneAnalyzer::open(std::shared_ptr<MemoryStream> stream) {
+  this->close();
+  this->decoder.setScanMode(this->scanThreads, true);
+  return this->start(this->decoder.open(stream, this->analysisWidth, AV_PIX_FMT_GRAY8));
+}
+
+bool SceneAnalyzer::start(bool opened) {
+  if (!opened) {
+    return false;
+  }
+
+  this->running = true;
+  this->worker = std::thread(&SceneAnalyzer::workLoop, this);
+  return true;
+}
+
+void SceneAnalyzer::close() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->running = false;
+  }
+  this->condition.notify_all();
+  if (this->worker.joinable())
+    this->worker.join();
+
+  this->decoder.close();
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->atEnd = false;
+  this->endFrameCount = 0;
+  this->index = nullptr;
+  this->bookmarks.clear();
+  this->stillSpans.clear();
+  this->stillStart = -1.0;
+  this->version++;
+  this->stats = SceneStats();
+  this->previous.clear();
+  this->lastPts = -1.0;
+  this->lastCut = -1e9;
+  this->lastMotion = -1e9;
+  this->fastSad = 0.0f;
+  this->slowSad = -1.0f;
+  this->inMotion = false;
+}
+
+void SceneAnalyzer::workLoop() {
+  double busySeconds = 0.0;
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  while (this->running) {
+    if (this->atEnd) {
+      // Caught up, pick up again once the recording has grown
+      if (!this->index || this->index->getFrameCount() <= this->endFrameCount) {
+        this->condition.wait(lock);
+        continue;
+      }
+      this->atEnd = false;
+      lock.unlock();
+      bool reopened = this->decoder.reopen();
+      lock.lock();
+      if (!reopened) {
+        this->atEnd = true;
+        this->endFrameCount = this->index->getFrameCount();
+        continue;
+      }
+    }
+    lock.unlock();
+
+    // Everything after the last analyzed frame up to whatever the demuxer sees now
+    auto scanStart = std::chrono::steady_clock::now();
+    double start = this->lastPts < 0.0 ? 0.0 : this->lastPts + 1e-6;
+    this->decoder.decodeRange(start, INFINITY, [&](std::shared_ptr<Thumbnail> frame) {
+      double busy = busySeconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - scanStart).count();
+      std::lock_guard<std::mutex> guard(this->mutex);
+      this->analyze(*frame);
+      this->stats.framesAnalyzed++;
+      this->stats.analyzedSeconds = frame->pts;
+      if (busy > 0.0) {
+        this->stats.fps = this->stats.framesAnalyzed / busy;
+        this->stats.speed = this->stats.analyzedSeconds / busy;
+      }
+      return this->running;
+    });
+    busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - scanStart).count();
+
+    lock.lock();
+    this->atEnd = true;
+    this->endFrameCount = this->index ? this->index->getFrameCount() : 0;
+    this->version++; // The open still span reaches the end now
+  }
+}
+
+void SceneAnalyzer::analyze(const Thumbnail& frame) {
+  const uint8_t* luma = frame.pixels.data();
+  size_t count = (size_t)frame.width * frame.height;
+  uint32_t histogram[HISTOGRAM_BINS] = {};
+  for (size_t i = 0; i < count; i++)
+    histogram[luma[i] * HISTOGRAM_BINS / 256]++;
+
+  if (this->previous.size() == count && count > 0) {
+    float sad = (float)sumAbsDiff(luma, this->previous.data(), count) / count;
+    uint32_t distance = 0;
+    for (int bin = 0; bin < HISTOGRAM_BINS; bin++)
+      distance += std::abs((int)histogram[bin] - (int)this->previousHistogram[bin]);
+    float histogramDistance = distance / (2.0f * count);
+
+    // A cut changes both what the frame contains and where it is
+    bool cut = histogramDistance > this->cutDistance && sad > this->cutMinSad;
+    if (cut && frame.pts - this->lastCut >= this->cutSpacing) {
+      this->bookmarks.push_back({ frame.pts, BookmarkKind::SceneCut, histogramDistance });
+      this->version++;
+      this->lastCut = frame.pts;
+    }
+
+    // Motion: a short average well above the long running one, bookmarked where the burst starts.
+    // Cut frames are left out so every cut doesn't also count as motion.
+    if (!cut) {
+      if (this->slowSad < 0.0f)
+        this->slowSad = sad;
+      this->fastSad += (sad - this->fastSad) * this->fastRate;
+      this->slowSad += (sad - this->slowSad) * this->slowRate;
+      bool moving = this->fastSad > this->motionMinSad && this->fastSad > this->slowSad * this->motionRatio;
+      if (moving && !this->inMotion && frame.pts - this->lastMotion >= this->motionSpacing) {
+        this->bookmarks.push_back({ frame.pts, BookmarkKind::Motion, this->fastSad });
+        this->version++;
+        this->lastMotion = frame.pts;
+      }
+      this->inMotion = moving;
+    }
+
+    // Still since the previous frame, or a still stretch just ended
+    if (sad < this->stillSad) {
+      if (this->stillStart < 0.0)
+        this->stillStart = this->lastPts;
+    } else if (this->stillStart >= 0.0) {
+      if (frame.pts - this->stillStart >= this->minStill) {
+        this->stillSpans.push_back({ this->stillStart, frame.pts });
+        this->version++;
+      }
+      this->stillStart = -1.0;
+    }
+  }
+
+  this->previous.assign(luma, luma + count);
+  memcpy(this->previousHistogram, histogram, sizeof(histogram));
+  this->lastPts = frame.pts;
+}
+
+void SceneAnalyzer::setIndex(std::shared_ptr<const TimelineIndex> index) {
+  if (!index) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (index == this->index) {
+    return;
+  }
+  this->index = index;
+  if (this->atEnd)
+    this->condition.notify_one();
+}
+
+uint64_t SceneAnalyzer::getVersion() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->version;
+}
+
+std::vector<Bookmark> SceneAnalyzer::getBookmarks() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->bookmarks;
+}
+
+std::vector<TimeSpan> SceneAnalyzer::getStillSpans() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::vector<TimeSpan> spans = this->stillSpans;
+  if (this->stillStart >= 0.0 && this->lastPts - this->stillStart >= this->minStill)
+    spans.push_back({ this->stillStart, this->lastPts });
+  return spans;
+}
+
+SceneStats SceneAnalyzer::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->stats;
+}
+
+bool SceneAnalyzer::isFinished() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return !this->running || (this->atEnd && this->index && this->index->getFrameCount() <= this->endFrameCount);
+}
@@ -0,0 +1,95 @@
+#ifndef SCENEANALYZER_HPP
+#define SCENEANALYZER_HPP
+
+#include "thumbnail_decoder.hpp"
+#include "timeline_index.hpp"
+#include "bookmark.hpp"
+#include "time_span.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+struct SceneStats {
+  uint64_t framesAnalyzed = 0;
+  double analyzedSeconds = 0.0; // Of the recording
+  double fps = 0.0;             // Frames analyzed per second of work
+  double speed = 0.0;           // Recording seconds per second of work
+};
+
+// Scans a recording on its own thread and bookmarks scene cuts and bursts of motion, and
+// notes the stretches where nothing moves (dead time candidates).
+// Frames are decoded without deblocking or B-frames and downscaled to a small luma image, then
+// compared with the previous one: histogram distance finds cuts, mean absolute
+// difference (SAD, AVX2 where available) tracks motion. Keeps up with a growing recording.
+class SceneAnalyzer {
+private:
+  const int analysisWidth = 64;
+  static constexpr int HISTOGRAM_BINS = 64;
+  const float cutDistance = 0.35f;   // Half the L1 distance of the normalized histograms
+  const float cutMinSad = 12.0f;     // Fades and flashes move the histogram but not the pixels much
+  const double cutSpacing = 1.0;
+  const float motionMinSad = 10.0f;  // Mean absolute luma difference per pixel
+  const float motionRatio = 2.5f;    // Over the recording's running baseline
+  const double motionSpacing = 5.0;
+  const float stillSad = 1.5f;       // Under this a frame counts as unchanged, encoder noise included
+  const double minStill = 2.0;
+  const float fastRate = 0.2f;       // Per frame, a handful of frames
+  const float slowRate = 0.005f;     // Per frame, several seconds
+  const int scanThreads = 4;         // Enough to stay well ahead of realtime at 1080p
+
+  ThumbnailDecoder decoder;
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool running = false;
+  bool atEnd = false;
+  size_t endFrameCount = 0; // Index size when the end was hit, grows while recording
+  std::shared_ptr<const TimelineIndex> index;
+
+  std::vector<Bookmark> bookmarks;
+  std::vector<TimeSpan> stillSpans;
+  uint64_t version = 0;
+  SceneStats stats;
+
+  // Detector state, touched by the worker with the lock held
+  std::vector<uint8_t> previous;
+  uint32_t previousHistogram[HISTOGRAM_BINS];
+  double lastPts = -1.0;
+  double lastCut = -1e9;
+  double lastMotion = -1e9;
+  float fastSad = 0.0f;
+  float slowSad = -1.0f; // Seeded with the first frame pair
+  bool inMotion = false;
+  double stillStart = -1.0;
+
+  bool start(bool opened);
+  void workLoop();
+  void analyze(const Thumbnail& frame);
+
+public:
+  SceneAnalyzer();
+  ~SceneAnalyzer();
+  bool open(const std::string& fileName);
+  bool open(std::shared_ptr<MemoryStream> stream);
+  void close();
+
+  // Latest index, the scan resumes when the recording has grown past where it ended
+  void setIndex(std::shared_ptr<const TimelineIndex> index);
+
+  // Bumped whenever bookmarks or spans are added, so callers only copy them when something changed
+  uint64_t getVersion();
+  std::vector<Bookmark> getBookmarks();
+
+  // Where frames barely change, including the one still going where the scan is
+  std::vector<TimeSpan> getStillSpans();
+  SceneStats getStats();
+
+  // Caught up with the whole index, for batch runs that wait for the scan to end
+  bool isFinished();
+};
+
+#endif // SCENEANALYZER_HPP
@@ -0,0 +1,59 @@
+#include "source_identity.hpp"
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+  constexpr uint32_t PREFIX_BYTES = 64 * 1024;
+
+  // FNV-1a over the first count bytes, false if the file is shorter than that
+  bool hashPrefix(int fd, uint32_t count, uint64_t* hash) {
+    std::vector<uint8_t> buffer(count);
+    if (count > 0 && pread(fd, buffer.data(), count, 0) != (ssize_t)count) {
+      return false;
+    }
+
+    uint64_t value = 0xcbf29ce484222325ULL;
+    for (uint8_t byte : buffer) {
+      value ^= byte;
+      value *= 0x100000001b3ULL;
+    }
+    *hash = value;
+    return true;
+  }
+}
+
+bool readSourceIdentity(const std::string& path, SourceIdentity* identity) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  bool read = fstat(fd, &st) == 0;
+  if (read) {
+    identity->size = st.st_size;
+    identity->prefixBytes = (uint32_t)std::min<uint64_t>(st.st_size, PREFIX_BYTES);
+    identity->reserved = 0;
+    read = hashPrefix(fd, identity->prefixBytes, &identity->prefixHash);
+  }
+  ::close(fd);
+  return read;
+}
+
+bool isSameSource(const SourceIdentity& stored, const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Hash the same number of bytes as back then, a shorter file can't be the same one
+  struct stat st;
+  uint64_t hash = 0;
+  bool same = fstat(fd, &st) == 0 && (uint64_t)st.st_size >= stored.size
+    && hashPrefix(fd, stored.prefixBytes, &hash) && hash == stored.prefixHash;
+  ::close(fd);
+  return same;
+}
@@ -0,0 +1,23 @@
+#ifndef SOURCEIDENTITY_HPP
+#define SOURCEIDENTITY_HPP
+
+#include <string>
+#include <cstdint>
+
+// What a sidecar remembers about the recording it was built from. Recordings are still
+// growing while they are followed, so this is a hash of the first bytes (header and first
+// fragment) plus the size at the time: the same file grown further still matches, a
+// replaced or re-recorded one doesn't.
+struct SourceIdentity {
+  uint64_t size = 0;
+  uint64_t prefixHash = 0;
+  uint32_t prefixBytes = 0;
+  uint32_t reserved = 0;
+};
+
+bool readSourceIdentity(const std::string& path, SourceIdentity* identity);
+
+// Whether path is still the file stored was read from, possibly grown since
+bool isSameSource(const SourceIdentity& stored, const std::string& path);
+
+#endif // SOURCEIDENTITY_HPP
@@ -0,0 +1,50 @@
+#include "string_arena.hpp"
+#include <cstring>
+#include <algorithm>
+
+uint32_t StringArena::intern(std::string_view text) {
+  auto found = this->lookup.find(text);
+  if (found != this->lookup.end()) {
+    return found->second;
+  }
+
+  // Start a new block when this one is full. Oversized strings get one to themselves,
+  // which also closes the current block, they don't happen with names.
+  size_t needed = text.size() + 1;
+  if (this->blockUsed + needed > BLOCK_SIZE) {
+    size_t size = std::max(needed, BLOCK_SIZE);
+    this->blocks.push_back(std::make_unique<char[]>(size));
+    this->memoryBytes += size;
+    this->blockUsed = 0;
+  }
+
+  char* copy = this->blocks.back().get() + this->blockUsed;
+  std::memcpy(copy, text.data(), text.size());
+  copy[text.size()] = '\0';
+  this->blockUsed = needed > BLOCK_SIZE ? BLOCK_SIZE : this->blockUsed + needed;
+
+  uint32_t id = (uint32_t)this->strings.size();
+  this->strings.push_back(copy);
+  this->lookup.emplace(std::string_view(copy, text.size()), id);
+  return id;
+}
+
+const char* StringArena::get(uint32_t id) const {
+  return id < this->strings.size() ? this->strings[id] : "";
+}
+
+size_t StringArena::size() const {
+  return this->strings.size();
+}
+
+size_t StringArena::getMemoryBytes() const {
+  return this->memoryBytes;
+}
+
+void StringArena::clear() {
+  this->blocks.clear();
+  this->blockUsed = BLOCK_SIZE;
+  this->memoryBytes = 0;
+  this->strings.clear();
+  this->lookup.clear();
+}
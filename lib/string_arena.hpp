@@ -0,0 +1,32 @@
+#ifndef STRINGARENA_HPP
+#define STRINGARENA_HPP
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Append-only storage for short strings such as clip names. Interning the same text twice
+// gives the same id, so thousands of clips called "Clip" share one copy. Strings live in
+// large blocks that never move: ids and the pointers they resolve to stay valid until clear.
+class StringArena {
+private:
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> blocks;
+  size_t blockUsed = BLOCK_SIZE;
+  size_t memoryBytes = 0;
+  std::vector<const char*> strings;                    // By id, null terminated
+  std::unordered_map<std::string_view, uint32_t> lookup; // Views into the blocks
+
+public:
+  uint32_t intern(std::string_view text);
+  const char* get(uint32_t id) const;
+  size_t size() const;
+  size_t getMemoryBytes() const;
+  void clear();
+};
+
+#endif // STRINGARENA_HPP
@@ -0,0 +1,170 @@
+#include "synthetic_capture.hpp"
+#include <iostream>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+// Small deterministic hash so every frame only depends on (seed, frame, position)
+static inline uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+SyntheticCapture::SyntheticCapture(SyntheticCaptureConfig config) {
+    // Chroma planes are subsampled, keep dimensions even
+    config.width = std::max(2, config.width & ~1);
+    config.height = std::max(2, config.height & ~1);
+    config.fps = std::max(1, config.fps);
+    this->config = config;
+}
+
+bool SyntheticCapture::open() {
+    this->frameIndex = 0;
+    this->startTime = std::chrono::steady_clock::now();
+    return true;
+}
+
+void SyntheticCapture::close() {
+
+}
+
+bool SyntheticCapture::grabFrame(CaptureFrame& frame) {
+    if (this->config.frameCount > 0 && this->frameIndex >= this->config.frameCount) {
+        return false;
+    }
+
+    if (this->config.realtime) {
+        auto due = this->startTime + std::chrono::microseconds(this->frameIndex * 1000000 / this->config.fps);
+        std::this_thread::sleep_until(due);
+    }
+
+    frame.width = this->config.width;
+    frame.height = this->config.height;
+    frame.linesize[0] = frame.width;
+    frame.linesize[1] = frame.width / 2;
+    frame.linesize[2] = frame.width / 2;
+    frame.data[0].resize(frame.linesize[0] * frame.height);
+    frame.data[1].resize(frame.linesize[1] * frame.height / 2);
+    frame.data[2].resize(frame.linesize[2] * frame.height / 2);
+    frame.pts = (double)this->frameIndex / this->config.fps;
+
+    switch (this->config.content) {
+        case SyntheticContent::Static: drawStatic(frame); break;
+        case SyntheticContent::ScrollingText: drawScrollingText(frame); break;
+        case SyntheticContent::Noise: drawNoise(frame); break;
+    }
+
+    this->frameIndex++;
+    return true;
+}
+
+void SyntheticCapture::drawStatic(CaptureFrame& frame) {
+    // SMPTE-like bars: white, yellow, cyan, green, magenta, red, blue
+    static const uint8_t bars[7][3] = {
+        { 235, 128, 128 }, { 210, 16, 146 }, { 170, 166, 16 }, { 145, 54, 34 },
+        { 106, 202, 222 }, { 81, 90, 240 }, { 41, 240, 110 }
+    };
+
+    for (int y = 0; y < frame.height; y++) {
+        uint8_t* row = frame.data[0].data() + y * frame.linesize[0];
+        for (int x = 0; x < frame.width; x++)
+            row[x] = bars[x * 7 / frame.width][0];
+    }
+
+    for (int y = 0; y < frame.height / 2; y++) {
+        uint8_t* rowU = frame.data[1].data() + y * frame.linesize[1];
+        uint8_t* rowV = frame.data[2].data() + y * frame.linesize[2];
+        for (int x = 0; x < frame.width / 2; x++) {
+            int bar = x * 2 * 7 / frame.width;
+            rowU[x] = bars[bar][1];
+            rowV[x] = bars[bar][2];
+        }
+    }
+}
+
+void SyntheticCapture::drawScrollingText(CaptureFrame& frame) {
+    const int glyphWidth = 8;
+    const int glyphHeight = 16;
+    const int scrollSpeed = 2; // Pixels per frame
+    int scroll = (int)(this->frameIndex * scrollSpeed);
+
+    for (int y = 0; y < frame.height; y++) {
+        uint8_t* row = frame.data[0].data() + y * frame.linesize[0];
+        int docY = y + scroll;
+        int line = docY / glyphHeight;
+        int glyphY = docY % glyphHeight;
+
+        for (int x = 0; x < frame.width; x++) {
+            int column = x / glyphWidth;
+            int glyphX = x % glyphWidth;
+            uint32_t glyph = hash32(this->config.seed ^ (line * 131 + column));
+
+            // Leave some cells and the glyph margins empty so it reads like text
+            bool blank = (glyph & 7) == 0 || glyphX == 0 || glyphY < 3 || glyphY > 12;
+            bool ink = !blank && (hash32(glyph + glyphX + (glyphY / 2) * 8) & 1);
+            row[x] = ink ? 16 : 235;
+        }
+    }
+
+    memset(frame.data[1].data(), 128, frame.data[1].size());
+    memset(frame.data[2].data(), 128, frame.data[2].size());
+}
+
+void SyntheticCapture::drawNoise(CaptureFrame& frame) {
+    uint32_t state = hash32(this->config.seed ^ (uint32_t)(this->frameIndex * 2654435761u)) | 1;
+
+    for (int plane = 0; plane < 3; plane++) {
+        uint8_t* data = frame.data[plane].data();
+        size_t size = frame.data[plane].size();
+
+        // xorshift32, four bytes per step
+        size_t i = 0;
+        for (; i + 4 <= size; i += 4) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            memcpy(data + i, &state, 4);
+        }
+        for (; i < size; i++) {
+            data[i] = (uint8_t)hash32(state + i);
+        }
+    }
+}
+
+int SyntheticCapture::getWidth() {
+    return this->config.width;
+}
+
+int SyntheticCapture::getHeight() {
+    return this->config.height;
+}
+
+int SyntheticCapture::getFrameRate() {
+    return this->config.fps;
+}
+
+std::string SyntheticCapture::contentToString(SyntheticContent content) {
+    switch (content) {
+        case SyntheticContent::Static: return "static";
+        case SyntheticContent::ScrollingText: return "text";
+        case SyntheticContent::Noise: return "noise";
+        default: return "unknown";
+    }
+}
+
+bool SyntheticCapture::contentFromString(const std::string& name, SyntheticContent* content) {
+    if (name == "static") {
+        *content = SyntheticContent::Static;
+    } else if (name == "text") {
+        *content = SyntheticContent::ScrollingText;
+    } else if (name == "noise") {
+        *content = SyntheticContent::Noise;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef SYNTHETICCAPTURE_HPP
+#define SYNTHETICCAPTURE_HPP
+
+#include "desktop_capture.hpp"
+#include <chrono>
+
+enum class SyntheticContent {
+    Static,         // Color bars, identical every frame
+    ScrollingText,  // Glyph-like blocks scrolling upwards (sharp edges, small motion)
+    Noise           // Full-motion random noise (worst case for the encoder)
+};
+
+struct SyntheticCaptureConfig {
+    int width = 1920;
+    int height = 1080;
+    int fps = 60;
+    SyntheticContent content = SyntheticContent::Static;
+    uint32_t seed = 1;
+
+    // Number of frames to produce before grabFrame returns false (0 = unlimited)
+    uint64_t frameCount = 0;
+
+    // Pace grabFrame to the wall clock like a real display would
+    bool realtime = false;
+};
+
+// Deterministic test-pattern source so recording can be measured without a display
+class SyntheticCapture : public DesktopCapture {
+private:
+    SyntheticCaptureConfig config;
+    uint64_t frameIndex = 0;
+    std::chrono::steady_clock::time_point startTime;
+
+    void drawStatic(CaptureFrame& frame);
+    void drawScrollingText(CaptureFrame& frame);
+    void drawNoise(CaptureFrame& frame);
+
+public:
+    SyntheticCapture(SyntheticCaptureConfig config);
+    bool open() override;
+    void close() override;
+    bool grabFrame(CaptureFrame& frame) override;
+    int getWidth() override;
+    int getHeight() override;
+    int getFrameRate() override;
+    static std::string contentToString(SyntheticContent content);
+    static bool contentFromString(const std::string& name, SyntheticContent* content);
+};
+
+#endif // SYNTHETICCAPTURE_HPP
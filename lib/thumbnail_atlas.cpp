@@ -0,0 +1,72 @@
+#include "thumbnail_atlas.hpp"
+#include <iostream>
+
+bool ThumbnailAtlas::init(int slotWidth, int slotHeight) {
+  if (slotWidth <= 0 || slotHeight <= 0 || slotWidth > this->atlasSize || slotHeight > this->atlasSize) {
+    std::cerr << "Invalid thumbnail size " << slotWidth << "x" << slotHeight << std::endl;
+    return false;
+  }
+
+  if (!this->texture) {
+    glGenTextures(1, &this->texture);
+    glBindTexture(GL_TEXTURE_2D, this->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, this->atlasSize, this->atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+
+  this->slotWidth = slotWidth;
+  this->slotHeight = slotHeight;
+  this->columns = this->atlasSize / slotWidth;
+  this->slotCount = this->columns * (this->atlasSize / slotHeight);
+  this->clear();
+  return true;
+}
+
+void ThumbnailAtlas::clear() {
+  this->slots.clear();
+  this->lru.clear();
+}
+
+bool ThumbnailAtlas::get(uint64_t key, const Thumbnail& thumbnail, ImVec2* uv0, ImVec2* uv1) {
+  if (!this->texture || thumbnail.width != this->slotWidth || thumbnail.height != this->slotHeight) {
+    return false;
+  }
+
+  int slot;
+  auto resident = this->slots.find(key);
+  if (resident != this->slots.end()) {
+    this->lru.splice(this->lru.begin(), this->lru, resident->second.lruPosition);
+    slot = resident->second.slot;
+  } else {
+    // Next free slot, or the one drawn longest ago
+    if ((int)this->slots.size() < this->slotCount) {
+      slot = (int)this->slots.size();
+    } else {
+      auto evicted = this->slots.find(this->lru.back());
+      slot = evicted->second.slot;
+      this->slots.erase(evicted);
+      this->lru.pop_back();
+    }
+
+    int x = (slot % this->columns) * this->slotWidth;
+    int y = (slot / this->columns) * this->slotHeight;
+    glBindTexture(GL_TEXTURE_2D, this->texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, thumbnail.width, thumbnail.height, GL_RGBA, GL_UNSIGNED_BYTE, thumbnail.pixels.data());
+
+    this->lru.push_front(key);
+    this->slots[key] = { slot, this->lru.begin() };
+  }
+
+  float x = (float)((slot % this->columns) * this->slotWidth);
+  float y = (float)((slot / this->columns) * this->slotHeight);
+  *uv0 = ImVec2(x / this->atlasSize, y / this->atlasSize);
+  *uv1 = ImVec2((x + this->slotWidth) / this->atlasSize, (y + this->slotHeight) / this->atlasSize);
+  return true;
+}
+
+ImTextureID ThumbnailAtlas::getTextureId() {
+  return (ImTextureID)(intptr_t)this->texture;
+}
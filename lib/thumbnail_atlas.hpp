@@ -0,0 +1,40 @@
+#ifndef THUMBNAILATLAS_HPP
+#define THUMBNAILATLAS_HPP
+
+#include "thumbnail_decoder.hpp"
+#include "imgui.h"
+#include <GL/glew.h>
+#include <unordered_map>
+#include <list>
+
+// One GL texture holding a grid of same-sized thumbnails. Slots are reused least recently
+// drawn first, so hovering back and forth never re-uploads what is already resident.
+class ThumbnailAtlas {
+private:
+  const int atlasSize = 2048;
+  GLuint texture = 0;
+  int slotWidth = 0;
+  int slotHeight = 0;
+  int columns = 0;
+  int slotCount = 0;
+
+  struct Slot {
+    int slot;
+    std::list<uint64_t>::iterator lruPosition;
+  };
+  std::unordered_map<uint64_t, Slot> slots;
+  std::list<uint64_t> lru;
+
+public:
+  // Needs a current GL context. Called again when the thumbnail size changes.
+  bool init(int slotWidth, int slotHeight);
+
+  // Forget every slot, e.g. when another recording is opened
+  void clear();
+
+  // Uploads the thumbnail under key on first use and returns its texture coordinates
+  bool get(uint64_t key, const Thumbnail& thumbnail, ImVec2* uv0, ImVec2* uv1);
+  ImTextureID getTextureId();
+};
+
+#endif // THUMBNAILATLAS_HPP
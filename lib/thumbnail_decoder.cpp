@@ -0,0 +1,236 @@
+#include "thumbnail_decoder.hpp"
+#include <iostream>
+#include <cmath>
+
+ThumbnailDecoder::ThumbnailDecoder() {
+
+}
+
+ThumbnailDecoder::~ThumbnailDecoder() {
+  this->close();
+}
+
+bool ThumbnailDecoder::open(const std::string& fileName, int width, AVPixelFormat format) {
+  this->close();
+  this->fileName = fileName;
+  this->memoryStream = nullptr;
+  this->width = width;
+  this->format = format;
+  return this->openInput();
+}
+
+bool ThumbnailDecoder::open(std::shared_ptr<MemoryStream> stream, int width, AVPixelFormat format) {
+  this->close();
+  this->fileName = "replay buffer";
+  this->memoryStream = stream;
+  this->width = width;
+  this->format = format;
+  return this->openInput();
+}
+
+void ThumbnailDecoder::setScanMode(int threadCount, bool referenceOnly) {
+  this->threadCount = threadCount;
+  this->referenceOnly = referenceOnly;
+}
+
+bool ThumbnailDecoder::reopen() {
+  this->close();
+  return this->openInput();
+}
+
+bool ThumbnailDecoder::openInput() {
+  if (!this->input.open(&this->formatContext, this->fileName, this->memoryStream)) {
+    std::cout << "Thumbnails: could not open " << this->fileName << std::endl;
+    this->close();
+    return false;
+  }
+
+  this->streamIndex = -1;
+  for (unsigned int i = 0; i < this->formatContext->nb_streams; i++) {
+    AVStream* stream = this->formatContext->streams[i];
+    if (this->streamIndex < 0 && stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+      this->streamIndex = i;
+    } else {
+      // Don't demux audio at all
+      stream->discard = AVDISCARD_ALL;
+    }
+  }
+
+  AVCodecParameters* params = this->streamIndex >= 0 ? this->formatContext->streams[this->streamIndex]->codecpar : nullptr;
+  const AVCodec* codec = params ? avcodec_find_decoder(params->codec_id) : nullptr;
+  if (!codec || params->width <= 0 || params->height <= 0) {
+    std::cout << "Thumbnails: no decodable video stream" << std::endl;
+    this->close();
+    return false;
+  }
+
+  this->codecContext = avcodec_alloc_context3(codec);
+  avcodec_parameters_to_context(this->codecContext, params);
+
+  // Previews use one thread so they stay off the playback decoder's cores, a scan has a whole
+  // recording to get through. Deblocking is invisible once downscaled.
+  this->codecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+  this->codecContext->skip_loop_filter = AVDISCARD_ALL;
+  this->codecContext->thread_count = this->threadCount;
+  if (this->threadCount != 1)
+    this->codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+  // Decode at a fraction of the resolution where the codec can (not H.264, but MPEG-2/MJPEG can)
+  int lowres = 0;
+  while (lowres < codec->max_lowres && (params->width >> (lowres + 1)) >= this->width)
+    lowres++;
+  this->codecContext->lowres = lowres;
+
+  if (avcodec_open2(this->codecContext, codec, NULL) < 0) {
+    std::cout << "Thumbnails: could not open decoder" << std::endl;
+    this->close();
+    return false;
+  }
+
+  this->height = std::max(2, (int)std::lround((double)this->width * params->height / params->width) & ~1);
+  this->packet = av_packet_alloc();
+  this->frame = av_frame_alloc();
+  return this->packet && this->frame;
+}
+
+void ThumbnailDecoder::close() {
+  if (this->swsContext) {
+    sws_freeContext(this->swsContext);
+    this->swsContext = nullptr;
+  }
+  av_frame_free(&this->frame);
+  av_packet_free(&this->packet);
+  avcodec_free_context(&this->codecContext);
+  this->input.close(&this->formatContext);
+}
+
+bool ThumbnailDecoder::seek(double pts, bool keyframeOnly) {
+  if (!this->formatContext || !this->codecContext) {
+    return false;
+  }
+
+  AVStream* stream = this->formatContext->streams[this->streamIndex];
+  int64_t target = (int64_t)std::llround(pts / av_q2d(stream->time_base));
+  if (av_seek_frame(this->formatContext, this->streamIndex, target, AVSEEK_FLAG_BACKWARD) < 0) {
+    return false;
+  }
+
+  avcodec_flush_buffers(this->codecContext);
+  this->codecContext->skip_frame = keyframeOnly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+
+  // A growing file may have more past the end the last decode ran into
+  if (this->formatContext->pb)
+    this->formatContext->pb->eof_reached = 0;
+  this->reachedEnd = false;
+  return true;
+}
+
+std::shared_ptr<Thumbnail> ThumbnailDecoder::scale() {
+  this->swsContext = sws_getCachedContext(this->swsContext, this->frame->width, this->frame->height, (AVPixelFormat)this->frame->format,
+    this->width, this->height, this->format, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+  if (!this->swsContext) {
+    return nullptr;
+  }
+
+  auto thumbnail = std::make_shared<Thumbnail>();
+  thumbnail->width = this->width;
+  thumbnail->height = this->height;
+  thumbnail->pts = this->frame->best_effort_timestamp * av_q2d(this->formatContext->streams[this->streamIndex]->time_base);
+  thumbnail->pixels.resize(av_image_get_buffer_size(this->format, this->width, this->height, 1));
+
+  uint8_t* dst[4];
+  int dstStride[4];
+  av_image_fill_arrays(dst, dstStride, thumbnail->pixels.data(), this->format, this->width, this->height, 1);
+  sws_scale(this->swsContext, this->frame->data, this->frame->linesize, 0, this->frame->height, dst, dstStride);
+  return thumbnail;
+}
+
+std::shared_ptr<Thumbnail> ThumbnailDecoder::decodeKeyframe(double pts) {
+  if (!this->seek(pts, true)) {
+    return nullptr;
+  }
+
+  // Feed keyframes until the decoder hands one back, drain at the end of the file
+  bool draining = false;
+  while (true) {
+    if (!draining) {
+      int result = av_read_frame(this->formatContext, this->packet);
+      if (result < 0) {
+        this->reachedEnd = result == AVERROR_EOF;
+        avcodec_send_packet(this->codecContext, NULL);
+        draining = true;
+      } else {
+        if (this->packet->stream_index == this->streamIndex && (this->packet->flags & AV_PKT_FLAG_KEY))
+          avcodec_send_packet(this->codecContext, this->packet);
+        av_packet_unref(this->packet);
+      }
+    }
+
+    int ret = avcodec_receive_frame(this->codecContext, this->frame);
+    if (ret == 0) {
+      std::shared_ptr<Thumbnail> thumbnail = this->scale();
+      av_frame_unref(this->frame);
+      return thumbnail;
+    }
+    if (ret != AVERROR(EAGAIN) || draining) {
+      return nullptr;
+    }
+  }
+}
+
+bool ThumbnailDecoder::decodeRange(double start, double end, const std::function<bool(std::shared_ptr<Thumbnail>)>& callback) {
+  if (!this->seek(start, false)) {
+    return false;
+  }
+  if (this->referenceOnly)
+    this->codecContext->skip_frame = AVDISCARD_NONREF;
+
+  AVRational timeBase = this->formatContext->streams[this->streamIndex]->time_base;
+  bool draining = false;
+  while (true) {
+    if (!draining) {
+      int result = av_read_frame(this->formatContext, this->packet);
+      if (result < 0) {
+        this->reachedEnd = result == AVERROR_EOF;
+        avcodec_send_packet(this->codecContext, NULL);
+        draining = true;
+      } else {
+        if (this->packet->stream_index == this->streamIndex)
+          avcodec_send_packet(this->codecContext, this->packet);
+        av_packet_unref(this->packet);
+      }
+    }
+
+    int ret;
+    while ((ret = avcodec_receive_frame(this->codecContext, this->frame)) == 0) {
+      double pts = this->frame->best_effort_timestamp * av_q2d(timeBase);
+      if (pts > end) {
+        av_frame_unref(this->frame);
+        return true;
+      }
+      if (pts >= start) {
+        std::shared_ptr<Thumbnail> thumbnail = this->scale();
+        if (thumbnail && !callback(thumbnail)) {
+          av_frame_unref(this->frame);
+          return true;
+        }
+      }
+      av_frame_unref(this->frame);
+    }
+    if (ret != AVERROR(EAGAIN) || draining) {
+      return ret == AVERROR_EOF;
+    }
+  }
+}
+
+bool ThumbnailDecoder::isAtEnd() {
+  return this->reachedEnd;
+}
+
+int ThumbnailDecoder::getWidth() {
+  return this->width;
+}
+
+int ThumbnailDecoder::getHeight() {
+  return this->height;
+}
@@ -0,0 +1,79 @@
+#ifndef THUMBNAILDECODER_HPP
+#define THUMBNAILDECODER_HPP
+
+#include "memory_stream.hpp"
+#include "media_input.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
+}
+
+struct Thumbnail {
+  std::vector<uint8_t> pixels; // Tightly packed, in the format the decoder was opened with
+  int width = 0;
+  int height = 0;
+  double pts = 0.0;    // Of the frame it was decoded from
+  size_t keyframe = 0; // Frame number of the keyframe it belongs to in the timeline index
+};
+
+// Demuxer and decoder of its own that turns frames into small images (RGBA by default), separate from
+// the playback decoder so previews never seek it. Not thread safe, owned by one worker.
+class ThumbnailDecoder {
+private:
+  std::string fileName;
+  std::shared_ptr<MemoryStream> memoryStream;
+  MediaInput input;
+  AVFormatContext* formatContext = nullptr;
+  AVCodecContext* codecContext = nullptr;
+  SwsContext* swsContext = nullptr;
+  AVPacket* packet = nullptr;
+  AVFrame* frame = nullptr;
+  int streamIndex = -1;
+  int width = 0;
+  int height = 0;
+  AVPixelFormat format = AV_PIX_FMT_RGBA;
+  bool reachedEnd = false;
+  int threadCount = 1;
+  bool referenceOnly = false;
+
+  bool openInput();
+  bool seek(double pts, bool keyframeOnly);
+  std::shared_ptr<Thumbnail> scale();
+
+public:
+  ThumbnailDecoder();
+  ~ThumbnailDecoder();
+  bool open(const std::string& fileName, int width, AVPixelFormat format = AV_PIX_FMT_RGBA);
+  bool open(std::shared_ptr<MemoryStream> stream, int width, AVPixelFormat format = AV_PIX_FMT_RGBA);
+  void close();
+
+  // For long scans instead of previews: frame threads on more cores, and decodeRange skips
+  // non-reference frames (B-frames) that nothing else depends on. Takes effect at the next open.
+  void setScanMode(int threadCount, bool referenceOnly);
+
+  // Reopen the same source, a growing file may have fragments the demuxer didn't see at open
+  bool reopen();
+
+  // First keyframe at or after the keyframe before pts. Only keyframes are decoded.
+  std::shared_ptr<Thumbnail> decodeKeyframe(double pts);
+
+  // The last decode ran into the end of the input. Nothing is broken, the next seek starts over.
+  bool isAtEnd();
+
+  // Every frame with pts in [start, end], decoding from the keyframe before start (reference
+  // frames only in scan mode). The callback returns false to stop early.
+  bool decodeRange(double start, double end, const std::function<bool(std::shared_ptr<Thumbnail>)>& callback);
+
+  int getWidth();
+  int getHeight();
+};
+
+#endif // THUMBNAILDECODER_HPP
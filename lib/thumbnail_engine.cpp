@@ -0,0 +1,183 @@
+#include "thumbnail_engine.hpp"
+#include <chrono>
+
+ThumbnailEngine::ThumbnailEngine() {
+
+}
+
+ThumbnailEngine::~ThumbnailEngine() {
+  this->close();
+}
+
+bool ThumbnailEngine::open(const std::string& fileName) {
+  this->close();
+  return this->start(this->decoder.open(fileName, this->thumbnailWidth));
+}
+
+bool ThumbnailEngine::open(std::shared_ptr<MemoryStream> stream) {
+  this->close();
+  return this->start(this->decoder.open(stream, this->thumbnailWidth));
+}
+
+bool ThumbnailEngine::start(bool opened) {
+  if (!opened) {
+    return false;
+  }
+
+  this->thumbnailHeight = this->decoder.getHeight();
+  this->running = true;
+  this->worker = std::thread(&ThumbnailEngine::workLoop, this);
+  return true;
+}
+
+void ThumbnailEngine::close() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->running = false;
+  }
+  this->condition.notify_all();
+  if (this->worker.joinable())
+    this->worker.join();
+
+  this->decoder.close();
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->cache.clear();
+  this->lru.clear();
+  this->index = nullptr;
+  this->hasRequest = false;
+  this->warmNext = 0;
+}
+
+void ThumbnailEngine::workLoop() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  while (this->running) {
+    size_t keyframe;
+    if (this->hasRequest) {
+      keyframe = this->requestedKeyframe;
+      this->hasRequest = false;
+    } else if (this->index && !this->index->empty() && this->warmNext < this->warmCount) {
+      // Idle, spread a coarse set over the timeline so any hover has something close
+      size_t frame = this->index->getFrameCount() * this->warmNext / this->warmCount;
+      keyframe = this->index->previousKeyframe(frame);
+      this->warmNext++;
+    } else {
+      this->condition.wait(lock);
+      continue;
+    }
+
+    if (this->cache.count(keyframe)) {
+      continue;
+    }
+    std::shared_ptr<const TimelineIndex> snapshot = this->index;
+    lock.unlock();
+
+    auto start = std::chrono::steady_clock::now();
+    double pts = snapshot->ptsForFrame(keyframe);
+    std::shared_ptr<Thumbnail> thumbnail = this->decoder.decodeKeyframe(pts);
+
+    // Running into the end is normal for a growing file, the next request just seeks again.
+    // Anything else gets one reopen in case the demuxer lost track of the file.
+    bool reopened = false;
+    if (!thumbnail && !this->decoder.isAtEnd() && this->decoder.reopen()) {
+      reopened = true;
+      thumbnail = this->decoder.decodeKeyframe(pts);
+    }
+    if (thumbnail)
+      thumbnail->keyframe = keyframe;
+    double decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    lock.lock();
+    if (reopened)
+      this->thumbnailHeight = this->decoder.getHeight();
+    if (thumbnail) {
+      this->insert(thumbnail);
+      this->stats.decoded++;
+      this->stats.lastDecodeMs = decodeMs;
+      this->stats.averageDecodeMs += (decodeMs - this->stats.averageDecodeMs) / this->stats.decoded;
+    }
+  }
+}
+
+void ThumbnailEngine::insert(std::shared_ptr<const Thumbnail> thumbnail) {
+  auto existing = this->cache.find(thumbnail->keyframe);
+  if (existing != this->cache.end()) {
+    this->lru.erase(existing->second.lruPosition);
+    this->cache.erase(existing);
+  }
+
+  this->lru.push_front(thumbnail->keyframe);
+  this->cache[thumbnail->keyframe] = { thumbnail, this->lru.begin() };
+
+  while (this->cache.size() > this->cacheCapacity) {
+    this->cache.erase(this->lru.back());
+    this->lru.pop_back();
+  }
+}
+
+void ThumbnailEngine::setIndex(std::shared_ptr<const TimelineIndex> index) {
+  if (!index) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (index == this->index) {
+    return;
+  }
+
+  // Re-spread the warm set once the recording has grown noticeably
+  if (!this->index || index->getFrameCount() > this->index->getFrameCount() * 11 / 10)
+    this->warmNext = 0;
+  this->index = index;
+  this->condition.notify_one();
+}
+
+std::shared_ptr<const Thumbnail> ThumbnailEngine::request(double time) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->stats.requests++;
+  if (!this->running || !this->index || this->index->empty()) {
+    return nullptr;
+  }
+
+  size_t keyframe = this->index->previousKeyframe(this->index->frameForPts(time));
+  auto exact = this->cache.find(keyframe);
+  if (exact != this->cache.end()) {
+    this->lru.splice(this->lru.begin(), this->lru, exact->second.lruPosition);
+    this->stats.hits++;
+    return exact->second.thumbnail;
+  }
+
+  this->requestedKeyframe = keyframe;
+  this->hasRequest = true;
+  this->condition.notify_one();
+
+  // Closest cached keyframe on either side stands in until the decode lands
+  auto after = this->cache.lower_bound(keyframe);
+  auto best = after;
+  if (after != this->cache.begin()) {
+    auto before = std::prev(after);
+    if (after == this->cache.end() || keyframe - before->first <= after->first - keyframe)
+      best = before;
+  }
+  if (best == this->cache.end()) {
+    return nullptr;
+  }
+
+  this->stats.substitutes++;
+  return best->second.thumbnail;
+}
+
+int ThumbnailEngine::getThumbnailWidth() {
+  return this->thumbnailWidth;
+}
+
+int ThumbnailEngine::getThumbnailHeight() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->thumbnailHeight;
+}
+
+ThumbnailStats ThumbnailEngine::getStats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->stats;
+}
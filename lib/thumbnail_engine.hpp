@@ -0,0 +1,78 @@
+#ifndef THUMBNAILENGINE_HPP
+#define THUMBNAILENGINE_HPP
+
+#include "thumbnail_decoder.hpp"
+#include "timeline_index.hpp"
+#include <string>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+struct ThumbnailStats {
+  uint64_t requests = 0;
+  uint64_t hits = 0;        // Exact keyframe was cached
+  uint64_t substitutes = 0; // Nearest cached keyframe was returned while the exact one decodes
+  uint64_t decoded = 0;
+  double lastDecodeMs = 0.0;
+  double averageDecodeMs = 0.0;
+};
+
+// Decodes seek-bar preview thumbnails on its own thread, with its own demuxer and decoder
+// so playback is never disturbed. Only keyframes are decoded (at reduced resolution when
+// the codec supports lowres) and downscaled to RGBA. Results live in an LRU keyed by
+// keyframe. No GL here, the UI uploads the images into its own atlas.
+class ThumbnailEngine {
+private:
+  const int thumbnailWidth = 160;
+  const size_t cacheCapacity = 512;
+  const size_t warmCount = 64; // Evenly spaced keyframes decoded while idle
+
+  ThumbnailDecoder decoder;
+  int thumbnailHeight = 0; // Published under mutex, the worker may reopen the decoder at any time
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool running = false;
+
+  // Latest hover request wins, older ones are dropped
+  bool hasRequest = false;
+  size_t requestedKeyframe = 0;
+  std::shared_ptr<const TimelineIndex> index;
+  size_t warmNext = 0;
+
+  struct CacheEntry {
+    std::shared_ptr<const Thumbnail> thumbnail;
+    std::list<size_t>::iterator lruPosition;
+  };
+  std::map<size_t, CacheEntry> cache;
+  std::list<size_t> lru;
+  ThumbnailStats stats;
+
+  bool start(bool opened);
+  void workLoop();
+  void insert(std::shared_ptr<const Thumbnail> thumbnail);
+
+public:
+  ThumbnailEngine();
+  ~ThumbnailEngine();
+  bool open(const std::string& fileName);
+  bool open(std::shared_ptr<MemoryStream> stream);
+  void close();
+
+  // Latest index snapshot, thumbnails are requested by the keyframes it knows about
+  void setIndex(std::shared_ptr<const TimelineIndex> index);
+
+  // Never waits for a decode. Returns the thumbnail of the keyframe before time if cached,
+  // otherwise the nearest cached one (or null) and queues the exact one.
+  std::shared_ptr<const Thumbnail> request(double time);
+
+  int getThumbnailWidth();
+  int getThumbnailHeight();
+  ThumbnailStats getStats();
+};
+
+#endif // THUMBNAILENGINE_HPP
@@ -0,0 +1,41 @@
+#include "time_span.hpp"
+#include <algorithm>
+
+std::vector<TimeSpan> intersectSpans(const std::vector<TimeSpan>& a, const std::vector<TimeSpan>& b, double minLength) {
+  std::vector<TimeSpan> result;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < a.size() && j < b.size()) {
+    double start = std::max(a[i].start, b[j].start);
+    double end = std::min(a[i].end, b[j].end);
+    if (end - start >= minLength)
+      result.push_back({ start, end });
+
+    // Drop whichever ends first, the other may still overlap the next one
+    if (a[i].end < b[j].end) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  return result;
+}
+
+std::vector<TimeSpan> subtractSpans(TimeSpan range, const std::vector<TimeSpan>& spans) {
+  std::vector<TimeSpan> result;
+  double cursor = range.start;
+  for (const TimeSpan& span : spans) {
+    if (span.end <= cursor) {
+      continue;
+    }
+    if (span.start >= range.end) {
+      break;
+    }
+    if (span.start > cursor)
+      result.push_back({ cursor, span.start });
+    cursor = span.end;
+  }
+  if (cursor < range.end)
+    result.push_back({ cursor, range.end });
+  return result;
+}
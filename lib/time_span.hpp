@@ -0,0 +1,18 @@
+#ifndef TIMESPAN_HPP
+#define TIMESPAN_HPP
+
+#include <vector>
+
+// [start, end) in seconds of the recording
+struct TimeSpan {
+  double start = 0.0;
+  double end = 0.0;
+};
+
+// Parts covered by both lists. Inputs are sorted and non-overlapping, results shorter than minLength are dropped.
+std::vector<TimeSpan> intersectSpans(const std::vector<TimeSpan>& a, const std::vector<TimeSpan>& b, double minLength);
+
+// What's left of range with the spans taken out, in order
+std::vector<TimeSpan> subtractSpans(TimeSpan range, const std::vector<TimeSpan>& spans);
+
+#endif // TIMESPAN_HPP
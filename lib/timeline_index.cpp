@@ -0,0 +1,425 @@
+#include "timeline_index.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back((uint8_t)(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+  }
+
+  uint64_t getVarint(const uint8_t*& in) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (*in & 0x80) {
+      value |= (uint64_t)(*in++ & 0x7f) << shift;
+      shift += 7;
+    }
+    value |= (uint64_t)(*in++) << shift;
+    return value;
+  }
+
+  uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+  }
+
+  int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+  }
+
+  // Unknown positions don't move the prediction for the next packet
+  int64_t nextExpectedPos(int64_t expected, int64_t pos, int32_t size) {
+    return pos >= 0 ? pos + size : expected;
+  }
+
+  // Size with a flag bit for "not where expected", the position delta only follows when it is set.
+  // Packets of one stream are mostly back to back, so most of them cost just the size.
+  void putPacket(std::vector<uint8_t>& out, int64_t expected, int64_t pos, int32_t size) {
+    putVarint(out, ((uint64_t)(uint32_t)size << 1) | (pos != expected));
+    if (pos != expected)
+      putVarint(out, zigzag(pos - expected));
+  }
+
+  void getPacket(const uint8_t*& in, int64_t expected, int64_t* pos, int32_t* size) {
+    uint64_t value = getVarint(in);
+    *size = (int32_t)(value >> 1);
+    *pos = (value & 1) ? expected + unzigzag(getVarint(in)) : expected;
+  }
+}
+
+int64_t TimelineIndex::Chunk::ticksForFrame(size_t frame) const {
+  if (frame == 0) {
+    return this->firstTicks;
+  }
+
+  auto checkpoint = std::upper_bound(this->runCheckpoints.begin(), this->runCheckpoints.end(), frame,
+    [](size_t value, const RunCheckpoint& c) { return value < c.frame; }) - 1;
+
+  const uint8_t* in = this->runs.data() + checkpoint->byte;
+  size_t runStart = checkpoint->frame;
+  int64_t ticks = checkpoint->anchor;
+  while (true) {
+    uint64_t length = getVarint(in);
+    int64_t delta = unzigzag(getVarint(in));
+    if (frame < runStart + length) {
+      return ticks + (int64_t)(frame - runStart + 1) * delta;
+    }
+    ticks += (int64_t)length * delta;
+    runStart += length;
+  }
+}
+
+size_t TimelineIndex::Chunk::frameForTicks(int64_t ticks) const {
+  if (ticks < this->firstTicks || this->runCheckpoints.empty()) {
+    return 0;
+  }
+
+  // The frame before the next checkpoint is already past ticks, so the decode stays within one checkpoint
+  auto checkpoint = std::upper_bound(this->runCheckpoints.begin(), this->runCheckpoints.end(), ticks,
+    [](int64_t value, const RunCheckpoint& c) { return value < c.anchor; }) - 1;
+
+  const uint8_t* in = this->runs.data() + checkpoint->byte;
+  const uint8_t* end = this->runs.data() + this->runs.size();
+  size_t runStart = checkpoint->frame;
+  int64_t runTicks = checkpoint->anchor;
+  while (in < end) {
+    uint64_t length = getVarint(in);
+    int64_t delta = unzigzag(getVarint(in));
+    if (delta > 0) {
+      uint64_t steps = (uint64_t)((ticks - runTicks) / delta);
+      if (steps < length) {
+        return runStart - 1 + steps;
+      }
+    }
+    runTicks += (int64_t)length * delta;
+    runStart += length;
+  }
+
+  return this->frameCount - 1;
+}
+
+void TimelineIndex::Chunk::packetForFrame(size_t frame, int64_t* pos, int32_t* size) const {
+  size_t first = frame / PACKETS_PER_CHECKPOINT * PACKETS_PER_CHECKPOINT;
+  const PacketCheckpoint& checkpoint = this->packetCheckpoints[frame / PACKETS_PER_CHECKPOINT];
+
+  const uint8_t* in = this->packets.data() + checkpoint.byte;
+  int64_t expected = checkpoint.expectedPos;
+  for (size_t i = first; i <= frame; i++) {
+    getPacket(in, expected, pos, size);
+    expected = nextExpectedPos(expected, *pos, *size);
+  }
+}
+
+bool TimelineIndex::Chunk::isKeyframe(size_t frame) const {
+  return (this->keyframes[frame / 64] >> (frame % 64)) & 1;
+}
+
+size_t TimelineIndex::Chunk::memoryBytes() const {
+  return sizeof(Chunk) + this->runs.capacity() + this->runCheckpoints.capacity() * sizeof(RunCheckpoint)
+    + this->packets.capacity() + this->packetCheckpoints.capacity() * sizeof(PacketCheckpoint)
+    + this->keyframes.capacity() * sizeof(uint64_t);
+}
+
+std::shared_ptr<const TimelineIndex::Chunk> TimelineIndex::makeChunk(const IndexedEntry* entries, size_t count) {
+  auto chunk = std::make_shared<Chunk>();
+  chunk->frameCount = (uint32_t)count;
+  chunk->firstTicks = entries[0].ticks;
+  chunk->keyframes.assign((count + 63) / 64, 0);
+
+  // Runs of equal deltas, a constant frame rate collapses to a single run
+  size_t runCount = 0;
+  for (size_t frame = 1; frame < count; runCount++) {
+    int64_t delta = entries[frame].ticks - entries[frame - 1].ticks;
+    size_t length = 1;
+    while (frame + length < count && entries[frame + length].ticks - entries[frame + length - 1].ticks == delta)
+      length++;
+
+    if (runCount % RUNS_PER_CHECKPOINT == 0)
+      chunk->runCheckpoints.push_back({ (uint32_t)frame, (uint32_t)chunk->runs.size(), entries[frame - 1].ticks });
+    putVarint(chunk->runs, length);
+    putVarint(chunk->runs, zigzag(delta));
+    frame += length;
+  }
+
+  int64_t expected = 0;
+  for (size_t i = 0; i < count; i++) {
+    const TimelineEntry& entry = entries[i].entry;
+    if (i % PACKETS_PER_CHECKPOINT == 0)
+      chunk->packetCheckpoints.push_back({ (uint32_t)chunk->packets.size(), expected });
+    putPacket(chunk->packets, expected, entry.pos, entry.size);
+    expected = nextExpectedPos(expected, entry.pos, entry.size);
+
+    if (entry.keyframe)
+      chunk->keyframes[i / 64] |= 1ULL << (i % 64);
+  }
+
+  chunk->runs.shrink_to_fit();
+  chunk->runCheckpoints.shrink_to_fit();
+  chunk->packets.shrink_to_fit();
+  chunk->packetCheckpoints.shrink_to_fit();
+  return chunk;
+}
+
+void TimelineIndex::appendChunkEntries(const Chunk& chunk, std::vector<IndexedEntry>& entries) const {
+  const uint8_t* runs = chunk.runs.data();
+  const uint8_t* packets = chunk.packets.data();
+  int64_t ticks = chunk.firstTicks;
+  int64_t expected = 0;
+  uint64_t runLeft = 0;
+  int64_t delta = 0;
+
+  for (size_t i = 0; i < chunk.frameCount; i++) {
+    if (i > 0) {
+      if (runLeft == 0) {
+        runLeft = getVarint(runs);
+        delta = unzigzag(getVarint(runs));
+      }
+      ticks += delta;
+      runLeft--;
+    }
+
+    int64_t pos;
+    int32_t size;
+    getPacket(packets, expected, &pos, &size);
+    expected = nextExpectedPos(expected, pos, size);
+
+    entries.push_back({ ticks, { ticks * this->tickDuration, pos, size, chunk.isKeyframe(i) } });
+  }
+}
+
+std::shared_ptr<const TimelineIndex> TimelineIndex::extend(const std::shared_ptr<const TimelineIndex>& base, std::vector<TimelineEntry> entries, double tickDuration) {
+  auto index = std::make_shared<TimelineIndex>();
+  index->tickDuration = base ? base->tickDuration : tickDuration;
+
+  std::vector<IndexedEntry> added;
+  added.reserve(entries.size());
+  for (const TimelineEntry& entry : entries)
+    added.push_back({ (int64_t)std::llround(entry.pts / index->tickDuration), entry });
+
+  auto byTicks = [](const IndexedEntry& a, const IndexedEntry& b) { return a.ticks < b.ticks; };
+  std::stable_sort(added.begin(), added.end(), byTicks);
+
+  std::vector<IndexedEntry> tail;
+  if (base && !base->chunks.empty()) {
+    // Reuse every full chunk that ends before the new entries, rebuild from there on
+    size_t keep = base->chunks.size() - 1;
+    if (!added.empty()) {
+      while (keep > 0 && base->chunks[keep - 1]->ticksForFrame(CHUNK_SIZE - 1) > added.front().ticks)
+        keep--;
+    }
+
+    index->chunks.assign(base->chunks.begin(), base->chunks.begin() + keep);
+    index->chunkFirstTicks.assign(base->chunkFirstTicks.begin(), base->chunkFirstTicks.begin() + keep);
+    for (size_t i = keep; i < base->chunks.size(); i++)
+      base->appendChunkEntries(*base->chunks[i], tail);
+  }
+
+  std::vector<IndexedEntry> merged;
+  merged.reserve(tail.size() + added.size());
+  std::merge(tail.begin(), tail.end(), added.begin(), added.end(), std::back_inserter(merged), byTicks);
+
+  index->appendChunks(merged.data(), merged.size());
+  return index;
+}
+
+std::shared_ptr<const TimelineIndex> TimelineIndex::dropBefore(const std::shared_ptr<const TimelineIndex>& base, double time) {
+  if (!base || base->empty() || base->getStartPts() >= time) {
+    return base;
+  }
+
+  std::vector<IndexedEntry> entries;
+  entries.reserve(base->frameCount);
+  for (const auto& chunk : base->chunks)
+    base->appendChunkEntries(*chunk, entries);
+
+  // Frames before the first remaining keyframe couldn't be decoded anyway
+  int64_t ticks = base->toTicks(time);
+  auto first = std::find_if(entries.begin(), entries.end(), [ticks](const IndexedEntry& entry) { return entry.ticks >= ticks && entry.entry.keyframe; });
+
+  auto index = std::make_shared<TimelineIndex>();
+  index->tickDuration = base->tickDuration;
+  index->appendChunks(entries.data() + (first - entries.begin()), entries.end() - first);
+  return index;
+}
+
+void TimelineIndex::appendChunks(const IndexedEntry* entries, size_t count) {
+  // Only the last chunk may be partial, callers append after full chunks
+  for (size_t i = 0; i < count; i += CHUNK_SIZE) {
+    size_t chunkCount = std::min(CHUNK_SIZE, count - i);
+    this->chunks.push_back(makeChunk(entries + i, chunkCount));
+    this->chunkFirstTicks.push_back(entries[i].ticks);
+  }
+  this->frameCount = this->chunks.empty() ? 0 : (this->chunks.size() - 1) * CHUNK_SIZE + this->chunks.back()->frameCount;
+}
+
+const TimelineIndex::Chunk& TimelineIndex::chunkFor(size_t frame, size_t* offset) const {
+  // Every chunk but the last is full, so this is a division
+  *offset = frame % CHUNK_SIZE;
+  return *this->chunks[frame / CHUNK_SIZE];
+}
+
+int64_t TimelineIndex::toTicks(double time) const {
+  // Times usually come from ptsForFrame, don't let rounding land them one tick early
+  return (int64_t)std::floor(time / this->tickDuration + 1e-6);
+}
+
+bool TimelineIndex::empty() const {
+  return this->frameCount == 0;
+}
+
+size_t TimelineIndex::getFrameCount() const {
+  return this->frameCount;
+}
+
+double TimelineIndex::getStartPts() const {
+  return this->empty() ? 0.0 : this->ptsForFrame(0);
+}
+
+double TimelineIndex::getEndPts() const {
+  return this->empty() ? 0.0 : this->ptsForFrame(this->frameCount - 1);
+}
+
+double TimelineIndex::getDuration() const {
+  return this->getEndPts() - this->getStartPts();
+}
+
+double TimelineIndex::getAverageFrameDuration() const {
+  if (this->frameCount < 2) {
+    return 0.0;
+  }
+  return this->getDuration() / (this->frameCount - 1);
+}
+
+size_t TimelineIndex::getMemoryBytes() const {
+  size_t bytes = sizeof(TimelineIndex) + this->chunks.capacity() * sizeof(std::shared_ptr<const Chunk>)
+    + this->chunkFirstTicks.capacity() * sizeof(int64_t);
+  for (const auto& chunk : this->chunks)
+    bytes += chunk->memoryBytes();
+  return bytes;
+}
+
+size_t TimelineIndex::frameForPts(double time) const {
+  if (this->empty()) {
+    return 0;
+  }
+
+  int64_t ticks = this->toTicks(time);
+  auto chunk = std::upper_bound(this->chunkFirstTicks.begin(), this->chunkFirstTicks.end(), ticks);
+  if (chunk == this->chunkFirstTicks.begin()) {
+    return 0;
+  }
+  size_t chunkIndex = chunk - this->chunkFirstTicks.begin() - 1;
+  return chunkIndex * CHUNK_SIZE + this->chunks[chunkIndex]->frameForTicks(ticks);
+}
+
+double TimelineIndex::ptsForFrame(size_t frame) const {
+  if (this->empty()) {
+    return 0.0;
+  }
+
+  size_t offset;
+  const Chunk& chunk = this->chunkFor(std::min(frame, this->frameCount - 1), &offset);
+  return chunk.ticksForFrame(offset) * this->tickDuration;
+}
+
+double TimelineIndex::nearestPts(double time) const {
+  if (this->empty()) {
+    return 0.0;
+  }
+
+  size_t frame = this->frameForPts(time);
+  double before = this->ptsForFrame(frame);
+  if (frame + 1 >= this->frameCount || time <= before) {
+    return before;
+  }
+
+  // Ties go to the earlier frame
+  double after = this->ptsForFrame(frame + 1);
+  return (after - time) < (time - before) ? after : before;
+}
+
+TimelineEntry TimelineIndex::entryForFrame(size_t frame) const {
+  if (this->empty()) {
+    return { 0.0, -1, 0, false };
+  }
+
+  size_t offset;
+  const Chunk& chunk = this->chunkFor(std::min(frame, this->frameCount - 1), &offset);
+  TimelineEntry entry = { chunk.ticksForFrame(offset) * this->tickDuration, -1, 0, chunk.isKeyframe(offset) };
+  chunk.packetForFrame(offset, &entry.pos, &entry.size);
+  return entry;
+}
+
+size_t TimelineIndex::previousKeyframe(size_t frame) const {
+  if (this->empty()) {
+    return 0;
+  }
+
+  frame = std::min(frame, this->frameCount - 1);
+  size_t chunkIndex = frame / CHUNK_SIZE;
+  size_t offset = frame % CHUNK_SIZE;
+
+  while (true) {
+    // Walk the keyframe bits backwards, a word at a time
+    const std::vector<uint64_t>& keyframes = this->chunks[chunkIndex]->keyframes;
+    for (size_t word = offset / 64 + 1; word-- > 0;) {
+      uint64_t bits = keyframes[word];
+      if (word == offset / 64)
+        bits &= ~0ULL >> (63 - offset % 64);
+      if (bits) {
+        return chunkIndex * CHUNK_SIZE + word * 64 + 63 - __builtin_clzll(bits);
+      }
+    }
+    if (chunkIndex == 0) {
+      return 0;
+    }
+
+    // GOP longer than the rest of this chunk, continue in the previous one
+    chunkIndex--;
+    offset = CHUNK_SIZE - 1;
+  }
+}
+
+size_t TimelineIndex::nextKeyframe(size_t frame) const {
+  if (frame + 1 >= this->frameCount) {
+    return this->frameCount;
+  }
+
+  size_t chunkIndex = (frame + 1) / CHUNK_SIZE;
+  size_t offset = (frame + 1) % CHUNK_SIZE;
+
+  for (; chunkIndex < this->chunks.size(); chunkIndex++, offset = 0) {
+    const std::vector<uint64_t>& keyframes = this->chunks[chunkIndex]->keyframes;
+    for (size_t word = offset / 64; word < keyframes.size(); word++) {
+      uint64_t bits = keyframes[word];
+      if (word == offset / 64)
+        bits &= ~0ULL << (offset % 64);
+      if (bits) {
+        return chunkIndex * CHUNK_SIZE + word * 64 + __builtin_ctzll(bits);
+      }
+    }
+  }
+
+  return this->frameCount;
+}
+
+PacketRange TimelineIndex::packetRange(double start, double end) const {
+  PacketRange range;
+  if (this->empty()) {
+    return range;
+  }
+
+  range.firstFrame = this->previousKeyframe(this->frameForPts(start));
+  range.lastFrame = this->frameForPts(end);
+  if (this->ptsForFrame(range.lastFrame) < end && range.lastFrame + 1 < this->frameCount)
+    range.lastFrame++;
+
+  // Packets of a GOP sit between its keyframe and the next one in the file
+  range.byteStart = this->entryForFrame(range.firstFrame).pos;
+  size_t next = this->nextKeyframe(range.lastFrame);
+  range.byteEnd = next < this->frameCount ? this->entryForFrame(next).pos : -1;
+  return range;
+}
@@ -0,0 +1,115 @@
+#ifndef TIMELINEINDEX_HPP
+#define TIMELINEINDEX_HPP
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+struct TimelineEntry {
+  double pts;
+  int64_t pos;     // Byte offset of the packet in the file (-1 if unknown)
+  int32_t size;
+  bool keyframe;
+};
+
+// Frames needed to reproduce [start, end]: decoding starts at firstFrame (a keyframe)
+struct PacketRange {
+  size_t firstFrame = 0;
+  size_t lastFrame = 0;
+  int64_t byteStart = -1;
+  int64_t byteEnd = -1; // -1 = up to the end of the file
+};
+
+// Immutable index of frames in presentation order. Snapshots share their full chunks,
+// so extending a live index only rebuilds the tail. Safe to read from any thread.
+//
+// Timestamps are stored as integer ticks of the stream time base, run-length encoded
+// deltas (a constant frame rate is one run per chunk). Sizes are varints, positions are
+// predicted from the end of the previous packet and only stored when that misses. Both
+// streams have checkpoints, so a lookup is a binary search plus a short bounded decode.
+//
+// Measured with 200k frames at 90 kHz ticks: about 3.3 bytes per frame at a constant frame
+// rate and 7.3 with +-1 ms jitter, against 24 for a TimelineEntry. Interleaved audio adds
+// about 2 for the position deltas. Constant-rate timestamps are close to free, the packet
+// sizes make up most of what is left, so this is 3x to 7x smaller, not 10x.
+class TimelineIndex {
+private:
+  static constexpr size_t CHUNK_SIZE = 4096;
+  static constexpr size_t RUNS_PER_CHECKPOINT = 16;
+  static constexpr size_t PACKETS_PER_CHECKPOINT = 64;
+
+  struct RunCheckpoint {
+    uint32_t frame;  // First frame covered by the run
+    uint32_t byte;   // Offset of the run in runs
+    int64_t anchor;  // Ticks of the frame before it
+  };
+
+  struct PacketCheckpoint {
+    uint32_t byte;
+    int64_t expectedPos; // End of the previous packet
+  };
+
+  struct Chunk {
+    uint32_t frameCount = 0;
+    int64_t firstTicks = 0;
+    std::vector<uint8_t> runs;    // (run length, zigzag delta) varint pairs for frames 1..n-1
+    std::vector<RunCheckpoint> runCheckpoints;
+    std::vector<uint8_t> packets; // Varint size and moved flag, zigzag position delta when moved
+    std::vector<PacketCheckpoint> packetCheckpoints;
+    std::vector<uint64_t> keyframes; // One bit per frame
+
+    int64_t ticksForFrame(size_t frame) const;
+    size_t frameForTicks(int64_t ticks) const;
+    void packetForFrame(size_t frame, int64_t* pos, int32_t* size) const;
+    bool isKeyframe(size_t frame) const;
+    size_t memoryBytes() const;
+  };
+
+  struct IndexedEntry {
+    int64_t ticks;
+    TimelineEntry entry;
+  };
+
+  std::vector<std::shared_ptr<const Chunk>> chunks;
+  std::vector<int64_t> chunkFirstTicks;
+  size_t frameCount = 0;
+  double tickDuration = 1.0 / 90000;
+
+  static std::shared_ptr<const Chunk> makeChunk(const IndexedEntry* entries, size_t count);
+  void appendChunks(const IndexedEntry* entries, size_t count);
+  void appendChunkEntries(const Chunk& chunk, std::vector<IndexedEntry>& entries) const;
+  const Chunk& chunkFor(size_t frame, size_t* offset) const;
+  int64_t toTicks(double time) const;
+
+public:
+  // New snapshot with entries merged into base (base may be null). Entries may be in decode order.
+  // tickDuration is the stream time base in seconds, only used when there is no base.
+  static std::shared_ptr<const TimelineIndex> extend(const std::shared_ptr<const TimelineIndex>& base, std::vector<TimelineEntry> entries, double tickDuration);
+
+  // New snapshot starting at the first keyframe at or after time, for a source that dropped its
+  // oldest data (the replay ring). Rebuilds every chunk, base is returned as is if nothing goes.
+  static std::shared_ptr<const TimelineIndex> dropBefore(const std::shared_ptr<const TimelineIndex>& base, double time);
+
+  bool empty() const;
+  size_t getFrameCount() const;
+  double getStartPts() const;
+  double getEndPts() const;
+  double getDuration() const;
+  double getAverageFrameDuration() const;
+  size_t getMemoryBytes() const;
+
+  // Frame shown at time (last frame with pts <= time, clamped to the first frame)
+  size_t frameForPts(double time) const;
+  double ptsForFrame(size_t frame) const;
+  double nearestPts(double time) const;
+  TimelineEntry entryForFrame(size_t frame) const;
+
+  // Keyframe at or before frame, and first keyframe after frame (getFrameCount() if none)
+  size_t previousKeyframe(size_t frame) const;
+  size_t nextKeyframe(size_t frame) const;
+
+  PacketRange packetRange(double start, double end) const;
+};
+
+#endif // TIMELINEINDEX_HPP
@@ -23,7 +23,7 @@ namespace Config {
 
 class Rewind {
   public:
-    const std::string filename = "video.mp4";
+    std::string filename = "video.mp4";
     int frame_width = 0;
     int frame_height = 0;
     unsigned char* frame_data = nullptr;
@@ -177,6 +177,19 @@ class Rewind {
           VideoFrame vFrame = mp.getVideoFrame();
           AudioFrame aFrame = mp.getAudioFrame();
 
+          // A new source (e.g. a screen recording) can have another size, reallocate the planes
+          if (vFrame.width > 0 && vFrame.height > 0 && (vFrame.width != this->frame_width || vFrame.height != this->frame_height)) {
+            this->frame_width = vFrame.width;
+            this->frame_height = vFrame.height;
+            this->screen_aspect_ratio = (float)this->frame_width / this->frame_height;
+            glBindTexture(GL_TEXTURE_2D, textureY);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, frame_width, frame_height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+            glBindTexture(GL_TEXTURE_2D, textureU);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, frame_width/2, frame_height/2, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+            glBindTexture(GL_TEXTURE_2D, textureV);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, frame_width/2, frame_height/2, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+          }
+
           // Generate texture from frame
           glActiveTexture(GL_TEXTURE0);
           glBindTexture(GL_TEXTURE_2D, textureY);
@@ -287,7 +300,9 @@ class Rewind {
 };
 
 
-int main() {
+int main(int argc, char** argv) {
   Rewind rw;
-  rw.run();
+  if (argc > 1)
+    rw.filename = argv[1];
+  return rw.run();
 }
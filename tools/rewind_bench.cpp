@@ -0,0 +1,578 @@
+#include "synthetic_capture.hpp"
+#include "recorder.hpp"
+#include "media_player.hpp"
+#include "thumbnail_decoder.hpp"
+#include "clip_exporter.hpp"
+#include "scene_analyzer.hpp"
+#include "json.hpp"
+
+#include <sys/stat.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/log.h>
+}
+
+// End-to-end media benchmark. Encodes synthetic recordings once per variant (kept in the media
+// directory and reused), then times opening and indexing them, sequential decode, random seeks,
+// a seek-bar drag with previews, a stream-copy export and the scene scan through the same engine
+// code the player uses. The report is JSON so runs on different commits can be diffed.
+
+namespace Config {
+  const int DEFAULT_SECONDS = 20;
+  const int DEFAULT_FPS = 30;
+  const int DEFAULT_SEEKS = 100;
+  const int INDEX_RUNS = 5;
+  const int OPEN_RUNS = 3;
+  const int SCRUB_STEPS = 60;          // One seek per UI frame of a one second drag
+  const double SCRUB_FROM = 0.1;       // Of the duration
+  const double SCRUB_TO = 0.6;
+  const int PREVIEW_WIDTH = 160;       // Same as the seek-bar thumbnails
+  const double BOOKMARK_AT = 0.37;     // Of the duration, a keyframe is asked for there while recording
+  const double RING_SECONDS = 2.0;     // Replay ring retention, recorded for three times that in real time
+  const int RING_POLL_MS = 100;
+  const int REPORT_SCHEMA = 1;
+}
+
+struct Variant {
+  int width = 1920;
+  int height = 1080;
+  std::string encoder = "libx264";
+  double keyframeInterval = 1.0; // Seconds, the GOP length
+
+  std::string getName() const {
+    char gop[32];
+    snprintf(gop, sizeof(gop), "%g", this->keyframeInterval);
+    return std::to_string(this->width) + "x" + std::to_string(this->height) + "-" + this->encoder + "-gop" + gop;
+  }
+};
+
+struct Options {
+  std::string mediaDir = "bench_media";
+  std::string outputFile;
+  std::string label;
+  std::vector<Variant> variants;
+  int seconds = Config::DEFAULT_SECONDS;
+  int fps = Config::DEFAULT_FPS;
+  SyntheticContent content = SyntheticContent::ScrollingText;
+  int seeks = Config::DEFAULT_SEEKS;
+  uint32_t seed = 1;
+  bool regenerate = false;
+  bool verbose = false;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double millisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static int64_t fileSize(const std::string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 ? (int64_t)info.st_size : -1;
+}
+
+static double median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+  return values[values.size() / 2];
+}
+
+// Nearest rank on sorted values
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+  return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+static void writeLatencies(JsonWriter& json, std::vector<double> ms) {
+  std::sort(ms.begin(), ms.end());
+  double total = 0.0;
+  for (double value : ms)
+    total += value;
+  json.beginObject().key("count").integer(ms.size())
+    .key("mean_ms").number(ms.empty() ? 0.0 : total / ms.size())
+    .key("min_ms").number(ms.empty() ? 0.0 : ms.front())
+    .key("p50_ms").number(percentile(ms, 50.0))
+    .key("p90_ms").number(percentile(ms, 90.0))
+    .key("p99_ms").number(percentile(ms, 99.0))
+    .key("max_ms").number(ms.empty() ? 0.0 : ms.back())
+    .endObject();
+}
+
+static void writeRuns(JsonWriter& json, const std::vector<double>& ms) {
+  json.beginObject().key("runs").integer(ms.size()).key("median_ms").number(median(ms))
+    .key("min_ms").number(ms.empty() ? 0.0 : *std::min_element(ms.begin(), ms.end())).endObject();
+}
+
+// Off the regular GOP grid, so only the request can put a keyframe there
+static double bookmarkTime(const Options& options) {
+  return options.seconds * Config::BOOKMARK_AT;
+}
+
+static void progress(const Variant& variant, const std::string& stage) {
+  std::cerr << "bench: " << variant.getName() << ": " << stage << std::endl;
+}
+
+// Encodes the variant unless an earlier run already did. Written under a temporary name, so
+// an interrupted run never leaves a short recording that looks finished.
+static bool generate(const Variant& variant, const Options& options, const std::string& path, JsonWriter& json) {
+  bool cached = !options.regenerate && fileSize(path) > 0;
+  double ms = 0.0;
+  RecorderStats stats;
+  AsyncWriterStats writer;
+
+  if (!cached) {
+    progress(variant, "generating");
+    SyntheticCaptureConfig captureConfig;
+    captureConfig.width = variant.width;
+    captureConfig.height = variant.height;
+    captureConfig.fps = options.fps;
+    captureConfig.content = options.content;
+    captureConfig.seed = options.seed;
+    captureConfig.frameCount = (uint64_t)options.seconds * options.fps;
+    captureConfig.realtime = false;
+    SyntheticCapture capture(captureConfig);
+
+    // Offline source, every frame is encoded. Scene-cut keyframes are off so the GOP is what was asked for.
+    RecorderConfig recorderConfig;
+    recorderConfig.encoderName = variant.encoder;
+    recorderConfig.dropWhenFull = false;
+    recorderConfig.keyframeInterval = variant.keyframeInterval;
+    recorderConfig.sceneCutKeyframes = false;
+    recorderConfig.asyncWriter = true;
+
+    std::string partial = path.substr(0, path.size() - 4) + ".tmp.mp4";
+    Clock::time_point start = Clock::now();
+    Recorder recorder;
+    recorder.forceKeyframe(bookmarkTime(options));
+    if (!recorder.start(&capture, partial, recorderConfig)) {
+      return false;
+    }
+    recorder.wait();
+    ms = millisecondsSince(start);
+    stats = recorder.getStats();
+    writer = recorder.getWriterStats();
+
+    if (stats.framesEncoded != captureConfig.frameCount || std::rename(partial.c_str(), path.c_str()) != 0) {
+      std::remove(partial.c_str());
+      return false;
+    }
+  }
+
+  json.key("generate").beginObject().key("cached").boolean(cached);
+  if (!cached) {
+    json.key("ms").number(ms).key("fps").number(ms > 0.0 ? stats.framesEncoded / (ms / 1000.0) : 0.0)
+      .key("keyframes").integer(stats.keyframes).key("max_keyframe_gap").number(stats.maxKeyframeGap)
+      .key("requested_keyframe_pts").number(stats.requestedKeyframePts);
+    json.key("writer").beginObject().key("backend").string(writer.backend).key("mb_per_s").number(writer.throughput)
+      .key("bytes_written").integer(writer.bytesWritten).key("max_queue_depth").integer(writer.maxQueueDepth)
+      .key("spilled_blocks").integer(writer.spilledBlocks).key("failed_blocks").integer(writer.failedBlocks)
+      .key("avg_write_ms").number(writer.averageWriteLatency * 1000.0).key("max_write_ms").number(writer.maxWriteLatency * 1000.0)
+      .endObject();
+  }
+  json.endObject();
+  return true;
+}
+
+// A ring-only recording played while it is written, the way Review Replay Buffer does. The ring
+// evicts its oldest fragments the whole time, every poll seeks to the start of the recording,
+// which is long gone, and has to land on the oldest frame still held.
+static void measureReplay(const Variant& variant, const Options& options, JsonWriter& json) {
+  progress(variant, "replay ring");
+  SyntheticCaptureConfig captureConfig;
+  captureConfig.width = variant.width;
+  captureConfig.height = variant.height;
+  captureConfig.fps = options.fps;
+  captureConfig.content = options.content;
+  captureConfig.seed = options.seed;
+  captureConfig.frameCount = (uint64_t)(Config::RING_SECONDS * 3 * options.fps);
+  captureConfig.realtime = true;
+  SyntheticCapture capture(captureConfig);
+
+  RecorderConfig recorderConfig;
+  recorderConfig.encoderName = variant.encoder;
+  recorderConfig.keyframeInterval = variant.keyframeInterval;
+  recorderConfig.sceneCutKeyframes = false;
+  recorderConfig.replayBufferSeconds = Config::RING_SECONDS;
+
+  json.key("replay").beginObject().key("ring_seconds").number(Config::RING_SECONDS);
+  Recorder recorder;
+  if (!recorder.start(&capture, "", recorderConfig)) {
+    json.key("error").string("could not record").endObject();
+    return;
+  }
+
+  // Let the ring go past its retention before opening it
+  std::this_thread::sleep_for(std::chrono::duration<double>(Config::RING_SECONDS + 1.0));
+  MediaPlayer player;
+  Clock::time_point start = Clock::now();
+  bool opened = player.loadStream(recorder.getReplayBuffer());
+  double openMs = millisecondsSince(start);
+  player.setLiveFollow(true);
+
+  std::vector<double> seekMs;
+  int landed = 0;
+  int failed = 0;
+  Clock::time_point began = Clock::now();
+  while (opened && recorder.isRecording()) {
+    player.syncMedia(millisecondsSince(began) / 1000.0);
+    start = Clock::now();
+    player.seek(0.0);
+    seekMs.push_back(millisecondsSince(start));
+
+    std::shared_ptr<const TimelineIndex> index = player.getTimelineIndex();
+    VideoFrame frame = player.getVideoFrame();
+    if (frame.width > 0 && index && frame.pts >= index->getStartPts() - 1e-6) {
+      landed++;
+    } else {
+      failed++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(Config::RING_POLL_MS));
+  }
+  recorder.wait();
+
+  std::shared_ptr<const TimelineIndex> index = player.getTimelineIndex();
+  json.key("ok").boolean(opened).key("open_ms").number(openMs).key("seeks_landed").integer(landed).key("seeks_failed").integer(failed)
+    .key("ring_bytes").integer(opened ? (int64_t)recorder.getReplayBuffer()->getSizeBytes() : 0)
+    .key("index_start").number(index ? index->getStartPts() : 0.0);
+  json.key("seek");
+  writeLatencies(json, seekMs);
+  json.endObject();
+}
+
+static bool measure(const Variant& variant, const Options& options, JsonWriter& json) {
+  json.beginObject().key("name").string(variant.getName()).key("width").integer(variant.width).key("height").integer(variant.height)
+    .key("encoder").string(variant.encoder).key("gop_seconds").number(variant.keyframeInterval);
+
+  // Recorder falls back to another H.264 encoder when one is missing, that would be mislabelled
+  if (!avcodec_find_encoder_by_name(variant.encoder.c_str())) {
+    json.key("error").string("encoder not available").endObject();
+    return false;
+  }
+
+  char contentName[64];
+  snprintf(contentName, sizeof(contentName), "-%s-%ds-%dfps-seed%u.mp4", SyntheticCapture::contentToString(options.content).c_str(),
+    options.seconds, options.fps, options.seed);
+  std::string path = options.mediaDir + "/" + variant.getName() + contentName;
+  if (!generate(variant, options, path, json)) {
+    json.key("error").string("could not generate " + path).endObject();
+    return false;
+  }
+
+  // Packet index alone, then a full load with decoders and the first cache fill
+  progress(variant, "open and index");
+  std::vector<double> indexMs;
+  std::shared_ptr<const TimelineIndex> index;
+  for (int run = 0; run < Config::INDEX_RUNS; run++) {
+    MediaPlayer player;
+    Clock::time_point start = Clock::now();
+    if (!player.indexFile(path)) {
+      json.key("error").string("could not index " + path).endObject();
+      return false;
+    }
+    indexMs.push_back(millisecondsSince(start));
+    index = player.getTimelineIndex();
+  }
+
+  std::vector<double> openMs;
+  for (int run = 0; run < Config::OPEN_RUNS; run++) {
+    MediaPlayer player;
+    Clock::time_point start = Clock::now();
+    if (!player.loadFile(path)) {
+      json.key("error").string("could not open " + path).endObject();
+      return false;
+    }
+    openMs.push_back(millisecondsSince(start));
+  }
+
+  size_t frames = index->getFrameCount();
+  double duration = index->getEndPts() + index->getAverageFrameDuration() - index->getStartPts();
+  json.key("file_bytes").integer(fileSize(path)).key("frames").integer(frames).key("duration").number(duration)
+    .key("index_bytes").integer(index->getMemoryBytes());
+  json.key("index");
+  writeRuns(json, indexMs);
+
+  // The keyframe asked for at the bookmark has to be on the first frame at or after it
+  double bookmark = index->getStartPts() + bookmarkTime(options);
+  size_t bookmarkFrame = index->frameForPts(bookmark);
+  if (index->ptsForFrame(bookmarkFrame) < bookmark - 1e-6 && bookmarkFrame + 1 < frames)
+    bookmarkFrame++;
+  json.key("bookmark_keyframe").beginObject().key("requested").number(bookmark)
+    .key("frame_pts").number(index->ptsForFrame(bookmarkFrame))
+    .key("ok").boolean(index->previousKeyframe(bookmarkFrame) == bookmarkFrame).endObject();
+  json.key("open");
+  writeRuns(json, openMs);
+
+  MediaPlayer player;
+  player.loadFile(path);
+
+  // Every frame in order, the way stepping through the recording refills the cache
+  progress(variant, "sequential decode");
+  player.seek(index->getStartPts());
+  Clock::time_point start = Clock::now();
+  size_t stepped = 0;
+  for (size_t frame = 1; frame < frames; frame++) {
+    player.stepForward();
+    stepped++;
+  }
+  double decodeMs = millisecondsSince(start);
+  json.key("decode").beginObject().key("frames").integer(stepped).key("ms").number(decodeMs)
+    .key("fps").number(decodeMs > 0.0 ? stepped / (decodeMs / 1000.0) : 0.0).endObject();
+
+  // Uniformly spread targets from a fixed seed, so every run seeks to the same places
+  progress(variant, "random seeks");
+  std::mt19937 random(options.seed);
+  std::uniform_real_distribution<double> position(index->getStartPts(), index->getEndPts());
+  std::vector<double> seekMs;
+  MappedReaderStats inputBefore = player.getInputStats();
+  for (int i = 0; i < options.seeks; i++) {
+    double target = position(random);
+    start = Clock::now();
+    player.seek(target);
+    seekMs.push_back(millisecondsSince(start));
+  }
+  json.key("seek");
+  writeLatencies(json, seekMs);
+
+  // What the seeks cost the mmap input: read-ahead issued, bytes copied and faults taken
+  MappedReaderStats input = player.getInputStats();
+  json.key("seek_input").beginObject().key("bytes_read").integer(input.bytesRead - inputBefore.bytesRead)
+    .key("bytes_prefetched").integer(input.bytesPrefetched - inputBefore.bytesPrefetched)
+    .key("minor_faults").integer(input.minorFaults - inputBefore.minorFaults)
+    .key("major_faults").integer(input.majorFaults - inputBefore.majorFaults)
+    .key("read_ms").number((input.readSeconds - inputBefore.readSeconds) * 1000.0).endObject();
+
+  // A seek-bar drag: the UI seeks and pauses every frame and asks for the hover preview
+  progress(variant, "scrub");
+  ThumbnailDecoder previews;
+  bool havePreviews = previews.open(path, Config::PREVIEW_WIDTH);
+  std::vector<double> scrubMs;
+  std::vector<double> previewMs;
+  for (int step = 0; step < Config::SCRUB_STEPS; step++) {
+    double fraction = Config::SCRUB_FROM + (Config::SCRUB_TO - Config::SCRUB_FROM) * step / (Config::SCRUB_STEPS - 1);
+    double target = index->getStartPts() + duration * fraction;
+    start = Clock::now();
+    player.seek(target);
+    player.pause();
+    scrubMs.push_back(millisecondsSince(start));
+
+    if (havePreviews) {
+      start = Clock::now();
+      previews.decodeKeyframe(target);
+      previewMs.push_back(millisecondsSince(start));
+    }
+  }
+  json.key("scrub").beginObject().key("seek");
+  writeLatencies(json, scrubMs);
+  json.key("preview");
+  writeLatencies(json, previewMs);
+  json.endObject();
+
+  // Whole recording stream copied, the same path as clip exports
+  progress(variant, "export");
+  std::string exportPath = options.mediaDir + "/export.tmp.mp4";
+  TimeSpan range = { index->getStartPts(), index->getEndPts() + index->getAverageFrameDuration() };
+  ClipExporter exporter;
+  start = Clock::now();
+  if (exporter.start(path, exportPath, ClipExporter::planSegments(*index, range, {}))) {
+    while (exporter.isRunning())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  double exportMs = millisecondsSince(start);
+  ExportStatus status = exporter.getStatus();
+  int64_t exportBytes = fileSize(exportPath);
+  std::remove(exportPath.c_str());
+  json.key("export").beginObject().key("ok").boolean(status.succeeded).key("ms").number(exportMs);
+  if (status.succeeded && exportMs > 0.0) {
+    json.key("media_speed").number(status.keptSeconds / (exportMs / 1000.0))
+      .key("mb_per_s").number(exportBytes / 1e6 / (exportMs / 1000.0));
+  } else if (!status.succeeded) {
+    json.key("error").string(status.error);
+  }
+  json.endObject();
+
+  // Scene scan of the whole recording, it has to stay ahead of realtime to keep up with a live one
+  progress(variant, "scene scan");
+  SceneAnalyzer sceneAnalyzer;
+  start = Clock::now();
+  bool scanned = sceneAnalyzer.open(path);
+  if (scanned) {
+    sceneAnalyzer.setIndex(index);
+    while (!sceneAnalyzer.isFinished())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  double sceneMs = millisecondsSince(start);
+  SceneStats sceneStats = sceneAnalyzer.getStats();
+  sceneAnalyzer.close();
+  json.key("scene").beginObject().key("ok").boolean(scanned).key("ms").number(sceneMs)
+    .key("frames").integer(sceneStats.framesAnalyzed).key("scene_fps").number(sceneStats.fps)
+    .key("scene_speed").number(sceneStats.speed).key("realtime").boolean(sceneStats.speed > 1.0).endObject();
+
+  measureReplay(variant, options, json);
+
+  json.endObject();
+  return true;
+}
+
+// WIDTHxHEIGHT:encoder:gop seconds, e.g. 1920x1080:libx264:2
+static bool parseVariant(const std::string& spec, Variant& variant) {
+  char encoder[64];
+  double gop = 0.0;
+  if (sscanf(spec.c_str(), "%dx%d:%63[^:]:%lf", &variant.width, &variant.height, encoder, &gop) != 4 ||
+    variant.width < 16 || variant.height < 16 || gop < 0.0) {
+    return false;
+  }
+  variant.encoder = encoder;
+  variant.keyframeInterval = gop;
+  return true;
+}
+
+static std::vector<Variant> defaultVariants() {
+  return {
+    { 1280, 720, "libx264", 1.0 },
+    { 1920, 1080, "libx264", 1.0 },
+    { 1920, 1080, "libx264", 4.0 },
+    { 1920, 1080, "libx265", 2.0 },
+    { 1920, 1080, "mpeg4", 2.0 },
+    { 2560, 1440, "libx264", 2.0 },
+  };
+}
+
+static void printUsage() {
+  std::cerr <<
+    "Usage: rewind_bench [options]\n"
+    "\n"
+    "Generates synthetic recordings (kept and reused) and measures open/index time, sequential\n"
+    "decode, random seeks, scrubbing, export and replay ring playback for each. Writes a JSON report.\n"
+    "\n"
+    "Options:\n"
+    "  --media DIR        Where recordings are generated (default bench_media)\n"
+    "  --output FILE      Write the report to FILE instead of stdout\n"
+    "  --label TEXT       Stored in the report, e.g. the commit being measured\n"
+    "  --variant SPEC     WIDTHxHEIGHT:encoder:gop seconds, repeatable, replaces the default set\n"
+    "  --seconds N        Length of generated recordings (default 20)\n"
+    "  --fps N            Frame rate of generated recordings (default 30)\n"
+    "  --content NAME     static, text or noise (default text)\n"
+    "  --seeks N          Random seeks per recording (default 100)\n"
+    "  --seed N           Seed for the content and the seek positions (default 1)\n"
+    "  --regenerate       Encode recordings again even if they exist\n"
+    "  --quick            First variant only, 5 seconds, 20 seeks\n"
+    "  --verbose          Keep the engine's log output (on stderr)\n";
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  bool quick = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--media" && hasValue) {
+      options.mediaDir = argv[++i];
+    } else if (arg == "--output" && hasValue) {
+      options.outputFile = argv[++i];
+    } else if (arg == "--label" && hasValue) {
+      options.label = argv[++i];
+    } else if (arg == "--variant" && hasValue) {
+      Variant variant;
+      if (!parseVariant(argv[++i], variant)) {
+        std::cerr << "Bad variant " << argv[i] << std::endl;
+        return 2;
+      }
+      options.variants.push_back(variant);
+    } else if (arg == "--seconds" && hasValue) {
+      options.seconds = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--fps" && hasValue) {
+      options.fps = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--content" && hasValue) {
+      if (!SyntheticCapture::contentFromString(argv[++i], &options.content)) {
+        std::cerr << "Unknown content " << argv[i] << std::endl;
+        return 2;
+      }
+    } else if (arg == "--seeks" && hasValue) {
+      options.seeks = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--seed" && hasValue) {
+      options.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--regenerate") {
+      options.regenerate = true;
+    } else if (arg == "--quick") {
+      quick = true;
+    } else if (arg == "--verbose") {
+      options.verbose = true;
+    } else if (arg == "-h" || arg == "--help") {
+      printUsage();
+      return 0;
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      printUsage();
+      return 2;
+    }
+  }
+
+  if (options.variants.empty())
+    options.variants = defaultVariants();
+  if (quick) {
+    options.variants.resize(1);
+    options.seconds = 5;
+    options.seeks = 20;
+  }
+  mkdir(options.mediaDir.c_str(), 0755);
+
+  // The player logs every cache fill to std::cout, that would swamp the timings and the report
+  std::ofstream discard;
+  std::streambuf* stdoutBuffer = std::cout.rdbuf();
+  if (options.verbose) {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  } else {
+    discard.open("/dev/null");
+    std::cout.rdbuf(discard.rdbuf());
+    av_log_set_level(AV_LOG_ERROR);
+  }
+
+  JsonWriter json;
+  json.beginObject().key("schema").integer(Config::REPORT_SCHEMA).key("label").string(options.label)
+    .key("timestamp").integer((int64_t)time(nullptr)).key("threads").integer(std::thread::hardware_concurrency())
+    .key("config").beginObject().key("seconds").integer(options.seconds).key("fps").integer(options.fps)
+    .key("content").string(SyntheticCapture::contentToString(options.content)).key("seeks").integer(options.seeks)
+    .key("seed").integer(options.seed).endObject();
+
+  int failed = 0;
+  json.key("results").beginArray();
+  for (const Variant& variant : options.variants) {
+    if (!measure(variant, options, json)) {
+      progress(variant, "failed");
+      failed++;
+    }
+  }
+  json.endArray().endObject();
+
+  std::cout.rdbuf(stdoutBuffer);
+  if (options.outputFile.empty()) {
+    std::cout << json.str() << std::endl;
+  } else {
+    std::ofstream out(options.outputFile);
+    out << json.str() << std::endl;
+    if (!out) {
+      std::cerr << "Could not write " << options.outputFile << std::endl;
+      return 1;
+    }
+  }
+  return failed == (int)options.variants.size() ? 1 : 0;
+}
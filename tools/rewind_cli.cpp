@@ -0,0 +1,457 @@
+#include "media_player.hpp"
+#include "scene_analyzer.hpp"
+#include "loudness_analyzer.hpp"
+#include "clip_exporter.hpp"
+#include "project_file.hpp"
+#include "json.hpp"
+
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+extern "C"
+{
+#include <libavutil/log.h>
+}
+
+// Headless batch runs over recordings: build the index, run the analyzers and export clips,
+// several files at once. Engine log lines go to stderr, stdout only carries the report.
+
+namespace Config {
+  const double DEFAULT_MIN_DEAD_TIME = 5.0; // Same as the UI
+  const double DEFAULT_PROGRESS_INTERVAL = 1.0;
+  const int POLL_MS = 50;
+}
+
+struct ClipRequest {
+  std::string name;
+  TimeSpan span;
+};
+
+struct Job {
+  std::string input;
+  std::string outputDir;      // Empty = next to the input
+  bool clipsFromJob = false;  // Listed in a job file, the project's clips are left alone
+  std::vector<ClipRequest> clips;
+};
+
+struct Options {
+  int jobs = 1;
+  bool analyze = true;
+  bool exportClips = true;
+  bool trim = false;
+  bool exportTrimmed = false;
+  bool saveMarkers = false;
+  bool json = false;
+  double minDeadTime = Config::DEFAULT_MIN_DEAD_TIME;
+  double progressInterval = Config::DEFAULT_PROGRESS_INTERVAL;
+  std::string outputDir;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double millisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::string format(const char* pattern, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, pattern);
+  vsnprintf(buffer, sizeof(buffer), pattern, args);
+  va_end(args);
+  return buffer;
+}
+
+// One line per event, as JSON or as text. Lines are written whole so parallel jobs don't interleave.
+class Reporter {
+private:
+  std::mutex mutex;
+  std::ostream out;
+  bool json;
+
+public:
+  Reporter(std::streambuf* buffer, bool json) : out(buffer), json(json) {
+
+  }
+
+  void emit(const JsonWriter& event, const std::string& text) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->out << (this->json ? event.str() : text) << std::endl;
+  }
+};
+
+static JsonWriter& beginEvent(JsonWriter& event, const char* name, const Job& job) {
+  return event.beginObject().key("event").string(name).key("file").string(job.input);
+}
+
+// <output dir or the input's dir>/<input name without extension>-<suffix>.mp4
+static std::string outputPath(const Job& job, const std::string& suffix) {
+  std::string base = job.input;
+  size_t slash = base.find_last_of('/');
+  size_t dot = base.find_last_of('.');
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    base = base.substr(0, dot);
+  if (!job.outputDir.empty())
+    base = job.outputDir + "/" + (slash == std::string::npos ? base : base.substr(slash + 1));
+
+  // Clip names are free text, keep what's safe in a file name
+  std::string safe;
+  for (char c : suffix)
+    safe += (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.') ? c : '_';
+  return base + "-" + safe + ".mp4";
+}
+
+static bool waitForExport(ClipExporter& exporter, const Job& job, const std::string& outputFile, const Options& options, Reporter& reporter) {
+  Clock::time_point start = Clock::now();
+  Clock::time_point reported = start;
+  while (exporter.isRunning()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(Config::POLL_MS));
+    if (millisecondsSince(reported) >= options.progressInterval * 1000.0) {
+      reported = Clock::now();
+      double progress = exporter.getProgress();
+      JsonWriter event;
+      beginEvent(event, "progress", job).key("stage").string("export").key("output").string(outputFile).key("progress").number(progress).endObject();
+      reporter.emit(event, format("[%s] export %s: %.0f%%", job.input.c_str(), outputFile.c_str(), progress * 100.0));
+    }
+  }
+
+  ExportStatus status = exporter.getStatus();
+  double ms = millisecondsSince(start);
+  JsonWriter event;
+  beginEvent(event, "export", job).key("output").string(outputFile).key("ok").boolean(status.succeeded)
+    .key("kept_seconds").number(status.keptSeconds).key("ms").number(ms);
+  if (!status.succeeded)
+    event.key("error").string(status.error);
+  event.endObject();
+  reporter.emit(event, status.succeeded
+    ? format("[%s] export %s: %.1fs in %.0f ms", job.input.c_str(), outputFile.c_str(), status.keptSeconds, ms)
+    : format("[%s] export %s failed: %s", job.input.c_str(), outputFile.c_str(), status.error.c_str()));
+  return status.succeeded;
+}
+
+static bool runJob(const Job& job, const Options& options, Reporter& reporter) {
+  Clock::time_point jobStart = Clock::now();
+  auto finish = [&](bool ok, const std::string& error) {
+    double ms = millisecondsSince(jobStart);
+    JsonWriter event;
+    beginEvent(event, "done", job).key("ok").boolean(ok).key("ms").number(ms);
+    if (!ok)
+      event.key("error").string(error);
+    event.endObject();
+    reporter.emit(event, ok ? format("[%s] done in %.0f ms", job.input.c_str(), ms) : format("[%s] failed: %s", job.input.c_str(), error.c_str()));
+    return ok;
+  };
+
+  // Packet headers only, no decoding
+  Clock::time_point stageStart = Clock::now();
+  MediaPlayer player;
+  if (!player.indexFile(job.input)) {
+    return finish(false, "could not index");
+  }
+  std::shared_ptr<const TimelineIndex> index = player.getTimelineIndex();
+  double duration = index->getEndPts() + index->getAverageFrameDuration() - index->getStartPts();
+  {
+    double ms = millisecondsSince(stageStart);
+    MappedReaderStats input = player.getInputStats();
+    JsonWriter event;
+    beginEvent(event, "index", job).key("frames").integer(index->getFrameCount()).key("duration").number(duration)
+      .key("index_bytes").integer(index->getMemoryBytes()).key("read_bytes").integer(input.bytesRead)
+      .key("major_faults").integer(input.majorFaults).key("ms").number(ms).endObject();
+    reporter.emit(event, format("[%s] index: %zu frames, %.2fs in %.0f ms", job.input.c_str(), index->getFrameCount(), duration, ms));
+  }
+
+  // The project is only created when markers are to be saved into it
+  ProjectFile project;
+  StringArena names;
+  std::vector<Clip> projectClips;
+  std::vector<Bookmark> bookmarks;
+  std::vector<TimeSpan> deadSpans;
+  std::string projectPath = job.input + ".rwproj";
+  bool haveProject = access(projectPath.c_str(), F_OK) == 0;
+  if ((haveProject || options.saveMarkers) && !project.open(projectPath, projectClips, names, bookmarks, deadSpans)) {
+    return finish(false, "could not open " + projectPath);
+  }
+
+  if (options.analyze) {
+    stageStart = Clock::now();
+    SceneAnalyzer sceneAnalyzer;
+    LoudnessAnalyzer loudnessAnalyzer;
+    if (!sceneAnalyzer.open(job.input)) {
+      return finish(false, "could not open for analysis");
+    }
+    bool hasAudio = loudnessAnalyzer.open(job.input);
+    sceneAnalyzer.setIndex(index);
+    loudnessAnalyzer.setIndex(index);
+
+    Clock::time_point reported = stageStart;
+    while (!sceneAnalyzer.isFinished() || (hasAudio && !loudnessAnalyzer.isFinished())) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(Config::POLL_MS));
+      if (millisecondsSince(reported) >= options.progressInterval * 1000.0) {
+        reported = Clock::now();
+        double analyzed = sceneAnalyzer.getStats().analyzedSeconds;
+        if (hasAudio)
+          analyzed = std::min(analyzed, loudnessAnalyzer.getStats().analyzedSeconds);
+        double progress = duration > 0.0 ? std::min(analyzed / duration, 1.0) : 0.0;
+        JsonWriter event;
+        beginEvent(event, "progress", job).key("stage").string("analyze").key("progress").number(progress).endObject();
+        reporter.emit(event, format("[%s] analyze: %.0f%%", job.input.c_str(), progress * 100.0));
+      }
+    }
+
+    // Fresh results replace whatever the project had stored
+    bookmarks = sceneAnalyzer.getBookmarks();
+    std::vector<Bookmark> loudness = loudnessAnalyzer.getBookmarks();
+    bookmarks.insert(bookmarks.end(), loudness.begin(), loudness.end());
+    std::sort(bookmarks.begin(), bookmarks.end(), [](const Bookmark& a, const Bookmark& b) { return a.time < b.time; });
+    std::vector<TimeSpan> silent = hasAudio ? loudnessAnalyzer.getSilentSpans() : std::vector<TimeSpan>{ { 0.0, INFINITY } };
+    deadSpans = intersectSpans(sceneAnalyzer.getStillSpans(), silent, options.minDeadTime);
+
+    size_t counts[3] = { 0, 0, 0 };
+    for (const Bookmark& bookmark : bookmarks)
+      counts[(int)bookmark.kind]++;
+    double deadSeconds = 0.0;
+    for (const TimeSpan& span : deadSpans)
+      deadSeconds += std::min(span.end, index->getEndPts()) - span.start;
+
+    double ms = millisecondsSince(stageStart);
+    SceneStats sceneStats = sceneAnalyzer.getStats();
+    JsonWriter event;
+    beginEvent(event, "analyze", job).key("scene_cuts").integer(counts[(int)BookmarkKind::SceneCut])
+      .key("motion").integer(counts[(int)BookmarkKind::Motion]).key("loudness").integer(counts[(int)BookmarkKind::Loudness])
+      .key("dead_spans").integer(deadSpans.size()).key("dead_seconds").number(deadSeconds).key("has_audio").boolean(hasAudio)
+      .key("scene_fps").number(sceneStats.fps).key("scene_speed").number(sceneStats.speed);
+    if (hasAudio)
+      event.key("loudness_speed").number(loudnessAnalyzer.getStats().speed);
+    event.key("ms").number(ms).endObject();
+    reporter.emit(event, format("[%s] analyze: %zu bookmarks, %.1fs dead time in %.0f ms (scene %.0f fps)",
+      job.input.c_str(), bookmarks.size(), deadSeconds, ms, sceneStats.fps));
+
+    if (options.saveMarkers)
+      project.putMarkers(bookmarks, deadSpans);
+  }
+
+  if (!options.exportClips) {
+    return finish(true, "");
+  }
+
+  std::vector<ClipRequest> clips = job.clips;
+  if (!job.clipsFromJob) {
+    for (const Clip& clip : projectClips)
+      clips.push_back({ names.get(clip.name), { clip.time_start, clip.time_end } });
+  }
+
+  // Dead time comes from this run's analysis, or what the project has stored without one.
+  // Without --trim clips are exported exactly as marked.
+  ClipExporter exporter;
+  std::set<std::string> written;
+  bool ok = true;
+  for (size_t i = 0; i < clips.size(); i++) {
+    std::string suffix = clips[i].name.empty() ? "clip" + std::to_string(i + 1) : clips[i].name;
+    std::string outputFile = outputPath(job, suffix);
+    if (!written.insert(outputFile).second) {
+      outputFile = outputPath(job, suffix + "-" + std::to_string(i + 1));
+      written.insert(outputFile);
+    }
+
+    std::vector<TimeSpan> segments = options.trim ? ClipExporter::planSegments(*index, clips[i].span, deadSpans) : ClipExporter::planPlain(*index, clips[i].span);
+    exporter.start(job.input, outputFile, segments);
+    ok = waitForExport(exporter, job, outputFile, options, reporter) && ok;
+  }
+
+  if (options.exportTrimmed) {
+    std::string outputFile = outputPath(job, "trimmed");
+    TimeSpan range = { index->getStartPts(), index->getEndPts() + index->getAverageFrameDuration() };
+    exporter.start(job.input, outputFile, ClipExporter::planSegments(*index, range, deadSpans));
+    ok = waitForExport(exporter, job, outputFile, options, reporter) && ok;
+  }
+
+  return finish(ok, ok ? "" : "some exports failed");
+}
+
+// Relative paths in a job file are relative to the job file
+static std::string resolvePath(const std::string& directory, const std::string& path) {
+  if (path.empty() || path[0] == '/' || directory.empty()) {
+    return path;
+  }
+  return directory + "/" + path;
+}
+
+static bool readJobFile(const std::string& fileName, const Options& options, std::vector<Job>& jobs) {
+  std::ifstream file(fileName);
+  if (!file) {
+    std::cerr << "Could not read " << fileName << std::endl;
+    return false;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+
+  JsonValue root;
+  std::string error;
+  if (!parseJson(text.str(), root, error)) {
+    std::cerr << fileName << ": " << error << std::endl;
+    return false;
+  }
+
+  size_t slash = fileName.find_last_of('/');
+  std::string directory = slash == std::string::npos ? "" : fileName.substr(0, slash);
+
+  // One job or a list of them
+  std::vector<const JsonValue*> entries;
+  if (root.isArray()) {
+    for (const JsonValue& item : root.items)
+      entries.push_back(&item);
+  } else {
+    entries.push_back(&root);
+  }
+
+  for (const JsonValue* entry : entries) {
+    std::string input = entry->getString("input", "");
+    if (!entry->isObject() || input.empty()) {
+      std::cerr << fileName << ": every job needs an \"input\"" << std::endl;
+      return false;
+    }
+
+    Job job;
+    job.input = resolvePath(directory, input);
+    job.outputDir = entry->get("output") ? resolvePath(directory, entry->getString("output", "")) : options.outputDir;
+    const JsonValue* clips = entry->get("clips");
+    if (clips && clips->isArray()) {
+      job.clipsFromJob = true;
+      for (const JsonValue& clip : clips->items) {
+        ClipRequest request = { clip.getString("name", ""), { clip.getNumber("start", 0.0), clip.getNumber("end", 0.0) } };
+        if (request.span.end <= request.span.start) {
+          std::cerr << fileName << ": clip \"" << request.name << "\" in " << input << " ends before it starts" << std::endl;
+          return false;
+        }
+        job.clips.push_back(request);
+      }
+    }
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+static void printUsage() {
+  std::cerr <<
+    "Usage: rewind_cli [options] <recording | job.json>...\n"
+    "\n"
+    "Indexes and analyzes each recording and exports its clips. Clips come from the\n"
+    "recording's project (<recording>.rwproj) or from a JSON job file, one job or a list:\n"
+    "  {\"input\": \"rec.mp4\", \"output\": \"out\", \"clips\": [{\"name\": \"intro\", \"start\": 0, \"end\": 12.5}]}\n"
+    "\n"
+    "Options:\n"
+    "  -j, --jobs N         Recordings processed at once (default: half the hardware threads)\n"
+    "  -o, --output DIR     Where exports go (default: next to the recording)\n"
+    "  --no-analyze         Skip the analyzers, dead time comes from the project if any\n"
+    "  --no-export          Index and analyze only\n"
+    "  --trim               Cut dead time out of exported clips\n"
+    "  --export-trimmed     Also export the whole recording without dead time\n"
+    "  --save-markers       Store bookmarks and dead time in the project\n"
+    "  --min-dead SECONDS   Shortest stretch counted as dead time (default 5)\n"
+    "  --progress SECONDS   Time between progress lines (default 1)\n"
+    "  --json               One JSON object per line instead of text\n";
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  options.jobs = std::max(1, (int)std::thread::hardware_concurrency() / 2);
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if ((arg == "-j" || arg == "--jobs") && hasValue) {
+      options.jobs = std::max(1, atoi(argv[++i]));
+    } else if ((arg == "-o" || arg == "--output") && hasValue) {
+      options.outputDir = argv[++i];
+    } else if (arg == "--no-analyze") {
+      options.analyze = false;
+    } else if (arg == "--no-export") {
+      options.exportClips = false;
+    } else if (arg == "--trim") {
+      options.trim = true;
+    } else if (arg == "--export-trimmed") {
+      options.exportTrimmed = true;
+    } else if (arg == "--save-markers") {
+      options.saveMarkers = true;
+    } else if (arg == "--min-dead" && hasValue) {
+      options.minDeadTime = atof(argv[++i]);
+    } else if (arg == "--progress" && hasValue) {
+      options.progressInterval = atof(argv[++i]);
+    } else if (arg == "--json") {
+      options.json = true;
+    } else if (arg == "-h" || arg == "--help") {
+      printUsage();
+      return 0;
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "Unknown option " << arg << std::endl;
+      printUsage();
+      return 2;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  if (inputs.empty()) {
+    printUsage();
+    return 2;
+  }
+
+  std::vector<Job> jobs;
+  for (const std::string& input : inputs) {
+    if (input.size() > 5 && input.compare(input.size() - 5, 5, ".json") == 0) {
+      if (!readJobFile(input, options, jobs))
+        return 2;
+    } else {
+      Job job;
+      job.input = input;
+      job.outputDir = options.outputDir;
+      jobs.push_back(job);
+    }
+  }
+
+  // The engine logs to std::cout, keep that out of the report
+  std::streambuf* stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+  av_log_set_level(AV_LOG_ERROR);
+  Reporter reporter(stdoutBuffer, options.json);
+
+  // Each job runs its analyzers on threads of their own, so a worker per job is enough
+  Clock::time_point start = Clock::now();
+  std::atomic<size_t> next(0);
+  std::atomic<int> failed(0);
+  std::vector<std::thread> workers;
+  int workerCount = std::min(options.jobs, (int)jobs.size());
+  for (int i = 0; i < workerCount; i++) {
+    workers.emplace_back([&]() {
+      for (size_t job = next++; job < jobs.size(); job = next++) {
+        if (!runJob(jobs[job], options, reporter))
+          failed++;
+      }
+    });
+  }
+  for (std::thread& worker : workers)
+    worker.join();
+
+  double ms = millisecondsSince(start);
+  JsonWriter event;
+  event.beginObject().key("event").string("summary").key("files").integer(jobs.size()).key("failed").integer(failed)
+    .key("jobs").integer(workerCount).key("ms").number(ms).endObject();
+  reporter.emit(event, format("%zu files, %d failed in %.0f ms", jobs.size(), (int)failed, ms));
+
+  std::cout.rdbuf(stdoutBuffer);
+  return failed > 0 ? 1 : 0;
+}